@@ -1,57 +1,94 @@
-#pragma once
-
-#include "Main.h"
-
-struct AABB {
-	glm::vec3 mCenter = { 0, 0, 0 };
-	glm::vec3 mHalfSize = { 0, 0, 0 };
-	AABB() {}
-	AABB(const glm::vec3& center, const glm::vec3& halfSize) : mCenter(center), mHalfSize(halfSize) {}
-	glm::vec3 GetMin() const {
-		return mCenter - mHalfSize;
-	}
-	glm::vec3 GetMax() const {
-		return mCenter + mHalfSize;
-	}
-	AABB Extend(const glm::vec3& v) const {
-		auto min = GetMin();
-		auto max = GetMax();
-		for (int i = 0; i < 3; ++i) {
-			min[i] = std::min(min[i], v[i]);
-			max[i] = std::max(max[i], v[i]);
-		}
-		return AABB::FromExtents(min, max);
-	}
-	AABB Extend(std::initializer_list<glm::vec3> args) const {
-		auto min = GetMin();
-		auto max = GetMax();
-		for (int i = 0; i < 3; ++i) {
-			for (const auto & arg : args) {
-				min[i] = std::min(min[i], arg[i]);
-				max[i] = std::max(max[i], arg[i]);
-			}
-		}
-		return AABB::FromExtents(min, max);
-	}
-	AABB Extend(const AABB& other) const {
-		return Extend({ other.GetMin(), other.GetMax() });
-	}
-	static AABB FromExtents(const glm::vec3& min, const glm::vec3& max) {
-		glm::vec3 mHalfSize = (max - min) * 0.5f;
-		return AABB(min + mHalfSize, mHalfSize);
-	}
-	static AABB FromVertices(const std::vector<Vertex>& vertices) {
-		if (!vertices.size()) {
-			return AABB();
-		}
-		glm::vec3 min = vertices[0].mPos;
-		glm::vec3 max = vertices[0].mPos;
-		for (const auto& v : vertices) {
-			for (int i = 0; i < 3; ++i) {
-				min[i] = std::min(min[i], v.mPos[i]);
-				max[i] = std::max(max[i], v.mPos[i]);
-			}
-		}
-		return FromExtents(min, max);
-	}
-};
+#pragma once
+
+#include "Main.h"
+#include "Vertex.h"
+
+struct AABB {
+	glm::vec3 mCenter = { 0, 0, 0 };
+	glm::vec3 mHalfSize = { 0, 0, 0 };
+	AABB() {}
+	AABB(const glm::vec3& center, const glm::vec3& halfSize) : mCenter(center), mHalfSize(halfSize) {}
+	glm::vec3 GetMin() const {
+		return mCenter - mHalfSize;
+	}
+	glm::vec3 GetMax() const {
+		return mCenter + mHalfSize;
+	}
+	AABB Extend(const glm::vec3& v) const {
+		auto min = GetMin();
+		auto max = GetMax();
+		for (int i = 0; i < 3; ++i) {
+			min[i] = std::min(min[i], v[i]);
+			max[i] = std::max(max[i], v[i]);
+		}
+		return AABB::FromExtents(min, max);
+	}
+	AABB Extend(std::initializer_list<glm::vec3> args) const {
+		auto min = GetMin();
+		auto max = GetMax();
+		for (int i = 0; i < 3; ++i) {
+			for (const auto & arg : args) {
+				min[i] = std::min(min[i], arg[i]);
+				max[i] = std::max(max[i], arg[i]);
+			}
+		}
+		return AABB::FromExtents(min, max);
+	}
+	AABB Extend(const AABB& other) const {
+		return Extend({ other.GetMin(), other.GetMax() });
+	}
+	AABB Grow(float margin) const {
+		return AABB(mCenter, mHalfSize + glm::vec3(margin));
+	}
+	AABB Transform(const glm::mat4& m) const {
+		glm::vec3 center = m * glm::vec4(mCenter, 1.0f);
+		glm::vec3 halfSize;
+		for (int i = 0; i < 3; ++i) {
+			halfSize[i] = glm::abs(m[0][i]) * mHalfSize.x + glm::abs(m[1][i]) * mHalfSize.y + glm::abs(m[2][i]) * mHalfSize.z;
+		}
+		return AABB(center, halfSize);
+	}
+	bool Contains(const AABB& other) const {
+		return glm::all(glm::lessThanEqual(glm::abs(other.mCenter - mCenter) + other.mHalfSize, mHalfSize));
+	}
+	bool Intersects(const AABB& other) const {
+		return glm::all(glm::lessThanEqual(glm::abs(other.mCenter - mCenter), mHalfSize + other.mHalfSize));
+	}
+	bool Intersects(const glm::vec3& center, float radius) const {
+		auto d = glm::max(glm::abs(center - mCenter) - mHalfSize, glm::vec3(0.0f));
+		return glm::dot(d, d) <= radius * radius;
+	}
+	// Slab test, invDir = 1 / ray direction
+	bool IntersectsRay(const glm::vec3& origin, const glm::vec3& invDir, float maxDistance, float& distance) const {
+		auto t0 = (GetMin() - origin) * invDir;
+		auto t1 = (GetMax() - origin) * invDir;
+		auto tmin = glm::min(t0, t1);
+		auto tmax = glm::max(t0, t1);
+		float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+		float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, maxDistance));
+		distance = enter;
+		return enter <= exit;
+	}
+	float GetSurfaceArea() const {
+		auto s = mHalfSize * 2.0f;
+		return 2.0f * (s.x * s.y + s.y * s.z + s.z * s.x);
+	}
+	static AABB FromExtents(const glm::vec3& min, const glm::vec3& max) {
+		glm::vec3 mHalfSize = (max - min) * 0.5f;
+		return AABB(min + mHalfSize, mHalfSize);
+	}
+	static AABB FromVertices(const std::vector<Vertex>& vertices) {
+		if (!vertices.size()) {
+			return AABB();
+		}
+		glm::vec3 min = vertices[0].mPos;
+		glm::vec3 max = vertices[0].mPos;
+		for (const auto& v : vertices) {
+			for (int i = 0; i < 3; ++i) {
+				min[i] = std::min(min[i], v.mPos[i]);
+				max[i] = std::max(max[i], v.mPos[i]);
+			}
+		}
+		return FromExtents(min, max);
+	}
+};
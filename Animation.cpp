@@ -1 +1 @@
-#include "Animation.h"
+#include "Animation.h"
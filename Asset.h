@@ -1,80 +1,112 @@
-#pragma once
-
-#include "Main.h"
-
-template<typename T>
-struct AssetMgr {
-	typedef std::shared_ptr<T> T_;
-	std::map<std::string, T_> mAssets;
-	std::map<std::string, std::string> mKeyCache;
-	rapidjson::Document mDefaultOptions;
-	bool mUseCache = true;
-
-	AssetMgr() {
-		mDefaultOptions.Parse("{}");
-	}
-
-	// TODO: hash file content
-	// TODO: options
-	std::string CreateKey(const std::string& name) {
-		auto it = mKeyCache.find(name);
-		if (it != mKeyCache.end()) {
-			return it->second;
-		}
-		auto id = std::hash<std::string>{}(name);
-		auto key = "cache/" + std::to_string(id) + ".dat";
-		mKeyCache[name] = key;
-		std::cout << name << " -> " << key << std::endl;
-		return key;
-	}
-
-	T_ Load(const std::string& name) {
-		auto key = CreateKey(name);
-		auto it = mAssets.find(key);
-		if (it != mAssets.end()) return it->second;
-		auto asset = std::make_shared<T>();
-		if (mUseCache && std::filesystem::exists(key)) {
-			asset->Import(key);
-		} else {
-			if (name.find(".json") != -1) {
-				rapidjson::Document options;
-				LoadJson(options, name);
-				assert(options.HasMember("source"));
-				asset->Load(options["source"].GetString(), options);
-			} else {
-				auto pos = name.find_first_of("?");
-				if (pos != -1) {
-					auto fileName = name.substr(0, pos);
-					auto opts = name.substr(pos + 1);
-					rapidjson::Document options;
-					options.Parse(opts.c_str());
-					asset->Load(fileName, options.GetObject());
-				} else {
-					asset->Load(name, mDefaultOptions);
-				}
-			}
-			if (mUseCache) {
-				asset->Export(key);
-			}
-		}
-		mAssets[key] = asset;
-		return asset;
-	}
-
-	T_ Load(const std::string& name, const rapidjson::Value& options) {
-		rapidjson::Document doc;
-		doc.CopyFrom(options, doc.GetAllocator());
-		std::ostringstream oss;
-		rapidjson::OStreamWrapper osw(oss);
-		rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
-		doc.Accept(writer);
-		return Load(name + "?" + oss.str());
-	}
-
-	T_ Load(const std::string& name, const rapidjson::Value& options, const std::string& optionsKey) {
-		if (options.HasMember(optionsKey.c_str())) {
-			return Load(name, options[optionsKey.c_str()]);
-		}
-		return Load(name);
-	}
-};
+#pragma once
+
+#include "Main.h"
+
+// What a cache file was built from. Import rejects a cache whose stamp
+// differs, the source file or the load options changed since the export.
+struct AssetStamp {
+	uint64_t mSourceSize = 0;
+	uint64_t mSourceTime = 0; // last write time in ticks of the file clock
+	uint64_t mOptionsHash = 0; // HashString of the options as JSON
+
+	static AssetStamp Create(const std::string& source, const rapidjson::Value& options) {
+		AssetStamp stamp;
+		std::error_code error;
+		const auto size = std::filesystem::file_size(source, error);
+		if (!error) stamp.mSourceSize = size;
+		const auto time = std::filesystem::last_write_time(source, error);
+		if (!error) stamp.mSourceTime = (uint64_t)time.time_since_epoch().count();
+		stamp.mOptionsHash = HashString(ToJson(options));
+		return stamp;
+	}
+
+	static std::string ToJson(const rapidjson::Value& value) {
+		std::ostringstream oss;
+		rapidjson::OStreamWrapper osw(oss);
+		rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+		value.Accept(writer);
+		return oss.str();
+	}
+
+	bool operator==(const AssetStamp& other) const {
+		return mSourceSize == other.mSourceSize && mSourceTime == other.mSourceTime && mOptionsHash == other.mOptionsHash;
+	}
+	bool operator!=(const AssetStamp& other) const {
+		return !(*this == other);
+	}
+};
+
+template<typename T>
+struct AssetMgr {
+	typedef std::shared_ptr<T> T_;
+	std::map<std::string, T_> mAssets;
+	std::map<std::string, std::string> mKeyCache;
+	rapidjson::Document mDefaultOptions;
+	bool mUseCache = true;
+
+	AssetMgr() {
+		mDefaultOptions.Parse("{}");
+	}
+
+	std::string CreateKey(const std::string& name) {
+		auto it = mKeyCache.find(name);
+		if (it != mKeyCache.end()) {
+			return it->second;
+		}
+		auto id = HashString(name);
+		auto key = "cache/" + std::to_string(id) + ".dat";
+		mKeyCache[name] = key;
+		std::cout << name << " -> " << key << std::endl;
+		return key;
+	}
+
+	// Splits an asset name into the source file and its load options: a .json
+	// file with the options and a "source" member, "file?{options}" or a plain
+	// file loaded with mDefaultOptions
+	void ParseName(const std::string& name, std::string& source, rapidjson::Document& options) {
+		if (name.find(".json") != -1) {
+			LoadJson(options, name);
+			assert(options.HasMember("source"));
+			source = options["source"].GetString();
+			return;
+		}
+		auto pos = name.find_first_of("?");
+		if (pos != -1) {
+			source = name.substr(0, pos);
+			options.Parse(name.substr(pos + 1).c_str());
+		} else {
+			source = name;
+			options.CopyFrom(mDefaultOptions, options.GetAllocator());
+		}
+	}
+
+	T_ Load(const std::string& name) {
+		auto key = CreateKey(name);
+		auto it = mAssets.find(key);
+		if (it != mAssets.end()) return it->second;
+		std::string source;
+		rapidjson::Document options;
+		ParseName(name, source, options);
+		const auto stamp = AssetStamp::Create(source, options);
+		auto asset = std::make_shared<T>();
+		if (!mUseCache || !std::filesystem::exists(key) || !asset->Import(key, stamp)) {
+			asset->Load(source, options);
+			if (mUseCache) {
+				asset->Export(key, stamp);
+			}
+		}
+		mAssets[key] = asset;
+		return asset;
+	}
+
+	T_ Load(const std::string& name, const rapidjson::Value& options) {
+		return Load(name + "?" + AssetStamp::ToJson(options));
+	}
+
+	T_ Load(const std::string& name, const rapidjson::Value& options, const std::string& optionsKey) {
+		if (options.HasMember(optionsKey.c_str())) {
+			return Load(name, options[optionsKey.c_str()]);
+		}
+		return Load(name);
+	}
+};
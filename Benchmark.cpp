@@ -0,0 +1,117 @@
+#include "Benchmark.h"
+
+bool Benchmark::Finish(Profiler& profiler, int physicsThreads) {
+	// Closes the last frame, the extra boundaries only read back GPU queries
+	for (size_t i = 0; i <= GpuProfiler::Latency; i++) {
+		profiler.EndFrame();
+	}
+
+	const auto renderer = glGetString(GL_RENDERER);
+	bool result = WriteReport(profiler, renderer ? (const char*)renderer : "", physicsThreads);
+	if (!mTrace.empty()) {
+		result &= profiler.ExportChromeTrace(mTrace);
+	}
+	return result;
+}
+
+bool Benchmark::WriteReport(const Profiler& profiler, const std::string& renderer, int physicsThreads) const {
+	// mFrames[0] is startup up to the first frame boundary, then warmup and measured frames
+	const auto first = 1 + mWarmup;
+	if (profiler.mFrames.size() < first + mFrames) {
+		std::cerr << "Benchmark: profiler recorded " << profiler.mFrames.size() << " frames, expected " << first + mFrames << std::endl;
+		return false;
+	}
+
+	const auto droppedEvents = profiler.GetDroppedEvents();
+	for (const auto& dropped : droppedEvents) {
+		std::cerr << "Benchmark: profiler dropped " << dropped.second << " events of " << dropped.first << ", subsystem times are incomplete" << std::endl;
+	}
+
+	FrameCounter<float> frameTimes(mFrames);
+	// Per frame sums of each scope, GPU scopes are prefixed
+	std::map<std::string, std::vector<float>> subsystems;
+	std::map<std::string, size_t> calls;
+	for (size_t frame = 0; frame < mFrames; frame++) {
+		const auto& profile = profiler.mFrames[first + frame];
+		frameTimes.Record((profile.mEnd - profile.mBegin) / 1e6f);
+		for (const auto& event : profile.mEvents) {
+			const auto name = (event.mThread == GpuProfiler::Thread ? "GPU " : "") + std::string(event.mName);
+			auto& times = subsystems[name];
+			times.resize(mFrames, 0.0f);
+			times[frame] += (event.mEnd - event.mBegin) / 1e6f;
+			calls[name]++;
+		}
+	}
+
+	std::ofstream ofs(mReport);
+	if (!ofs.is_open()) {
+		std::cerr << "Could not write benchmark report: " << mReport << std::endl;
+		return false;
+	}
+	rapidjson::OStreamWrapper osw(ofs);
+	rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+
+	auto writeStats = [&writer](const FrameTimeStats& stats) {
+		writer.Key("mean"); writer.Double(stats.mMean);
+		writer.Key("p50"); writer.Double(stats.mP50);
+		writer.Key("p95"); writer.Double(stats.mP95);
+		writer.Key("p99"); writer.Double(stats.mP99);
+		writer.Key("max"); writer.Double(stats.mMax);
+	};
+
+	writer.StartObject();
+	writer.Key("scene"); writer.String(mScene.c_str());
+	writer.Key("renderer"); writer.String(renderer.c_str());
+	writer.Key("frames"); writer.Uint64(mFrames);
+	writer.Key("warmup"); writer.Uint64(mWarmup);
+	writer.Key("step"); writer.Double(mStep);
+	writer.Key("seed"); writer.Uint(mSeed);
+	writer.Key("draw"); writer.Bool(mDraw);
+	writer.Key("physicsThreads"); writer.Int(physicsThreads); // 0: single threaded world
+
+	// Whole run, any drop means the subsystem times below are short
+	writer.Key("droppedEvents");
+	writer.StartObject();
+	for (const auto& dropped : droppedEvents) {
+		writer.Key(dropped.first.c_str()); writer.Uint64(dropped.second);
+	}
+	writer.EndObject();
+
+	// All times in ms
+	const auto stats = frameTimes.GetRunStats();
+	writer.Key("frameTime");
+	writer.StartObject();
+	writeStats(stats);
+	writer.Key("budget"); writer.Double(frameTimes.mBudget);
+	writer.Key("hitches"); writer.Uint64(stats.mHitches);
+	writer.EndObject();
+
+	// Percentiles of the per frame totals, over all measured frames
+	writer.Key("subsystems");
+	writer.StartObject();
+	for (auto& it : subsystems) {
+		auto& times = it.second;
+		FrameTimeStats subsystem;
+		subsystem.mMean = std::accumulate(times.begin(), times.end(), 0.0f) / mFrames;
+		std::sort(times.begin(), times.end());
+		auto percentile = [&times](double p) {
+			return times[std::min((size_t)std::ceil(p * times.size()), times.size()) - 1];
+		};
+		subsystem.mP50 = percentile(0.50);
+		subsystem.mP95 = percentile(0.95);
+		subsystem.mP99 = percentile(0.99);
+		subsystem.mMax = times.back();
+
+		writer.Key(it.first.c_str());
+		writer.StartObject();
+		writeStats(subsystem);
+		writer.Key("callsPerFrame"); writer.Double((double)calls[it.first] / mFrames);
+		writer.EndObject();
+	}
+	writer.EndObject();
+	writer.EndObject();
+
+	std::cout << "Benchmark: " << mFrames << " frames, report written to " << mReport << std::endl;
+	frameTimes.Log(std::cout);
+	return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Main.h"
+#include "Camera.h"
+#include "Profiler.h"
+
+// Scripted movement of the selected entity, axes in -1..1
+struct BenchmarkInput {
+	float mWalk = 0.0f;
+	float mStrafe = 0.0f;
+	bool mJump = false;
+};
+
+// Reproducible run of the frame loop:
+//   -s scene.json --benchmark [--frames N] [--warmup N] [--step seconds]
+//   [--seed N] [--no-draw] [--context native|egl|osmesa] [--report file]
+//   [--trace file] [--physics-threads N]
+// Time advances by a fixed step, the camera orbits the scene on a fixed path
+// and the selected entity follows a fixed input script. The window is hidden,
+// but GLFW 3.3 still needs a display connection (Xvfb on a headless machine)
+// and a GL 3.3 context. --context selects the context creation API, osmesa
+// renders in software without a GPU. --no-draw still creates the context and
+// the scene's GL resources, it only skips draw submission. --physics-threads
+// overrides the scene's physics settings, 0 steps the single threaded world,
+// for comparing the Physics scope across thread counts. After the last
+// frame the per subsystem timings of the profiler are written as JSON.
+struct Benchmark {
+	bool mEnabled = false;
+	bool mDraw = true; // false: simulate, cull and gather draws but submit nothing
+	size_t mFrames = 600; // measured frames
+	size_t mWarmup = 60; // shader compiles, first uploads
+	float mStep = 1.0f / 60.0f;
+	unsigned mSeed = 0;
+	int mContextApi = GLFW_NATIVE_CONTEXT_API; // GLFW_CONTEXT_CREATION_API hint
+	std::string mScene;
+	std::string mReport = "benchmark.json";
+	std::string mTrace; // Chrome trace of the whole run if set
+	int mPhysicsThreads = -1; // -1: as configured by the scene
+	size_t mFrame = 0; // frames started
+
+	glm::vec3 mOrbitCenter = { 0.0f, 1.0f, 0.0f };
+	float mOrbitRadius = 15.0f;
+	float mOrbitHeight = 5.0f;
+	float mOrbitPeriod = 10.0f; // seconds per revolution
+
+	Benchmark(const int argc, const char** argv) {
+		for (int i = 1; i < argc; ++i) {
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--benchmark") {
+				mEnabled = true;
+			} else if (arg == "--no-draw") {
+				mDraw = false;
+			} else if (arg == "--frames" && hasValue) {
+				mFrames = std::stoul(argv[++i]);
+			} else if (arg == "--warmup" && hasValue) {
+				mWarmup = std::stoul(argv[++i]);
+			} else if (arg == "--step" && hasValue) {
+				mStep = std::stof(argv[++i]);
+			} else if (arg == "--seed" && hasValue) {
+				mSeed = (unsigned)std::stoul(argv[++i]);
+			} else if (arg == "--context" && hasValue) {
+				const std::string api = argv[++i];
+				if (api == "egl") {
+					mContextApi = GLFW_EGL_CONTEXT_API;
+				} else if (api == "osmesa") {
+					mContextApi = GLFW_OSMESA_CONTEXT_API;
+				} else if (api != "native") {
+					std::cerr << "Warning: Unknown context API " << api << ", using native" << std::endl;
+				}
+			} else if (arg == "--report" && hasValue) {
+				mReport = argv[++i];
+			} else if (arg == "--trace" && hasValue) {
+				mTrace = argv[++i];
+			} else if (arg == "--physics-threads" && hasValue) {
+				mPhysicsThreads = std::stoi(argv[++i]);
+			} else if (arg == "-s" && hasValue) {
+				mScene = argv[++i];
+			}
+		}
+		if (!mEnabled) {
+			mDraw = true;
+		}
+		mFrames = std::max(mFrames, (size_t)1);
+	}
+
+	size_t GetTotalFrames() const {
+		return mWarmup + mFrames;
+	}
+
+	bool IsDone() const {
+		return mEnabled && mFrame >= GetTotalFrames();
+	}
+
+	// Replaces Timer::Update at the top of the frame loop
+	template<typename T>
+	void BeginFrame(Timer<T>& timer) {
+		timer.Step((T)mStep);
+		mFrame++;
+	}
+
+	// Walk forward, change the strafe direction every 4 s and jump every 5 s.
+	// Counted in frames, float time would drift and skip or double jumps.
+	BenchmarkInput GetInput() const {
+		BenchmarkInput input;
+		input.mWalk = 1.0f;
+		input.mStrafe = mFrame / GetFrames(4.0) % 2 ? 0.5f : -0.5f;
+		input.mJump = mFrame % GetFrames(5.0) == 0;
+		return input;
+	}
+
+	// Whole steps in the given time, at least one
+	size_t GetFrames(double seconds) const {
+		return std::max((size_t)std::lround(seconds / mStep), (size_t)1);
+	}
+
+	void UpdateCamera(Camera& cam, float now) const {
+		const auto angle = now / mOrbitPeriod * glm::two_pi<float>();
+		cam.mPos = mOrbitCenter + glm::vec3(std::cos(angle) * mOrbitRadius, mOrbitHeight, std::sin(angle) * mOrbitRadius);
+		cam.mFront = glm::normalize(mOrbitCenter - cam.mPos);
+		cam.mRight = glm::normalize(glm::cross(cam.mUp, cam.mFront));
+	}
+
+	// Profiler::mFrames must hold every frame of the run, see PrepareProfiler
+	void PrepareProfiler(Profiler& profiler) const {
+		profiler.mFrameLimit = GetTotalFrames() + GpuProfiler::Latency + 2;
+		profiler.mPaused = false;
+	}
+
+	// Resolves the outstanding GPU queries and writes the report and trace,
+	// the profiler must not have recorded anything after the last frame
+	bool Finish(Profiler& profiler, int physicsThreads);
+
+	bool WriteReport(const Profiler& profiler, const std::string& renderer, int physicsThreads) const;
+};
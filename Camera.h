@@ -1,39 +1,81 @@
-#pragma once
-
-#include "Main.h"
-
-struct Camera {
-	glm::vec3 mPos = { 0,0,0 };
-	glm::vec3 mFront = { 0,0,1 };
-	glm::vec3 mUp = { 0,1,0 };
-	glm::vec3 mRight;
-
-	float mFov = glm::radians(45.0f);
-	float mAspect = 1.0f;
-	float mNear = 0.1f;
-	float mFar = 10000.0f;
-
-	glm::mat4 mView;
-	glm::mat4 mProjection;
-
-	void Look(float yaw, float pitch) {
-		glm::vec3 dir = {
-			cos(glm::radians(yaw)) * cos(glm::radians(pitch)),
-			sin(glm::radians(pitch)),
-			sin(glm::radians(yaw)) * cos(glm::radians(pitch)),
-		};
-		mFront = glm::normalize(dir);
-	}
-
-	void SetAspect(int width, int height) {
-		mAspect = width / (float)height;
-	}
-
-	void UpdateView() {
-		mView = glm::lookAt(mPos, mPos + mFront, mUp);
-	}
-
-	void UpdateProjection() {
-		mProjection = glm::perspective(mFov, mAspect, mNear, mFar);
-	}
-};
+#pragma once
+
+#include "Main.h"
+#include "AABB.h"
+
+struct Frustum {
+	glm::vec4 mPlanes[6];
+
+	// Gribb/Hartmann plane extraction, expects zero to one depth range
+	static Frustum FromMatrix(const glm::mat4& m) {
+		auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+		Frustum frustum;
+		frustum.mPlanes[0] = row(3) + row(0);
+		frustum.mPlanes[1] = row(3) - row(0);
+		frustum.mPlanes[2] = row(3) + row(1);
+		frustum.mPlanes[3] = row(3) - row(1);
+		frustum.mPlanes[4] = row(2);
+		frustum.mPlanes[5] = row(3) - row(2);
+		for (auto& plane : frustum.mPlanes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return frustum;
+	}
+
+	bool Intersects(const AABB& aabb) const {
+		for (const auto& plane : mPlanes) {
+			const glm::vec3 n = plane;
+			if (glm::dot(n, aabb.mCenter) + glm::dot(glm::abs(n), aabb.mHalfSize) + plane.w < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+struct Camera {
+	glm::vec3 mPos = { 0,0,0 };
+	glm::vec3 mFront = { 0,0,1 };
+	glm::vec3 mUp = { 0,1,0 };
+	glm::vec3 mRight;
+
+	float mFov = glm::radians(45.0f);
+	float mAspect = 1.0f;
+	float mNear = 0.1f;
+	float mFar = 10000.0f;
+
+	glm::mat4 mView;
+	glm::mat4 mProjection;
+
+	void Look(float yaw, float pitch) {
+		glm::vec3 dir = {
+			cos(glm::radians(yaw)) * cos(glm::radians(pitch)),
+			sin(glm::radians(pitch)),
+			sin(glm::radians(yaw)) * cos(glm::radians(pitch)),
+		};
+		mFront = glm::normalize(dir);
+	}
+
+	void SetAspect(int width, int height) {
+		mAspect = width / (float)height;
+	}
+
+	void UpdateView() {
+		mView = glm::lookAt(mPos, mPos + mFront, mUp);
+	}
+
+	void UpdateProjection() {
+		mProjection = glm::perspective(mFov, mAspect, mNear, mFar);
+	}
+
+	Frustum GetFrustum() const {
+		return Frustum::FromMatrix(mProjection * mView);
+	}
+
+	// Fraction of the viewport height covered by a sphere, 1 if the camera is inside it
+	float GetScreenSize(const glm::vec3& center, float radius) const {
+		const float distance = glm::length(center - mPos);
+		if (distance <= radius) return 1.0f;
+		return radius / (distance * std::tan(mFov * 0.5f));
+	}
+};
@@ -0,0 +1,456 @@
+#pragma once
+
+#include "Main.h"
+#include "Model.h"
+#include "Shader.h"
+#include "ParticleEmitter.h"
+
+struct Entity;
+
+typedef uint32_t EntityID;
+constexpr EntityID InvalidEntityID = -1;
+
+// Sparse set: dense component storage that systems iterate linearly,
+// plus an EntityID -> dense index lookup for random access
+template<typename T>
+struct ComponentArray {
+	std::vector<T> mData;
+	std::vector<EntityID> mEntities;
+	std::vector<uint32_t> mIndices;
+
+	T& Add(EntityID id, const T& value = T()) {
+		if (id >= mIndices.size()) {
+			mIndices.resize(id + 1, InvalidEntityID);
+		}
+		if (mIndices[id] != InvalidEntityID) {
+			return mData[mIndices[id]] = value;
+		}
+		mIndices[id] = (uint32_t)mData.size();
+		mEntities.push_back(id);
+		mData.push_back(value);
+		return mData.back();
+	}
+
+	void Remove(EntityID id) {
+		if (!Has(id)) return;
+		const auto index = mIndices[id];
+		const auto last = (uint32_t)mData.size() - 1;
+		if (index != last) {
+			mData[index] = std::move(mData[last]);
+			mEntities[index] = mEntities[last];
+			mIndices[mEntities[index]] = index;
+		}
+		mData.pop_back();
+		mEntities.pop_back();
+		mIndices[id] = InvalidEntityID;
+	}
+
+	bool Has(EntityID id) const {
+		return id < mIndices.size() && mIndices[id] != InvalidEntityID;
+	}
+
+	T& Get(EntityID id) {
+		assert(Has(id));
+		return mData[mIndices[id]];
+	}
+
+	const T& Get(EntityID id) const {
+		assert(Has(id));
+		return mData[mIndices[id]];
+	}
+
+	T* Find(EntityID id) {
+		return Has(id) ? &mData[mIndices[id]] : nullptr;
+	}
+
+	const T* Find(EntityID id) const {
+		return Has(id) ? &mData[mIndices[id]] : nullptr;
+	}
+
+	size_t Size() const {
+		return mData.size();
+	}
+
+	// Reorders the dense arrays, order[i] is the old dense index of the new element i
+	void Permute(const std::vector<uint32_t>& order) {
+		assert(order.size() == mData.size());
+		std::vector<T> data;
+		std::vector<EntityID> entities;
+		data.reserve(order.size());
+		entities.reserve(order.size());
+		for (auto index : order) {
+			data.push_back(std::move(mData[index]));
+			entities.push_back(mEntities[index]);
+		}
+		mData.swap(data);
+		mEntities.swap(entities);
+		for (uint32_t i = 0; i < (uint32_t)mEntities.size(); ++i) {
+			mIndices[mEntities[i]] = i;
+		}
+	}
+};
+
+struct TransformComponent {
+	glm::vec3 mPos = { 0,0,0 };
+	glm::quat mRot = { 1,0,0,0 };
+	glm::vec3 mScale = { 1,1,1 };
+	glm::mat4 mWorld = glm::identity<glm::mat4>();
+	glm::vec3 mPrevOffset = { 0,0,0 }; // position before the last physics step relative to mPos, for interpolation
+	EntityID mParent = InvalidEntityID;
+	uint32_t mParentNode = -1;
+	EntityID mFirstChild = InvalidEntityID; // children of the entity, kept by EntityRegistry::SetParent
+	EntityID mNextSibling = InvalidEntityID;
+	EntityID mPrevSibling = InvalidEntityID;
+	bool mRigidBody = false; // mWorld is written by the bullet motion state
+	bool mDirty = true; // set when mPos/mRot/mScale (or mWorld for rigid bodies) is modified
+	bool mChanged = false; // mWorld changed this frame
+};
+
+// Non rigid body physics for entities using gravity. Sparse set like
+// ComponentArray but stored as SoA so the integrator vectorizes.
+struct BodyArray {
+	static constexpr float DefaultMaxVelocity = 100.0f;
+	static inline const glm::vec3 DefaultGravity = { 0, -10, 0 };
+
+	std::vector<EntityID> mEntities;
+	std::vector<uint32_t> mIndices;
+	std::vector<float> mPosX, mPosY, mPosZ;
+	std::vector<float> mVelX, mVelY, mVelZ;
+	std::vector<float> mForceX, mForceY, mForceZ;
+	std::vector<float> mGravityX, mGravityY, mGravityZ;
+	std::vector<float> mMaxVelocity;
+	std::vector<uint8_t> mGrounded;
+	std::vector<float> mPrevX, mPrevY, mPrevZ; // before the last step of a frame, scratch of EntityRegistry::UpdateBodies
+
+	template<typename F>
+	void ForEachArray(F f) {
+		f(mPosX); f(mPosY); f(mPosZ);
+		f(mVelX); f(mVelY); f(mVelZ);
+		f(mForceX); f(mForceY); f(mForceZ);
+		f(mGravityX); f(mGravityY); f(mGravityZ);
+		f(mMaxVelocity);
+		f(mGrounded);
+	}
+
+	void Add(EntityID id, const glm::vec3& gravity = DefaultGravity) {
+		if (id >= mIndices.size()) {
+			mIndices.resize(id + 1, InvalidEntityID);
+		}
+		if (mIndices[id] == InvalidEntityID) {
+			mIndices[id] = (uint32_t)mEntities.size();
+			mEntities.push_back(id);
+			ForEachArray([](auto& v) { v.emplace_back(); });
+		}
+		const auto index = mIndices[id];
+		ForEachArray([index](auto& v) { v[index] = 0; });
+		mGravityX[index] = gravity.x;
+		mGravityY[index] = gravity.y;
+		mGravityZ[index] = gravity.z;
+		mMaxVelocity[index] = DefaultMaxVelocity;
+	}
+
+	void Remove(EntityID id) {
+		if (!Has(id)) return;
+		const auto index = mIndices[id];
+		const auto last = (uint32_t)mEntities.size() - 1;
+		if (index != last) {
+			ForEachArray([index, last](auto& v) { v[index] = v[last]; });
+			mEntities[index] = mEntities[last];
+			mIndices[mEntities[index]] = index;
+		}
+		ForEachArray([](auto& v) { v.pop_back(); });
+		mEntities.pop_back();
+		mIndices[id] = InvalidEntityID;
+	}
+
+	bool Has(EntityID id) const {
+		return id < mIndices.size() && mIndices[id] != InvalidEntityID;
+	}
+
+	size_t Size() const {
+		return mEntities.size();
+	}
+
+	glm::vec3 GetGravity(EntityID id) const {
+		const auto index = mIndices[id];
+		return { mGravityX[index], mGravityY[index], mGravityZ[index] };
+	}
+
+	void SetForce(EntityID id, const glm::vec3& force) {
+		const auto index = mIndices[id];
+		mForceX[index] = force.x;
+		mForceY[index] = force.y;
+		mForceZ[index] = force.z;
+	}
+
+	bool IsGrounded(EntityID id) const {
+		return mGrounded[mIndices[id]] != 0;
+	}
+
+	void SetGrounded(EntityID id, bool grounded) {
+		mGrounded[mIndices[id]] = grounded;
+	}
+
+	// One fixed step for all bodies. The force is an impulse applied on the
+	// first step of a frame. Velocity clamping is rare, so it only runs as a
+	// second pass when a body actually exceeded its max velocity.
+	// tests/BodyIntegratorTest.cpp compares it with the old per body integrator.
+	void Integrate(float step, bool applyForce) {
+		const auto count = mEntities.size();
+		const float dampAir = 1.0f / (1.0f + 1.0f * step);
+		const float dampGrounded = 1.0f / (1.0f + 2.0f * step);
+		const float forceScale = applyForce ? 1.0f : 0.0f;
+		float* __restrict px = mPosX.data(); float* __restrict py = mPosY.data(); float* __restrict pz = mPosZ.data();
+		float* __restrict vx = mVelX.data(); float* __restrict vy = mVelY.data(); float* __restrict vz = mVelZ.data();
+		const float* __restrict fx = mForceX.data(); const float* __restrict fy = mForceY.data(); const float* __restrict fz = mForceZ.data();
+		const float* __restrict gx = mGravityX.data(); const float* __restrict gy = mGravityY.data(); const float* __restrict gz = mGravityZ.data();
+		const float* __restrict maxVelocity = mMaxVelocity.data();
+		const uint8_t* __restrict grounded = mGrounded.data();
+		uint32_t exceeded = 0;
+		for (size_t i = 0; i < count; ++i) {
+			float x = vx[i] + gx[i] * step + fx[i] * forceScale;
+			float y = vy[i] + gy[i] * step + fy[i] * forceScale;
+			float z = vz[i] + gz[i] * step + fz[i] * forceScale;
+			px[i] += x * step;
+			py[i] += y * step;
+			pz[i] += z * step;
+			const float damp = grounded[i] ? dampGrounded : dampAir;
+			x *= damp;
+			y *= damp;
+			z *= damp;
+			vx[i] = x;
+			vy[i] = y;
+			vz[i] = z;
+			exceeded |= (x * x + y * y + z * z) > maxVelocity[i] * maxVelocity[i];
+		}
+		if (!exceeded) return;
+		for (size_t i = 0; i < count; ++i) {
+			const float length2 = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+			if (length2 <= maxVelocity[i] * maxVelocity[i]) continue;
+			const float scale = maxVelocity[i] / std::sqrt(length2);
+			vx[i] *= scale;
+			vy[i] *= scale;
+			vz[i] *= scale;
+		}
+	}
+
+	void ClearForces() {
+		std::fill(mForceX.begin(), mForceX.end(), 0.0f);
+		std::fill(mForceY.begin(), mForceY.end(), 0.0f);
+		std::fill(mForceZ.begin(), mForceZ.end(), 0.0f);
+	}
+
+	// Bodies at or below the ground plane are clamped and become grounded
+	void ResolveGround() {
+		for (size_t i = 0; i < mEntities.size(); ++i) {
+			if (mPosY[i] <= 0.0f) {
+				mPosY[i] = 0.0f;
+				mGrounded[i] = 1;
+			}
+		}
+	}
+};
+
+struct RenderComponent {
+	Model* mModel = nullptr;
+	ShaderProgram* mShaderProgram = nullptr;
+	glm::vec3 mOffset = { 0,0,0 };
+	ParticleEmitter* mEmitter = nullptr; // drawn instead of the model meshes
+	int32_t mSpatialProxy = -1;
+	glm::vec3 mProxyOffset = { 0,0,0 }; // mOffset the proxy bounds were computed with
+};
+
+struct AnimationComponent {
+	AnimationController* mController = nullptr;
+	bool mChanged = false; // bone transforms changed this frame
+};
+
+struct LifetimeComponent {
+	float mRemaining = 0.0f; // seconds until the entity is despawned
+};
+
+struct EntityRegistry {
+	std::vector<Entity*> mEntities;
+	std::vector<EntityID> mFreeIDs;
+	ComponentArray<TransformComponent> mTransforms;
+	BodyArray mBodies;
+	ComponentArray<RenderComponent> mRenders;
+	ComponentArray<AnimationComponent> mAnimations;
+	ComponentArray<LifetimeComponent> mLifetimes;
+	bool mTransformOrderDirty = false; // parents must come before children in mTransforms
+
+	EntityID Create(Entity* entity) {
+		EntityID id;
+		if (!mFreeIDs.empty()) {
+			id = mFreeIDs.back();
+			mFreeIDs.pop_back();
+			mEntities[id] = entity;
+		} else {
+			id = (EntityID)mEntities.size();
+			mEntities.push_back(entity);
+		}
+		// A recycled id starts without a parent, whatever its previous owner had
+		auto& transform = mTransforms.Add(id);
+		transform.mParent = InvalidEntityID;
+		transform.mParentNode = -1;
+		transform.mFirstChild = InvalidEntityID;
+		transform.mNextSibling = InvalidEntityID;
+		transform.mPrevSibling = InvalidEntityID;
+		return id;
+	}
+
+	void Destroy(EntityID id) {
+		Unlink(id);
+		// Detach the children now, once the id is reused they would follow the new entity
+		for (auto child = mTransforms.Get(id).mFirstChild; child != InvalidEntityID;) {
+			auto& transform = mTransforms.Get(child);
+			child = transform.mNextSibling;
+			transform.mParent = InvalidEntityID;
+			transform.mParentNode = -1;
+			transform.mNextSibling = InvalidEntityID;
+			transform.mPrevSibling = InvalidEntityID;
+			transform.mDirty = true;
+		}
+		mTransforms.Remove(id);
+		mBodies.Remove(id);
+		mRenders.Remove(id);
+		mAnimations.Remove(id);
+		mLifetimes.Remove(id);
+		mEntities[id] = nullptr;
+		mTransformOrderDirty = true;
+		mFreeIDs.push_back(id);
+	}
+
+	void SetParent(EntityID id, EntityID parent, uint32_t parentNode = -1) {
+		Unlink(id);
+		auto& transform = mTransforms.Get(id);
+		if (parent != InvalidEntityID) {
+			auto& parentTransform = mTransforms.Get(parent);
+			transform.mNextSibling = parentTransform.mFirstChild;
+			if (parentTransform.mFirstChild != InvalidEntityID) {
+				mTransforms.Get(parentTransform.mFirstChild).mPrevSibling = id;
+			}
+			parentTransform.mFirstChild = id;
+		}
+		transform.mParent = parent;
+		transform.mParentNode = parentNode;
+		transform.mDirty = true;
+		mTransformOrderDirty = true;
+	}
+
+	Entity* GetEntity(EntityID id) const {
+		return id < mEntities.size() ? mEntities[id] : nullptr;
+	}
+
+	// Gravity body system: positions are gathered from and scattered back to the
+	// transforms once per frame around the batched fixed steps
+	void UpdateBodies(size_t steps, float step) {
+		auto& bodies = mBodies;
+		if (!steps || !bodies.Size()) return;
+
+		for (size_t i = 0; i < bodies.Size(); ++i) {
+			const auto& pos = mTransforms.Get(bodies.mEntities[i]).mPos;
+			bodies.mPosX[i] = pos.x;
+			bodies.mPosY[i] = pos.y;
+			bodies.mPosZ[i] = pos.z;
+		}
+
+		for (size_t n = 0; n < steps; ++n) {
+			if (n + 1 == steps) {
+				bodies.mPrevX = bodies.mPosX;
+				bodies.mPrevY = bodies.mPosY;
+				bodies.mPrevZ = bodies.mPosZ;
+			}
+			bodies.Integrate(step, n == 0);
+		}
+		bodies.ClearForces();
+		bodies.ResolveGround();
+
+		for (size_t i = 0; i < bodies.Size(); ++i) {
+			auto& transform = mTransforms.Get(bodies.mEntities[i]);
+			transform.mPos = { bodies.mPosX[i], bodies.mPosY[i], bodies.mPosZ[i] };
+			transform.mPrevOffset = glm::vec3(bodies.mPrevX[i], bodies.mPrevY[i], bodies.mPrevZ[i]) - transform.mPos;
+			transform.mDirty = true;
+		}
+	}
+
+	// Transforms are kept sorted parents first so a single pass resolves the
+	// hierarchy. Only dirty transforms and children of changed parents are
+	// recomputed, bone attachments follow the parent animation in the same frame.
+	void UpdateTransforms() {
+		if (mTransformOrderDirty) {
+			SortTransforms();
+		}
+		auto& transforms = mTransforms;
+		for (auto& transform : transforms.mData) {
+			bool changed = transform.mDirty;
+			const TransformComponent* parent = nullptr;
+			const AnimationComponent* parentAnimation = nullptr;
+			if (transform.mParent != InvalidEntityID) {
+				parent = &transforms.Get(transform.mParent);
+				changed = changed || parent->mChanged;
+				if (transform.mParentNode != -1) {
+					parentAnimation = &mAnimations.Get(transform.mParent);
+					changed = changed || parentAnimation->mChanged;
+				}
+			}
+			transform.mDirty = false;
+			transform.mChanged = changed;
+			if (!changed || transform.mRigidBody) continue;
+
+			// translate * rotate * scale without the matrix products
+			transform.mWorld = glm::mat4_cast(transform.mRot);
+			transform.mWorld[0] *= transform.mScale.x;
+			transform.mWorld[1] *= transform.mScale.y;
+			transform.mWorld[2] *= transform.mScale.z;
+			transform.mWorld[3] = glm::vec4(transform.mPos, 1.0f);
+			if (parentAnimation) {
+				transform.mWorld = parent->mWorld * parentAnimation->mController->mLocalTransforms[transform.mParentNode] * transform.mWorld;
+			} else if (parent) {
+				transform.mWorld = parent->mWorld * transform.mWorld;
+			}
+		}
+	}
+
+	void SortTransforms() {
+		auto& transforms = mTransforms;
+		std::vector<uint32_t> depths(transforms.Size());
+		for (size_t i = 0; i < transforms.Size(); ++i) {
+			auto& transform = transforms.mData[i];
+			if (transform.mParent != InvalidEntityID && !transforms.Has(transform.mParent)) {
+				std::cerr << "Warning: Parent of entity " << transforms.mEntities[i] << " was destroyed" << std::endl;
+				transform.mParent = InvalidEntityID;
+				transform.mParentNode = -1;
+			}
+			uint32_t depth = 0;
+			for (auto parent = transform.mParent; parent != InvalidEntityID && transforms.Has(parent); parent = transforms.Get(parent).mParent) {
+				depth++;
+			}
+			depths[i] = depth;
+		}
+		std::vector<uint32_t> order(transforms.Size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&depths](uint32_t a, uint32_t b) {
+			return depths[a] < depths[b];
+		});
+		transforms.Permute(order);
+		mTransformOrderDirty = false;
+	}
+
+private:
+	// Removes the entity from its parent's child list
+	void Unlink(EntityID id) {
+		auto& transform = mTransforms.Get(id);
+		if (transform.mParent == InvalidEntityID) return;
+		if (transform.mPrevSibling != InvalidEntityID) {
+			mTransforms.Get(transform.mPrevSibling).mNextSibling = transform.mNextSibling;
+		} else {
+			mTransforms.Get(transform.mParent).mFirstChild = transform.mNextSibling;
+		}
+		if (transform.mNextSibling != InvalidEntityID) {
+			mTransforms.Get(transform.mNextSibling).mPrevSibling = transform.mPrevSibling;
+		}
+		transform.mNextSibling = InvalidEntityID;
+		transform.mPrevSibling = InvalidEntityID;
+	}
+};
@@ -1,141 +1,250 @@
-#pragma once
-
-#include "Main.h"
-#include "Mesh.h"
-#include "Shader.h"
-#include "Camera.h"
-
-struct DebugLine {
-	glm::vec3 mStart;
-	glm::vec3 mEnd;
-	glm::vec3 mColor;
-};
-
-struct DebugPoint {
-	glm::vec3 mPos;
-	glm::vec3 mColor = { 1,1,1 };
-	float mScale = 1.0f;
-	DebugPoint(float x, float y, float z, float s = 1.0f) : DebugPoint(glm::vec3(x, y, z), s) {}
-	DebugPoint(const glm::vec3& p, float s = 1.0f) {
-		mPos = p;
-		mScale = s;
-	}
-};
-
-struct DebugRenderer {
-	std::vector<DebugLine> mLines;
-	std::vector<DebugPoint> mPoints;
-	ShaderProgram_ mLineProgram;
-	ShaderProgram_ mPointProgram;
-
-	DebugRenderer() {
-		mLineProgram = ShaderProgram::Load("debug");
-		mPointProgram = ShaderProgram::Load("particles");
-	}
-
-	void Clear() {
-		mLines.clear();
-		mPoints.clear();
-	}
-
-	void AddLine(const DebugLine& line) { mLines.push_back(line); }
-	void AddCube(const glm::vec3& pos, const AABB& aabb, const glm::vec3& color) {
-		auto up = glm::vec3(0, 1, 0);
-		auto s = aabb.mHalfSize * 2;
-		auto a = pos + aabb.mCenter - aabb.mHalfSize;
-		auto b = a + s * glm::vec3(1, 0, 0);
-		auto c = b + s * glm::vec3(0, 0, 1);
-		auto d = c + s * glm::vec3(-1, 0, 0);
-
-		AddLine({ a, b, color });
-		AddLine({ b, c, color });
-		AddLine({ c, d, color });
-		AddLine({ d, a, color });
-
-		AddLine({ a, a + s * up, color });
-		AddLine({ b, b + s * up, color });
-		AddLine({ c, c + s * up, color });
-		AddLine({ d, d + s * up, color });
-
-		AddLine({ a + s * up, b + s * up, color });
-		AddLine({ b + s * up, c + s * up, color });
-		AddLine({ c + s * up, d + s * up, color });
-		AddLine({ d + s * up, a + s * up, color });
-	}
-
-	void AddGrid(float scale, float halfSize, const glm::vec3& color) {
-		for (int dx = -halfSize; dx <= halfSize; ++dx) {
-			AddLine({ {dx * scale, 0, -halfSize * scale}, {dx * scale, 0, halfSize * scale}, color });
-			AddLine({ {-halfSize * scale, 0, dx * scale}, {halfSize * scale, 0, dx * scale}, color });
-		}
-	}
-
-	void AddPoint(const DebugPoint& point) {
-		mPoints.push_back(point);
-	}
-
-	void AddPoint(const glm::vec3& point) {
-		mPoints.push_back({ point });
-	}
-
-	void Render(const Camera& cam) {
-		auto drawDebugLines = [](auto& debugLines) {
-			for (auto& debugLine : debugLines) {
-				auto debugMesh = std::make_shared<Mesh>();
-				debugMesh->mIndices.push_back(0);
-				debugMesh->mIndices.push_back(1);
-				debugMesh->mVertices.push_back({
-					debugLine.mStart,
-					{},
-					debugLine.mColor
-					});
-				debugMesh->mVertices.push_back({
-					debugLine.mEnd,
-					{},
-					debugLine.mColor
-					});
-				debugMesh->Bind();
-				glDrawElements(GL_LINES, debugMesh->mIndices.size(), GL_UNSIGNED_INT, 0);
-			}
-		};
-
-		auto drawDebugPoints = [](auto& debugPoints) {
-			if (debugPoints.size() < 1) return;
-			auto debugMesh = std::make_shared<Mesh>();
-			for (auto& debugPoint : debugPoints) {
-				float ps = 0.25f;
-				float quad[] = {
-					0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,
-					0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f,
-				};
-				for (int v = 0; v < 12; v += 2) {
-					Vertex vertex;
-					vertex.mPos = debugPoint.mPos;
-					vertex.mNormal.x = (quad[v] - 0.5f) * ps;
-					vertex.mNormal.y = (quad[v + 1] - 0.5f) * ps;
-					vertex.mNormal.z = debugPoint.mScale;
-					debugMesh->mVertices.push_back(vertex);
-					debugMesh->mIndices.push_back(debugMesh->mIndices.size());
-				}
-			}
-			debugMesh->Bind();
-			glDrawElements(GL_TRIANGLES, debugMesh->mIndices.size(), GL_UNSIGNED_INT, 0);
-		};
-
-		auto debugTransform = glm::identity<glm::mat4>();
-
-		glUseProgram(mLineProgram->mID);
-		glUniformMatrix4fv(glGetUniformLocation(mLineProgram->mID, "uProj"), 1, GL_FALSE, (GLfloat*)&cam.mProjection[0]);
-		glUniformMatrix4fv(glGetUniformLocation(mLineProgram->mID, "uView"), 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
-		glUniformMatrix4fv(glGetUniformLocation(mLineProgram->mID, "uModel"), 1, GL_FALSE, (GLfloat*)&debugTransform[0]);
-
-		drawDebugLines(mLines);
-
-		glUseProgram(mPointProgram->mID);
-		glUniformMatrix4fv(glGetUniformLocation(mPointProgram->mID, "uProj"), 1, GL_FALSE, (GLfloat*)&cam.mProjection[0]);
-		glUniformMatrix4fv(glGetUniformLocation(mPointProgram->mID, "uView"), 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
-		glUniformMatrix4fv(glGetUniformLocation(mPointProgram->mID, "uModel"), 1, GL_FALSE, (GLfloat*)&debugTransform[0]);
-
-		drawDebugPoints(mPoints);
-	}
-};
+#pragma once
+
+#include "Main.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "Camera.h"
+#include "StreamBuffer.h"
+#include "Profiler.h"
+
+struct DebugLine {
+	glm::vec3 mStart;
+	glm::vec3 mEnd;
+	glm::vec3 mColor;
+};
+
+struct DebugPoint {
+	glm::vec3 mPos;
+	glm::vec3 mColor = { 1,1,1 };
+	float mScale = 1.0f;
+	DebugPoint(float x, float y, float z, float s = 1.0f) : DebugPoint(glm::vec3(x, y, z), s) {}
+	DebugPoint(const glm::vec3& p, float s = 1.0f) {
+		mPos = p;
+		mScale = s;
+	}
+};
+
+// Compact vertex for debug lines, also used as the per instance data of points
+struct DebugVertex {
+	glm::vec3 mPos;
+	uint32_t mColor; // RGBA8
+	DebugVertex(const glm::vec3& pos, const glm::vec3& color) : mPos(pos), mColor(glm::packUnorm4x8(glm::vec4(color, 1.0f))) {}
+};
+
+struct DebugPointInstance {
+	DebugVertex mVertex;
+	float mScale;
+};
+
+inline void MapDebugLineVertexArray(GLuint vertexArray, GLuint buffer) {
+	// layout matches debug.vert.glsl, color is read as normalized bytes
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (GLvoid*)offsetof(DebugVertex, mPos));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugVertex), (GLvoid*)offsetof(DebugVertex, mColor));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+inline void MapDebugPointVertexArray(GLuint vertexArray, GLuint buffer, size_t offset) {
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (GLuint index : { 0, 1, 2 }) {
+		glEnableVertexAttribArray(index);
+		glVertexAttribDivisor(index, 1);
+	}
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugPointInstance), (GLvoid*)(offset + offsetof(DebugPointInstance, mVertex.mPos)));
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(DebugPointInstance), (GLvoid*)(offset + offsetof(DebugPointInstance, mScale)));
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugPointInstance), (GLvoid*)(offset + offsetof(DebugPointInstance, mVertex.mColor)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Geometry of one debug layer. Static layers are uploaded to their own buffer
+// when modified and drawn from it every frame, dynamic layers are cleared
+// after each frame and streamed through the renderer's ring buffer.
+struct DebugLayer {
+	std::string mName;
+	bool mStatic = false;
+	bool mVisible = true;
+	bool mDepthTest = true;
+	std::vector<DebugVertex> mLineVertices;
+	std::vector<DebugPointInstance> mPoints;
+	GLuint mBuffer = 0; // static layers only
+	GLuint mLineVertexArray = 0;
+	GLuint mPointVertexArray = 0;
+	bool mDirty = true;
+
+	DebugLayer(const DebugLayer&) = delete;
+	DebugLayer& operator=(const DebugLayer&) = delete;
+	DebugLayer(const std::string& name, bool isStatic, bool depthTest) : mName(name), mStatic(isStatic), mDepthTest(depthTest) {}
+	~DebugLayer() {
+		if (mBuffer) glDeleteBuffers(1, &mBuffer);
+		if (mLineVertexArray) glDeleteVertexArrays(1, &mLineVertexArray);
+		if (mPointVertexArray) glDeleteVertexArrays(1, &mPointVertexArray);
+	}
+
+	void Clear() {
+		mLineVertices.clear();
+		mPoints.clear();
+		mDirty = true;
+	}
+
+	void AddLine(const DebugLine& line) {
+		mLineVertices.emplace_back(line.mStart, line.mColor);
+		mLineVertices.emplace_back(line.mEnd, line.mColor);
+		mDirty = true;
+	}
+
+	void AddCube(const glm::vec3& pos, const AABB& aabb, const glm::vec3& color) {
+		auto up = glm::vec3(0, 1, 0);
+		auto s = aabb.mHalfSize * 2;
+		auto a = pos + aabb.mCenter - aabb.mHalfSize;
+		auto b = a + s * glm::vec3(1, 0, 0);
+		auto c = b + s * glm::vec3(0, 0, 1);
+		auto d = c + s * glm::vec3(-1, 0, 0);
+
+		AddLine({ a, b, color });
+		AddLine({ b, c, color });
+		AddLine({ c, d, color });
+		AddLine({ d, a, color });
+
+		AddLine({ a, a + s * up, color });
+		AddLine({ b, b + s * up, color });
+		AddLine({ c, c + s * up, color });
+		AddLine({ d, d + s * up, color });
+
+		AddLine({ a + s * up, b + s * up, color });
+		AddLine({ b + s * up, c + s * up, color });
+		AddLine({ c + s * up, d + s * up, color });
+		AddLine({ d + s * up, a + s * up, color });
+	}
+
+	void AddGrid(float scale, float halfSize, const glm::vec3& color) {
+		for (int dx = -halfSize; dx <= halfSize; ++dx) {
+			AddLine({ {dx * scale, 0, -halfSize * scale}, {dx * scale, 0, halfSize * scale}, color });
+			AddLine({ {-halfSize * scale, 0, dx * scale}, {halfSize * scale, 0, dx * scale}, color });
+		}
+	}
+
+	void AddPoint(const DebugPoint& point) {
+		mPoints.push_back({ { point.mPos, point.mColor }, point.mScale });
+		mDirty = true;
+	}
+
+	void AddPoint(const glm::vec3& point) {
+		AddPoint(DebugPoint(point));
+	}
+
+	// Static layers only, lines followed by the point instances in one buffer
+	void Upload() {
+		const auto lineBytes = mLineVertices.size() * sizeof(DebugVertex);
+		const auto pointBytes = mPoints.size() * sizeof(DebugPointInstance);
+		if (!mBuffer) {
+			glGenBuffers(1, &mBuffer);
+			glGenVertexArrays(1, &mLineVertexArray);
+			glGenVertexArrays(1, &mPointVertexArray);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, lineBytes + pointBytes, nullptr, GL_STATIC_DRAW);
+		if (lineBytes) glBufferSubData(GL_COPY_WRITE_BUFFER, 0, lineBytes, mLineVertices.data());
+		if (pointBytes) glBufferSubData(GL_COPY_WRITE_BUFFER, lineBytes, pointBytes, mPoints.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		MapDebugLineVertexArray(mLineVertexArray, mBuffer);
+		MapDebugPointVertexArray(mPointVertexArray, mBuffer, lineBytes);
+		glBindVertexArray(0);
+		mDirty = false;
+	}
+};
+
+// Draws the visible layers in the order they were added. Per layer all lines
+// are one glDrawArrays and all points one instanced draw.
+struct DebugRenderer {
+	ShaderProgram_ mLineProgram;
+	ShaderProgram_ mPointProgram;
+	StreamBuffer mBuffer;
+	GLuint mLineVertexArray = 0;
+	GLuint mPointVertexArray = 0;
+	std::vector<std::unique_ptr<DebugLayer>> mLayers;
+
+	DebugRenderer(const DebugRenderer&) = delete;
+	DebugRenderer& operator=(const DebugRenderer&) = delete;
+	DebugRenderer() : mBuffer(1024 * 1024) {
+		mLineProgram = ShaderProgram::Load("debug");
+		mPointProgram = ShaderProgram::Load("debugpoints");
+		glGenVertexArrays(1, &mLineVertexArray);
+		glGenVertexArrays(1, &mPointVertexArray);
+		MapDebugLineVertexArray(mLineVertexArray, mBuffer.mBuffer);
+		glBindVertexArray(0);
+	}
+
+	~DebugRenderer() {
+		glDeleteVertexArrays(1, &mLineVertexArray);
+		glDeleteVertexArrays(1, &mPointVertexArray);
+	}
+
+	DebugLayer& AddLayer(const std::string& name, bool isStatic, bool depthTest = true) {
+		mLayers.push_back(std::make_unique<DebugLayer>(name, isStatic, depthTest));
+		return *mLayers.back();
+	}
+
+	// Clears the dynamic layers
+	void Clear() {
+		for (auto& layer : mLayers) {
+			if (!layer->mStatic) layer->Clear();
+		}
+	}
+
+	// Debug geometry is in world space, the camera comes from the Frame block
+	void Render() {
+		PROFILE_SCOPE("DebugRenderer::Render");
+		PROFILE_GPU_SCOPE("DebugRenderer::Render");
+		for (auto& layer : mLayers) {
+			if (!layer->mVisible) continue;
+			if (layer->mDepthTest) {
+				glEnable(GL_DEPTH_TEST);
+			} else {
+				glDisable(GL_DEPTH_TEST);
+			}
+			if (layer->mStatic) {
+				RenderStatic(*layer);
+			} else {
+				RenderDynamic(*layer);
+			}
+		}
+
+		glEnable(GL_DEPTH_TEST);
+		glBindVertexArray(0);
+	}
+
+	void RenderStatic(DebugLayer& layer) {
+		if (layer.mDirty) {
+			layer.Upload();
+		}
+		if (!layer.mLineVertices.empty()) {
+			glUseProgram(mLineProgram->mID);
+			glBindVertexArray(layer.mLineVertexArray);
+			glDrawArrays(GL_LINES, 0, layer.mLineVertices.size());
+		}
+		if (!layer.mPoints.empty()) {
+			glUseProgram(mPointProgram->mID);
+			glBindVertexArray(layer.mPointVertexArray);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6, layer.mPoints.size());
+		}
+	}
+
+	void RenderDynamic(DebugLayer& layer) {
+		if (!layer.mLineVertices.empty()) {
+			const auto offset = mBuffer.Write(layer.mLineVertices.data(), layer.mLineVertices.size() * sizeof(DebugVertex), sizeof(DebugVertex));
+			glUseProgram(mLineProgram->mID);
+			glBindVertexArray(mLineVertexArray);
+			glDrawArrays(GL_LINES, offset / sizeof(DebugVertex), layer.mLineVertices.size());
+		}
+		if (!layer.mPoints.empty()) {
+			const auto offset = mBuffer.Write(layer.mPoints.data(), layer.mPoints.size() * sizeof(DebugPointInstance));
+			glUseProgram(mPointProgram->mID);
+			MapDebugPointVertexArray(mPointVertexArray, mBuffer.mBuffer, offset);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6, layer.mPoints.size());
+		}
+	}
+};
\ No newline at end of file
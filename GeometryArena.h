@@ -0,0 +1,302 @@
+#pragma once
+
+#include "Main.h"
+#include "StreamBuffer.h"
+
+// First fit allocator over a range of elements, freed ranges are merged with
+// their free neighbours
+struct RangeAllocator {
+	static constexpr size_t Invalid = SIZE_MAX;
+
+	std::map<size_t, size_t> mFree; // offset -> count
+	size_t mCapacity = 0;
+	size_t mUsed = 0;
+
+	// Returns Invalid if no free range is large enough
+	size_t Allocate(size_t count) {
+		for (auto it = mFree.begin(); it != mFree.end(); ++it) {
+			if (it->second < count) continue;
+			const auto offset = it->first;
+			const auto remaining = it->second - count;
+			mFree.erase(it);
+			if (remaining) mFree[offset + count] = remaining;
+			mUsed += count;
+			return offset;
+		}
+		return Invalid;
+	}
+
+	void Free(size_t offset, size_t count) {
+		if (!count) return;
+		mUsed -= count;
+		auto next = mFree.lower_bound(offset);
+		if (next != mFree.end() && offset + count == next->first) {
+			count += next->second;
+			next = mFree.erase(next);
+		}
+		if (next != mFree.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				prev->second += count;
+				return;
+			}
+		}
+		mFree[offset] = count;
+	}
+
+	void Grow(size_t capacity) {
+		assert(capacity >= mCapacity);
+		const auto added = capacity - mCapacity;
+		mUsed += added;
+		Free(mCapacity, added);
+		mCapacity = capacity;
+	}
+
+	// Everything below used is allocated, everything above free
+	void Reset(size_t used) {
+		mFree.clear();
+		mUsed = used;
+		if (used < mCapacity) mFree[used] = mCapacity - used;
+	}
+
+	// End of the last allocated range
+	size_t GetHighWater() const {
+		if (!mFree.empty()) {
+			const auto& last = *mFree.rbegin();
+			if (last.first + last.second == mCapacity) return last.first;
+		}
+		return mCapacity;
+	}
+
+	// Free elements below the high water mark
+	size_t GetHoles() const {
+		return GetHighWater() - mUsed;
+	}
+};
+
+// Place of one mesh in a GeometryArena. Offsets are in elements, indices are
+// relative to mBaseVertex. Both offsets change when the arena is defragmented.
+struct GeometryAllocation {
+	size_t mBaseVertex = 0;
+	size_t mVertexCount = 0;
+	size_t mFirstIndex = 0;
+	size_t mIndexCount = 0;
+	size_t mSlot = 0; // in GeometryArena::mAllocations
+};
+
+struct GeometryArenaStats {
+	size_t mAllocations = 0;
+	size_t mVertexBytes = 0;
+	size_t mVertexCapacityBytes = 0;
+	size_t mIndexBytes = 0;
+	size_t mIndexCapacityBytes = 0;
+	size_t mFreeRanges = 0;
+	size_t mDefragmentations = 0;
+	size_t mStreamCapacityBytes = 0;
+};
+
+// Static geometry of one vertex format suballocated from a shared vertex and
+// index buffer. There is a single VAO per format, meshes are drawn with base
+// vertex draws. Freed ranges are reused, when the holes grow past a quarter of
+// the used range the live allocations are packed to the front.
+// Vertices that change every frame are streamed through mStream instead, see
+// Stream, their indices stay in the static index buffer.
+template<typename TVertex>
+struct GeometryArena {
+	GLuint mVertexBuffer = 0;
+	GLuint mIndexBuffer = 0;
+	GLuint mVertexArray = 0;
+	bool mVertexArrayDirty = true;
+	std::unique_ptr<StreamBuffer> mStream;
+	GLuint mStreamVertexArray = 0; // mStream vertices with mIndexBuffer
+	bool mStreamVertexArrayDirty = true;
+	RangeAllocator mVertices;
+	RangeAllocator mIndices;
+	std::vector<std::unique_ptr<GeometryAllocation>> mAllocations;
+	size_t mDefragmentations = 0;
+
+	static GeometryArena& Get() {
+		static GeometryArena arena;
+		return arena;
+	}
+
+	// Buffers are not deleted here, the context is gone when the singleton is
+	// destroyed. Call Shutdown before glfwTerminate.
+	GeometryArena() {}
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	// Deletes the GL objects while the context is current. Meshes released
+	// later only return their ranges, which does not touch GL.
+	void Shutdown() {
+		if (mVertexBuffer) glDeleteBuffers(1, &mVertexBuffer);
+		if (mIndexBuffer) glDeleteBuffers(1, &mIndexBuffer);
+		if (mVertexArray) glDeleteVertexArrays(1, &mVertexArray);
+		if (mStreamVertexArray) glDeleteVertexArrays(1, &mStreamVertexArray);
+		mStream.reset();
+		mVertexBuffer = mIndexBuffer = mVertexArray = mStreamVertexArray = 0;
+		mVertexArrayDirty = mStreamVertexArrayDirty = true;
+	}
+
+	GeometryAllocation* Allocate(size_t vertexCount, size_t indexCount) {
+		auto allocation = std::make_unique<GeometryAllocation>();
+		allocation->mBaseVertex = Allocate(mVertexBuffer, mVertices, sizeof(TVertex), vertexCount);
+		allocation->mVertexCount = vertexCount;
+		allocation->mFirstIndex = Allocate(mIndexBuffer, mIndices, sizeof(uint32_t), indexCount);
+		allocation->mIndexCount = indexCount;
+		allocation->mSlot = mAllocations.size();
+		mAllocations.push_back(std::move(allocation));
+		return mAllocations.back().get();
+	}
+
+	void Free(GeometryAllocation* allocation) {
+		mVertices.Free(allocation->mBaseVertex, allocation->mVertexCount);
+		mIndices.Free(allocation->mFirstIndex, allocation->mIndexCount);
+		const auto slot = allocation->mSlot;
+		std::swap(mAllocations[slot], mAllocations.back());
+		mAllocations[slot]->mSlot = slot;
+		mAllocations.pop_back();
+	}
+
+	void UploadVertices(const GeometryAllocation& allocation, const TVertex* vertices, size_t first, size_t count) {
+		assert(first + count <= allocation.mVertexCount);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mVertexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (allocation.mBaseVertex + first) * sizeof(TVertex), count * sizeof(TVertex), vertices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	void UploadIndices(const GeometryAllocation& allocation, const uint32_t* indices, size_t first, size_t count) {
+		assert(first + count <= allocation.mIndexCount);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mIndexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (allocation.mFirstIndex + first) * sizeof(uint32_t), count * sizeof(uint32_t), indices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	void Bind() {
+		if (mVertexArrayDirty) {
+			if (!mVertexArray) glGenVertexArrays(1, &mVertexArray);
+			glBindVertexArray(mVertexArray);
+			glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+			TVertex::MapVertexArray();
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			mVertexArrayDirty = false;
+		}
+		glBindVertexArray(mVertexArray);
+	}
+
+	// Writes vertices that are rewritten every frame to the stream ring buffer.
+	// Updating them in place in the static buffer could wait for draws still
+	// reading it, the ring orphans its storage instead when it wraps. Returns
+	// the base vertex of the copy, it stays valid while IsStreamed(generation).
+	size_t Stream(const TVertex* vertices, size_t count, size_t& generation) {
+		if (!mStream) mStream = std::make_unique<StreamBuffer>(4 * 1024 * 1024);
+		if (!count) return 0;
+		const auto offset = mStream->Write(vertices, count * sizeof(TVertex), sizeof(TVertex));
+		generation = mStream->mOrphans;
+		return offset / sizeof(TVertex);
+	}
+
+	bool IsStreamed(size_t generation) const {
+		return mStream && mStream->mOrphans == generation;
+	}
+
+	// Orphaning keeps the buffer name, only a new index buffer invalidates the VAO
+	void BindStream() {
+		if (mStreamVertexArrayDirty) {
+			if (!mStreamVertexArray) glGenVertexArrays(1, &mStreamVertexArray);
+			glBindVertexArray(mStreamVertexArray);
+			glBindBuffer(GL_ARRAY_BUFFER, mStream->mBuffer);
+			TVertex::MapVertexArray();
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			mStreamVertexArrayDirty = false;
+		}
+		glBindVertexArray(mStreamVertexArray);
+	}
+
+	// Called at the frame boundary, moving ranges while draws are being recorded would invalidate them
+	void Update() {
+		const auto fragmented = [](const RangeAllocator& ranges) { return ranges.GetHoles() * 4 > ranges.GetHighWater(); };
+		if (fragmented(mVertices) || fragmented(mIndices)) {
+			Defragment();
+		}
+	}
+
+	void Defragment() {
+		Compact(mVertexBuffer, mVertices, sizeof(TVertex), &GeometryAllocation::mBaseVertex, &GeometryAllocation::mVertexCount);
+		Compact(mIndexBuffer, mIndices, sizeof(uint32_t), &GeometryAllocation::mFirstIndex, &GeometryAllocation::mIndexCount);
+		mVertexArrayDirty = mStreamVertexArrayDirty = true;
+		mDefragmentations++;
+	}
+
+	GeometryArenaStats GetStats() const {
+		GeometryArenaStats stats;
+		stats.mAllocations = mAllocations.size();
+		stats.mVertexBytes = mVertices.mUsed * sizeof(TVertex);
+		stats.mVertexCapacityBytes = mVertices.mCapacity * sizeof(TVertex);
+		stats.mIndexBytes = mIndices.mUsed * sizeof(uint32_t);
+		stats.mIndexCapacityBytes = mIndices.mCapacity * sizeof(uint32_t);
+		stats.mFreeRanges = mVertices.mFree.size() + mIndices.mFree.size();
+		stats.mDefragmentations = mDefragmentations;
+		stats.mStreamCapacityBytes = mStream ? mStream->mSize : 0;
+		return stats;
+	}
+
+private:
+	// Allocates count elements, growing the buffer if no free range fits
+	size_t Allocate(GLuint& buffer, RangeAllocator& ranges, size_t elementSize, size_t count) {
+		if (!count) return 0; // streamed meshes have no static vertices
+		auto offset = ranges.Allocate(count);
+		if (offset != RangeAllocator::Invalid) return offset;
+
+		const auto capacity = std::max({ ranges.mCapacity * 2, ranges.mCapacity + count, (size_t)64 * 1024 });
+		GLuint newBuffer = 0;
+		glGenBuffers(1, &newBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, capacity * elementSize, nullptr, GL_STATIC_DRAW);
+		if (buffer) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, ranges.mCapacity * elementSize);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		buffer = newBuffer;
+		mVertexArrayDirty = mStreamVertexArrayDirty = true;
+
+		ranges.Grow(capacity);
+		offset = ranges.Allocate(count);
+		assert(offset != RangeAllocator::Invalid);
+		return offset;
+	}
+
+	// Copies the live ranges to the front of a new buffer of the same capacity
+	void Compact(GLuint& buffer, RangeAllocator& ranges, size_t elementSize, size_t GeometryAllocation::* offset, size_t GeometryAllocation::* count) {
+		if (!buffer) return;
+		std::vector<GeometryAllocation*> allocations;
+		for (auto& allocation : mAllocations) {
+			allocations.push_back(allocation.get());
+		}
+		std::sort(allocations.begin(), allocations.end(), [offset](auto a, auto b) { return a->*offset < b->*offset; });
+
+		GLuint newBuffer = 0;
+		glGenBuffers(1, &newBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, ranges.mCapacity * elementSize, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		size_t end = 0;
+		for (auto allocation : allocations) {
+			if (allocation->*count) {
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->*offset * elementSize, end * elementSize, allocation->*count * elementSize);
+			}
+			allocation->*offset = end;
+			end += allocation->*count;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		buffer = newBuffer;
+		ranges.Reset(end);
+	}
+};
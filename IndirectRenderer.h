@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Main.h"
+#include "Mesh.h"
+#include "Profiler.h"
+#include "Shader.h"
+#include "StreamBuffer.h"
+#include "UniformBuffer.h"
+
+// Layout of one record in GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+	uint32_t mCount;
+	uint32_t mInstanceCount;
+	uint32_t mFirstIndex;
+	int32_t mBaseVertex;
+	uint32_t mBaseInstance;
+};
+
+// Draws static meshes with glMultiDrawElementsIndirect (GL 4.3). All of them
+// share the buffers and VAO of GeometryArena<Vertex>. Every mesh added during
+// a frame becomes one indirect command and its Draw block one instance of per
+// draw attributes selected by the command's base instance, so the whole set is
+// submitted with one call regardless of the mesh count.
+struct IndirectRenderer {
+	static constexpr GLuint InstanceAttribute = 5; // after the Vertex attributes
+
+	ShaderProgram_ mShaderProgram;
+	StreamBuffer mCommandBuffer;
+	StreamBuffer mInstanceBuffer;
+	std::vector<DrawElementsIndirectCommand> mCommands;
+	std::vector<DrawUniforms> mInstances;
+	size_t mDrawCount = 0; // commands submitted last frame
+	bool mEnabled = false;
+
+	IndirectRenderer() : mCommandBuffer(64 * 1024), mInstanceBuffer(1024 * 1024) {
+		mEnabled = IsSupported();
+		if (mEnabled) {
+			mShaderProgram = ShaderProgram::Load("default", { "INSTANCED" });
+		}
+	}
+	IndirectRenderer(const IndirectRenderer&) = delete;
+	IndirectRenderer& operator=(const IndirectRenderer&) = delete;
+
+	static bool IsSupported() {
+#ifdef GL_VERSION_4_3
+		return GLAD_GL_VERSION_4_3;
+#else
+		return false;
+#endif
+	}
+
+	// Returns false if the mesh has to be drawn on the regular path
+	bool Add(Mesh& mesh, const glm::mat4& transform, size_t lod = 0) {
+		if (!mEnabled || mesh.mMode != GL_TRIANGLES || mesh.mDynamic) return false;
+		mesh.Upload();
+		size_t first, count;
+		mesh.GetIndexRange(lod, first, count);
+		if (!count) return true;
+		mCommands.push_back({ (uint32_t)count, 1, (uint32_t)first, (int32_t)mesh.mAllocation->mBaseVertex, (uint32_t)mInstances.size() });
+		mInstances.push_back(transform);
+		return true;
+	}
+
+	void Render() {
+		mDrawCount = mCommands.size();
+		if (mCommands.empty()) return;
+#ifdef GL_VERSION_4_3
+		PROFILE_SCOPE("IndirectRenderer::Render");
+		PROFILE_GPU_SCOPE("IndirectRenderer::Render");
+		const auto commandOffset = mCommandBuffer.Write(mCommands.data(), mCommands.size() * sizeof(DrawElementsIndirectCommand));
+		const auto instanceOffset = mInstanceBuffer.Write(mInstances.data(), mInstances.size() * sizeof(DrawUniforms), 16);
+
+		glUseProgram(mShaderProgram->mID);
+		GeometryArena<Vertex>::Get().Bind();
+
+		// inModel and inNormalMatrix in default.vert.glsl, four columns each
+		glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer.mBuffer);
+		for (GLuint column = 0; column < 8; column++) {
+			const auto index = InstanceAttribute + column;
+			glEnableVertexAttribArray(index);
+			glVertexAttribPointer(index, 4, GL_FLOAT, GL_FALSE, sizeof(DrawUniforms), (GLvoid*)(instanceOffset + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(index, 1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer.mBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)commandOffset, (GLsizei)mCommands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		// The VAO is shared with the regular path
+		for (GLuint column = 0; column < 8; column++) {
+			glDisableVertexAttribArray(InstanceAttribute + column);
+		}
+		glBindVertexArray(0);
+#endif
+		Clear();
+	}
+
+	void Clear() {
+		mCommands.clear();
+		mInstances.clear();
+	}
+};
@@ -1,426 +1,631 @@
-#include "Main.h"
-#include "Scene.h"
-#include "Shader.h"
-#include "Input.h"
-#include "UI.h"
-#include "Debug.h"
-#include "Camera.h"
-
-#ifdef USE_HIGH_PERFORMANCE_GPU
-extern "C" {
-	_declspec(dllexport) unsigned long NvOptimusEnablement = 1;
-	_declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
-}
-#endif
-
-Input* Input::sInstance = nullptr;
-
-Scene_ CreateScene(const int argc, const char** argv) {
-	auto scene = std::make_shared<Scene>();
-	bool loadModel = true;
-
-	for (int i = 1; i < argc; ++i) {
-		std::string arg = argv[i];
-		
-		if (arg == "-s") {
-			scene->Load(argv[++i]);
-		} /*else if (arg == "-m") {
-			loadModel = true;
-		} else if (arg == "-a") {
-			loadModel = false;
-		} else {
-			if (loadModel) {
-				auto model = std::make_shared<Model>();
-				model->Load(arg);
-				scene->mEntities.push_back(std::make_shared<Entity>(model));
-			} else {
-				scene->mEntities.back()->mModel->LoadAnimation(arg, true);
-			}
-		}*/
-	}
-	scene->Init();
-	return scene;
-}
-
-float get_deque(void* data, int idx) {
-	auto deque = (std::deque<float>*)data;
-	return deque->at(idx);
-}
-
-int main(const int argc, const char **argv) {
-	if (!glfwInit()) {
-		std::cerr << "glfwInit failed" << std::endl;
-		return -1;
-	}
-
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-	const std::string windowTitle = "OpenGL Animation Demo";
-	
-	auto fullscreen = false;
-
-	auto monitor = fullscreen ? glfwGetPrimaryMonitor() : NULL;
-	auto window = glfwCreateWindow(1280, 720, windowTitle.c_str(), monitor, NULL);
-	if (!window) {
-		std::cerr << "glfwCreateWindow failed" << std::endl;
-		glfwTerminate();
-		return -1;
-	}
-
-	glfwMakeContextCurrent(window);
-
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		std::cerr << "Failed to initialize OpenGL context" << std::endl;
-		return -1;
-	}
-
-	auto scene = CreateScene(argc, argv);
-	auto input = std::make_shared<Input>(window, scene);
-
-	int windowWidth, windowHeight;
-	glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
-	glViewport(0, 0, windowWidth, windowHeight);
-	glfwSwapInterval(0);
-
-	auto ui = std::make_shared<UI>(window);
-
-	bool autoBlend = false;
-	bool animDetails = false;
-	bool modelDetails = true;
-	bool enableDebug = true;
-	bool drawDebug = true;
-	bool drawPersistentDebug = true;
-	bool headRot = false;
-
-	std::vector<float> selectedWeights;
-
-	glm::vec3 lightPos = { 100.0f, 100.0f, 100.0f };
-	glm::vec3 lightColor = { 1.0f, 1.0f, 1.0f };
-
-	DebugRenderer debugRenderer;
-	DebugRenderer persistentDebugRenderer;
-
-	persistentDebugRenderer.AddGrid(1.0f, 10.0f, { .5f, .5f, .5f });
-
-	Camera cam;
-	cam.mRight = glm::normalize(glm::cross(cam.mUp, cam.mFront));
-	cam.SetAspect(windowWidth, windowHeight);
-	float movementSpeed = 1.0f;
-	float camSpeed = 10.0f;
-
-	FrameCounter<float> fps;
-	fps.mHistoryLimit = 600;
-
-	Timer<float> timer;
-	while (!glfwWindowShouldClose(window)) {
-		timer.Update();
-		input->mNow = timer.mNow;
-		input->mDelta = timer.mDelta;
-
-		if (fps.Tick(timer.mNow, timer.mDelta)) {
-			glfwSetWindowTitle(window, (windowTitle + " - FPS: " + std::to_string(fps.mValue)).c_str());
-		}
-
-		glfwSwapBuffers(window);
-
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_DEPTH_TEST);
-
-		glfwPollEvents();
-
-		if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-			glfwSetWindowShouldClose(window, 1);
-		}
-
-		auto selected = scene->mSelected;
-		if (nullptr != selected) {
-			movementSpeed = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) ? 10.0f : 2.0f;
-			float walk = 0;
-			float strafe = 0;
-
-			if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-				walk = movementSpeed;
-			if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-				walk = -movementSpeed;
-			if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-				strafe = -movementSpeed;
-			if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-				strafe = movementSpeed;
-
-			if (walk != 0) {
-				scene->mSelected->Move(selected->mFront * walk);
-				debugRenderer.AddLine({ selected->mPos, selected->mPos + selected->mFront * walk, {1,0,1} });
-			}
-
-			if (strafe != 0) {
-				scene->mSelected->Strafe(strafe);
-			}
-
-			if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-				scene->mSelected->Jump();
-			//if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-			//	cam.Crounch();
-
-			auto selectedCenter = scene->mSelected->mPos + scene->mSelected->mUp * scene->mSelected->mModel->mAABB.mHalfSize.y;
-			
-			bool rotPlayer = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2) == GLFW_PRESS;
-			bool rot = rotPlayer || glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) == GLFW_PRESS;
-			if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) { rot = true; scene->mCameraRotationX = -0.1f; }
-			if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {rot=true;scene->mCameraRotationX = 0.1f;}
-			if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {rot=true;scene->mCameraRotationY = 0.1f;
-}			if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {rot=true;scene->mCameraRotationY = -0.1f;}
-			
-			if (rot) {
-				auto rotY = glm::angleAxis(scene->mCameraRotationX * timer.mDelta, glm::vec3(0, 1, 0));
-				auto rotX = glm::angleAxis(scene->mCameraRotationY * timer.mDelta, cam.mRight);
-				// TODO: limit X
-				auto targetPos2 = glm::normalize(rotY * rotX * cam.mFront);
-				targetPos2 = selectedCenter + targetPos2 * -scene->mCameraDistance;
-
-				// FIXME
-				scene->mCameraRotationX = 0;
-				scene->mCameraRotationY = 0;
-
-				cam.mPos = targetPos2;
-				debugRenderer.AddLine({ selectedCenter , cam.mPos, {1,1,1} });
-				cam.mFront = glm::normalize(selectedCenter - cam.mPos);
-				cam.mRight = glm::normalize(glm::cross(cam.mUp, cam.mFront));
-			}
-			else {
-				// TODO: Fixed pos & rot from player
-				auto targetPos = selectedCenter + cam.mFront * -scene->mCameraDistance;
-				cam.mPos.y = targetPos.y;
-				cam.mPos = glm::lerp(cam.mPos, targetPos, timer.mDelta * camSpeed);
-				cam.mFront = glm::lerp(cam.mFront, glm::normalize(selectedCenter - cam.mPos), timer.mDelta * camSpeed); // TODO norm
-				cam.mRight = glm::normalize(glm::cross(cam.mUp, cam.mFront));
-			}
-
-			if (rotPlayer) {
-				selected->mTargetFront = glm::normalize(glm::cross(cam.mRight, selected->mUp));
-				selected->mTargetFrontEnable = true;
-			}
-		}
-
-		if (enableDebug && selected) {
-			debugRenderer.AddLine({ selected->mPos, selected->mPos + cam.mFront, { 1, 1, 1 } });
-			debugRenderer.AddLine({ selected->mPos, selected->mPos + selected->mFront, { 1, 0, 0 } });
-			debugRenderer.AddLine({ selected->mPos, selected->mPos + selected->mUp, { 0, 1, 0 } });
-			debugRenderer.AddPoint(selected->mPos);
-			if (selected->mModel) {
-				debugRenderer.AddCube(selected->mPos, selected->mModel->mAABB, { 1, 1, 0 });
-			}
-		}
-
-		ui->NewFrame();
-
-		//ImGui::ShowDemoWindow();
-		ImGui::PlotHistogram("FPS", get_deque, (void*)&fps.mHistory, fps.mHistory.size(), 0, NULL, FLT_MAX, FLT_MAX, ImVec2(600, 100));
-		//ImGui::PlotHistogram("DT", get_deque, (void*)&fps.mFrameTimeHistory, fps.mFrameTimeHistory.size(), 0, NULL, FLT_MAX, FLT_MAX, ImVec2(600, 100));
-
-		if (selected) {
-			ImGui::PlotHistogram("Y", get_deque, (void*)&selected->mHistoryY, selected->mHistoryY.size(), 0, NULL, FLT_MAX, FLT_MAX, ImVec2(600, 100));
-		}
-
-		ImGui::Checkbox("debug", &enableDebug);
-		if (enableDebug) {
-			ImGui::Checkbox("drawDebug", &drawDebug);
-			ImGui::Checkbox("drawPersistentDebug", &drawPersistentDebug);
-		}
-
-		auto selectedModel = scene->mSelected ? scene->mSelected->mModel : nullptr;
-		if (selectedModel) {
-			ImGui::Checkbox("Model info", &modelDetails);
-			ImGui::Text(std::to_string(scene->mCameraRotationX).c_str());
-			ImGui::Text(std::to_string(scene->mCameraRotationY).c_str());
-
-			if (modelDetails) {
-				ImGui::Text("Name: %s", selectedModel->mName.c_str());
-				ImGui::Text("Model: c=%s, s=%s | length=%f",
-					glm::to_string(selectedModel->mAABB.mCenter).c_str(),
-					glm::to_string(selectedModel->mAABB.mHalfSize).c_str(),
-					glm::length(selectedModel->mAABB.mHalfSize) * 2.0f
-				);
-				/*for (const auto& mesh : selectedModel->mMeshes) {
-					ImGui::Text("Mesh: h=%d, v=%d, i=%d, c=%s, s=%s",
-						mesh->mHidden,
-						mesh->mVertices.size(),
-						mesh->mIndices.size(),
-						glm::to_string(mesh->mAABB.mCenter).c_str(),
-						glm::to_string(mesh->mAABB.mHalfSize).c_str()
-					);
-				}*/
-			}
-			if (selectedModel->HasAnimations() && ImGui::TreeNode("AnimationNodes")) {
-				auto renderTree = [](AnimationNode_ node, auto renderTree) -> void {
-					if (ImGui::TreeNode(node->mName.c_str())) {
-						ImGui::Text(glm::to_string(node->mTransform).c_str());
-						for (auto& c : node->mChildren) {
-							renderTree(c, renderTree);
-						}
-						ImGui::TreePop();
-					}
-				};
-				renderTree(selectedModel->mAnimationSet->mAnimations[0]->mRootNode, renderTree);
-				ImGui::TreePop();
-			}
-		}
-
-		ImGui::Text("GL_VENDOR: %s", glGetString(GL_VENDOR));
-		ImGui::Text("GL_RENDERER: %s", glGetString(GL_RENDERER));
-		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-
-		if (selected && selected->mAnimationController) {
-			const auto ac = selected->mAnimationController;
-			const auto as = ac->mAnimationSet;
-			ImGui::Begin("Animations");
-			ImGui::Text(ac->GetAnimationEnabled() ? ac->GetAnimation()->mName.c_str() : "DISABLED");
-
-			ImGui::Checkbox("Animation info", &animDetails);
-			if (animDetails) {
-				for (const auto& anim : as->mAnimations) {
-					ImGui::Text("Animation: %s, %f", anim->mName.c_str(), anim->mDuration);
-				}
-			}
-
-			ImGui::Checkbox("Blend", &ac->mBlended);
-			if (ac->mBlended) {
-				ImGui::Checkbox("HeadRot", &headRot);
-				if (headRot) {
-					//ac->mHeadRot = glm::quatLookAt(cam.mFront, { 0, 0, 1 });
-					double mx = 0;
-					glfwGetCursorPos(window, &mx, nullptr);
-					ac->mHeadRot = glm::rotate(glm::identity<glm::quat>(), (float)mx * 0.025f, { 0, 1, 0 });
-				}
-				else {
-					ac->mHeadRot = glm::identity<glm::quat>();
-				}
-
-				ImGui::Checkbox("autoBlend", &autoBlend);
-
-				// FIXME
-				if (selectedWeights.size() != ac->GetAnimationCount()) {
-					selectedWeights.resize(ac->GetAnimationCount());
-					if (!selectedWeights.empty()) {
-						std::fill(selectedWeights.begin(), selectedWeights.end(), 0);
-						selectedWeights[0] = 1.0f;
-					}
-				}
-
-				// FIXME
-				if (autoBlend) {
-					const auto animIdle = as->GetAnimationIndex("CharacterArmature|Idle");
-					const auto animWalk = as->GetAnimationIndex("CharacterArmature|Walk");
-					const auto animJump = as->GetAnimationIndex("CharacterArmature|Victory");
-					const float animFadeIn = 20.0f;
-					const float animFadeOut = 10.0f;
-
-					for (auto& w : selectedWeights) {
-						w = glm::clamp(w - timer.mDelta * animFadeOut, 0.0f, 1.0f);
-					}
-
-					// TODO: Move to ? & use velocity to choose animation
-					if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-						selectedWeights[animWalk] = glm::clamp(selectedWeights[animWalk] + timer.mDelta * animFadeIn, 0.0f, 1.0f);
-					} else {
-						selectedWeights[animIdle] = glm::clamp(selectedWeights[animIdle] + timer.mDelta * animFadeIn, 0.0f, 1.0f);
-					}
-
-					if (scene->mSelected->mPos.y > 1.0f) {
-						selectedWeights[animJump] = glm::clamp(selectedWeights[animJump] + timer.mDelta * animFadeIn, 0.0f, 1.0f);
-					}
-				}
-
-				size_t animIndex = 0;
-				for (const auto& anim : as->mAnimations) {
-					ImGui::SliderFloat(("#" + std::to_string(animIndex) + " " + anim->mName).c_str(), &selectedWeights[animIndex], 0.0f, 1.0f);
-					ac->BlendAnimation(animIndex, selectedWeights[animIndex]);
-					animIndex++;
-				}
-			}
-
-			if (ImGui::CollapsingHeader("Stuff")) {
-				ImGui::End();
-			}
-
-			if (ImGui::TreeNode("AnimationNodes")) {
-				auto renderTree = [](AnimationNode_ node, auto renderTree) -> void {
-					if (ImGui::TreeNode(node->mName.c_str())) {
-						for (auto& c : node->mChildren) {
-							renderTree(c, renderTree);
-						}
-						ImGui::TreePop();
-					}
-				};
-				renderTree(as->mAnimations[0]->mRootNode, renderTree);
-				ImGui::TreePop();
-			}
-
-			ImGui::End();
-		}
-
-		//cam.mView = glm::lookAt(glm::vec3(4.0f,4.0f,4.0f), glm::vec3(0.0f,2.0f,0.0f), glm::vec3(0.0f,1.0f,0.0f));
-		cam.UpdateView();
-		cam.UpdateProjection();
-
-		scene->Update(timer.mNow, timer.mDelta);
-
-		ShaderProgram_ shaderProgram = nullptr;
-		for (auto& entity : scene->mEntities) {
-			const auto& model = entity->mModel;
-			if (!model) continue;
-			if (entity->mShaderProgram != shaderProgram) {
-				shaderProgram = entity->mShaderProgram;
-				glUseProgram(shaderProgram->mID);
-				glUniformMatrix4fv(shaderProgram->uProj, 1, GL_FALSE, (GLfloat*)&cam.mProjection[0]);
-				glUniformMatrix4fv(shaderProgram->uView, 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
-				glUniform3fv(shaderProgram->uViewPos, 1, (GLfloat*)&cam.mPos[0]);
-				glUniform3fv(shaderProgram->uLightPos, 1, (GLfloat*)&lightPos[0]);
-				glUniform3fv(shaderProgram->uLightColor, 1, (GLfloat*)&lightColor[0]);
-				glUniform1f(shaderProgram->uTime, timer.mNow);
-			}
-			if (entity->mAnimationController && shaderProgram->uBones) {
-				const auto& bones = entity->mAnimationController->mFinalTransforms;
-				glUniformMatrix4fv(shaderProgram->uBones, bones.size(), GL_FALSE, (GLfloat*)&bones[0]);
-			}
-			for (auto& modelMesh : model->mMeshes) {
-				if (modelMesh->mMesh->mHidden) continue;
-				//glm::mat4 meshTransform = entity->mTransform * modelMesh->mTransform;
-
-				// FIXME!!!
-				glm::mat4 meshTransform = entity->mTransform;
-				if (entity->mRigidBody) {
-					meshTransform = glm::translate(meshTransform, { 0, -1, 0 });
-				}
-				meshTransform *= modelMesh->mTransform;
-
-				glUniformMatrix4fv(shaderProgram->uModel, 1, GL_FALSE, (GLfloat*)&meshTransform[0]);
-				modelMesh->mMesh->Bind();
-				glDrawElements(modelMesh->mMesh->mMode, modelMesh->mMesh->mIndices.size(), GL_UNSIGNED_INT, 0);
-			}
-		}
-
-		if (enableDebug) {
-			if (drawDebug) {
-				glDisable(GL_DEPTH_TEST);
-				debugRenderer.Render(cam);
-				glEnable(GL_DEPTH_TEST);
-			}
-			if (drawPersistentDebug) {
-				persistentDebugRenderer.Render(cam);
-			}
-		}
-		debugRenderer.Clear();
-
-		ui->Render();
-	}
-
-	input.reset();
-	scene.reset();
-
-	glfwTerminate();
-	return 0;
-}
+#include "Main.h"
+#include "Scene.h"
+#include "Shader.h"
+#include "Input.h"
+#include "UI.h"
+#include "Debug.h"
+#include "Camera.h"
+#include "UniformBuffer.h"
+#include "IndirectRenderer.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "Skinning.h"
+
+#ifdef USE_HIGH_PERFORMANCE_GPU
+extern "C" {
+	_declspec(dllexport) unsigned long NvOptimusEnablement = 1;
+	_declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
+}
+#endif
+
+Input* Input::sInstance = nullptr;
+
+Scene_ CreateScene(const int argc, const char** argv, int physicsThreads) {
+	auto scene = std::make_shared<Scene>();
+	scene->mForcePhysicsThreads = physicsThreads;
+	bool loadModel = true;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		
+		if (arg == "-s") {
+			scene->Load(argv[++i]);
+		} /*else if (arg == "-m") {
+			loadModel = true;
+		} else if (arg == "-a") {
+			loadModel = false;
+		} else {
+			if (loadModel) {
+				auto model = std::make_shared<Model>();
+				model->Load(arg);
+				scene->mEntities.push_back(std::make_shared<Entity>(model));
+			} else {
+				scene->mEntities.back()->mModel->LoadAnimation(arg, true);
+			}
+		}*/
+	}
+	scene->Init();
+	return scene;
+}
+
+float get_deque(void* data, int idx) {
+	auto deque = (std::deque<float>*)data;
+	return deque->at(idx);
+}
+
+float get_ring(void* data, int idx) {
+	auto ring = (RingBuffer<float>*)data;
+	return (*ring)[idx];
+}
+
+int main(const int argc, const char **argv) {
+	Benchmark benchmark(argc, argv);
+
+	glfwSetErrorCallback([](int error, const char* description) {
+		std::cerr << "GLFW error " << error << ": " << description << std::endl;
+	});
+	if (!glfwInit()) {
+		std::cerr << "glfwInit failed" << std::endl;
+		return -1;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	glfwWindowHint(GLFW_VISIBLE, benchmark.mEnabled ? GLFW_FALSE : GLFW_TRUE);
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, benchmark.mContextApi);
+
+	const std::string windowTitle = "OpenGL Animation Demo";
+	
+	auto fullscreen = false;
+
+	auto monitor = fullscreen ? glfwGetPrimaryMonitor() : NULL;
+	auto window = glfwCreateWindow(1280, 720, windowTitle.c_str(), monitor, NULL);
+	if (!window) {
+		std::cerr << "glfwCreateWindow failed" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+
+	glfwMakeContextCurrent(window);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		std::cerr << "Failed to initialize OpenGL context" << std::endl;
+		return -1;
+	}
+
+	Profiler::Get().SetThreadName("main");
+	Profiler::Get().mGpu.Init();
+	if (benchmark.mEnabled) {
+		benchmark.PrepareProfiler(Profiler::Get());
+		srand(benchmark.mSeed);
+	}
+
+	auto scene = CreateScene(argc, argv, benchmark.mEnabled ? benchmark.mPhysicsThreads : -1);
+	auto input = std::make_shared<Input>(window, scene);
+
+	int windowWidth, windowHeight;
+	glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+	glViewport(0, 0, windowWidth, windowHeight);
+	glfwSwapInterval(0);
+
+	auto ui = std::make_shared<UI>(window);
+
+	bool autoBlend = false;
+	bool animDetails = false;
+	bool modelDetails = true;
+	bool enableDebug = true;
+	bool showSkinnedBounds = false; // CPU skinned, see Skinning.h
+	bool cpuSkinning = false; // draw the selected model skinned by SkinMesh through dynamic meshes
+	bool showProfiler = false;
+	bool headRot = false;
+
+	std::vector<float> selectedWeights;
+
+	glm::vec3 lightPos = { 100.0f, 100.0f, 100.0f };
+	glm::vec3 lightColor = { 1.0f, 1.0f, 1.0f };
+
+	DebugRenderer debugRenderer;
+	auto& gridLayer = debugRenderer.AddLayer("grid", true);
+	auto& debugLayer = debugRenderer.AddLayer("frame", false, false);
+
+	gridLayer.AddGrid(1.0f, 10.0f, { .5f, .5f, .5f });
+
+	Camera cam;
+	cam.mRight = glm::normalize(glm::cross(cam.mUp, cam.mFront));
+	cam.SetAspect(windowWidth, windowHeight);
+	float movementSpeed = 1.0f;
+	float camSpeed = 10.0f;
+
+	FrameCounter<float> fps(600);
+
+	std::vector<EntityID> visibleEntities;
+
+	ShaderWatcher shaderWatcher;
+
+	// Frame is bound once, Draw is rebound per draw
+	UniformBuffer frameUniforms(sizeof(FrameUniforms));
+	frameUniforms.Bind(FrameBinding);
+	UniformStream<DrawUniforms> drawUniforms(4096);
+
+	// One mesh or emitter of a visible entity, in the order its Draw block was pushed
+	struct DrawCommand {
+		uint32_t mRenderIndex;
+		Mesh* mMesh; // null for emitters
+		uint32_t mLod;
+	};
+	std::vector<DrawCommand> drawCommands;
+
+	// Static meshes of unspecialized default programs go through multi draw indirect when available
+	IndirectRenderer indirectRenderer;
+
+	bool enableLod = true;
+	size_t drawnTriangles = 0;
+
+	// CPU skinned copies of the selected model's meshes, rewritten every frame
+	std::unordered_map<const Mesh*, Mesh_> cpuSkinnedMeshes;
+	std::vector<glm::mat4> cpuSkinningBones;
+	SkinnedMesh cpuSkinned;
+
+	Timer<float> timer;
+	while (!glfwWindowShouldClose(window) && !benchmark.IsDone()) {
+		if (benchmark.mEnabled) {
+			benchmark.BeginFrame(timer);
+		} else {
+			timer.Update();
+		}
+		input->mNow = timer.mNow;
+		input->mDelta = timer.mDelta;
+
+		if (fps.Tick(timer.mNow, timer.mDelta)) {
+			glfwSetWindowTitle(window, (windowTitle + " - FPS: " + std::to_string(fps.mValue) + ", p99: " + std::to_string(fps.mStats.mP99) + " ms").c_str());
+		}
+
+		if (benchmark.mDraw) {
+			glfwSwapBuffers(window);
+
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glEnable(GL_DEPTH_TEST);
+		}
+
+		// Frame boundary, no draws are being recorded: programs can be swapped and geometry moved
+		shaderWatcher.Update();
+		GeometryArena<Vertex>::Get().Update();
+		Profiler::Get().EndFrame();
+
+		// Input callbacks and everything up to scene->Update modify the scene
+		scene->Sync();
+		glfwPollEvents();
+
+		if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+			glfwSetWindowShouldClose(window, 1);
+		}
+
+		auto selected = scene->mSelected;
+		if (nullptr != selected) {
+			movementSpeed = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) ? 10.0f : 2.0f;
+			float walk = 0;
+			float strafe = 0;
+
+			if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+				walk = movementSpeed;
+			if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+				walk = -movementSpeed;
+			if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+				strafe = -movementSpeed;
+			if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+				strafe = movementSpeed;
+			bool jump = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+
+			if (benchmark.mEnabled) {
+				const auto script = benchmark.GetInput();
+				walk = script.mWalk * movementSpeed;
+				strafe = script.mStrafe * movementSpeed;
+				jump = script.mJump;
+			}
+
+			if (walk != 0) {
+				scene->mSelected->Move(selected->mFront * walk);
+				debugLayer.AddLine({ selected->GetTransform().mPos, selected->GetTransform().mPos + selected->mFront * walk, {1,0,1} });
+			}
+
+			if (strafe != 0) {
+				scene->mSelected->Strafe(strafe);
+			}
+
+			if (jump)
+				scene->mSelected->Jump();
+			//if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+			//	cam.Crounch();
+
+			auto selectedHeight = scene->mSelected->mModel ? scene->mSelected->mModel->mAABB.mHalfSize.y : 0.0f;
+			auto selectedCenter = scene->mSelected->GetTransform().mPos + scene->mSelected->mUp * selectedHeight;
+			
+			bool rotPlayer = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2) == GLFW_PRESS;
+			bool rot = rotPlayer || glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) == GLFW_PRESS;
+			if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) { rot = true; scene->mCameraRotationX = -0.1f; }
+			if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {rot=true;scene->mCameraRotationX = 0.1f;}
+			if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {rot=true;scene->mCameraRotationY = 0.1f;
+}			if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {rot=true;scene->mCameraRotationY = -0.1f;}
+			
+			if (rot) {
+				auto rotY = glm::angleAxis(scene->mCameraRotationX * timer.mDelta, glm::vec3(0, 1, 0));
+				auto rotX = glm::angleAxis(scene->mCameraRotationY * timer.mDelta, cam.mRight);
+				// TODO: limit X
+				auto targetPos2 = glm::normalize(rotY * rotX * cam.mFront);
+				targetPos2 = selectedCenter + targetPos2 * -scene->mCameraDistance;
+
+				// FIXME
+				scene->mCameraRotationX = 0;
+				scene->mCameraRotationY = 0;
+
+				cam.mPos = targetPos2;
+				debugLayer.AddLine({ selectedCenter , cam.mPos, {1,1,1} });
+				cam.mFront = glm::normalize(selectedCenter - cam.mPos);
+				cam.mRight = glm::normalize(glm::cross(cam.mUp, cam.mFront));
+			}
+			else {
+				// TODO: Fixed pos & rot from player
+				auto targetPos = selectedCenter + cam.mFront * -scene->mCameraDistance;
+				cam.mPos.y = targetPos.y;
+				cam.mPos = glm::lerp(cam.mPos, targetPos, timer.mDelta * camSpeed);
+				cam.mFront = glm::lerp(cam.mFront, glm::normalize(selectedCenter - cam.mPos), timer.mDelta * camSpeed); // TODO norm
+				cam.mRight = glm::normalize(glm::cross(cam.mUp, cam.mFront));
+			}
+
+			if (rotPlayer) {
+				selected->mTargetFront = glm::normalize(glm::cross(cam.mRight, selected->mUp));
+				selected->mTargetFrontEnable = true;
+			}
+		}
+
+		if (benchmark.mEnabled) {
+			benchmark.UpdateCamera(cam, timer.mNow);
+		}
+
+		if (enableDebug && selected) {
+			const auto& selectedPos = selected->GetTransform().mPos;
+			debugLayer.AddLine({ selectedPos, selectedPos + cam.mFront, { 1, 1, 1 } });
+			debugLayer.AddLine({ selectedPos, selectedPos + selected->mFront, { 1, 0, 0 } });
+			debugLayer.AddLine({ selectedPos, selectedPos + selected->mUp, { 0, 1, 0 } });
+			debugLayer.AddPoint(selectedPos);
+			if (selected->mModel) {
+				debugLayer.AddCube(selectedPos, selected->mModel->mAABB, { 1, 1, 0 });
+			}
+			if (showSkinnedBounds && selected->mModel && selected->mModel->HasAnimations()) {
+				debugLayer.AddCube({ 0, 0, 0 }, scene->GetSkinnedBounds(selected->mID), { 0, 1, 1 });
+			}
+		}
+
+		ProfileScope uiScope("UI");
+		ui->NewFrame();
+
+		//ImGui::ShowDemoWindow();
+		ImGui::PlotHistogram("Frame ms", get_ring, (void*)&fps.mFrameTimes, fps.mFrameTimes.Size(), 0, NULL, 0.0f, fps.mBudget * 2.0f, ImVec2(600, 100));
+		ImGui::Text("Frame: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms, %d/%d over %.1f ms",
+			fps.mStats.mP50, fps.mStats.mP95, fps.mStats.mP99, fps.mStats.mMax, (int)fps.mStats.mHitches, (int)fps.mStats.mFrames, fps.mBudget);
+
+		if (selected) {
+			ImGui::PlotHistogram("Y", get_deque, (void*)&selected->mHistoryY, selected->mHistoryY.size(), 0, NULL, FLT_MAX, FLT_MAX, ImVec2(600, 100));
+		}
+
+		ImGui::Checkbox("debug", &enableDebug);
+		if (enableDebug) {
+			ImGui::Checkbox("skinned bounds", &showSkinnedBounds);
+			ImGui::Checkbox("CPU skinning", &cpuSkinning);
+			for (auto& layer : debugRenderer.mLayers) {
+				ImGui::Checkbox(layer->mName.c_str(), &layer->mVisible);
+				ImGui::SameLine();
+				ImGui::Checkbox(("depth test##" + layer->mName).c_str(), &layer->mDepthTest);
+			}
+		}
+
+		auto selectedModel = scene->mSelected ? scene->mSelected->mModel : nullptr;
+		if (selectedModel) {
+			ImGui::Checkbox("Model info", &modelDetails);
+			ImGui::Text(std::to_string(scene->mCameraRotationX).c_str());
+			ImGui::Text(std::to_string(scene->mCameraRotationY).c_str());
+
+			if (modelDetails) {
+				ImGui::Text("Name: %s", selectedModel->mName.c_str());
+				ImGui::Text("Model: c=%s, s=%s | length=%f",
+					glm::to_string(selectedModel->mAABB.mCenter).c_str(),
+					glm::to_string(selectedModel->mAABB.mHalfSize).c_str(),
+					glm::length(selectedModel->mAABB.mHalfSize) * 2.0f
+				);
+				/*for (const auto& mesh : selectedModel->mMeshes) {
+					ImGui::Text("Mesh: h=%d, v=%d, i=%d, c=%s, s=%s",
+						mesh->mHidden,
+						mesh->mVertices.size(),
+						mesh->mIndices.size(),
+						glm::to_string(mesh->mAABB.mCenter).c_str(),
+						glm::to_string(mesh->mAABB.mHalfSize).c_str()
+					);
+				}*/
+			}
+			if (selectedModel->HasAnimations() && ImGui::TreeNode("AnimationNodes")) {
+				auto renderTree = [](AnimationNode_ node, auto renderTree) -> void {
+					if (ImGui::TreeNode(node->mName.c_str())) {
+						ImGui::Text(glm::to_string(node->mTransform).c_str());
+						for (auto& c : node->mChildren) {
+							renderTree(c, renderTree);
+						}
+						ImGui::TreePop();
+					}
+				};
+				renderTree(selectedModel->mAnimationSet->mAnimations[0]->mRootNode, renderTree);
+				ImGui::TreePop();
+			}
+		}
+
+		ImGui::Text("GL_VENDOR: %s", glGetString(GL_VENDOR));
+		ImGui::Text("GL_RENDERER: %s", glGetString(GL_RENDERER));
+		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+		ImGui::Text("Visible: %d/%d, BVH height: %d", (int)visibleEntities.size(), (int)scene->mSpatialIndex.GetProxyCount(), scene->mSpatialIndex.GetHeight());
+		ImGui::Text("Physics: %.3f ms, %d rigid bodies", scene->mPhysicsTime, scene->mDynamicsWorld->getNumCollisionObjects());
+		if (scene->mPhysicsThreads > 0 && ImGui::SliderInt("Physics threads", &scene->mPhysicsThreads, 1, btGetTaskScheduler()->getMaxNumThreads())) {
+			btGetTaskScheduler()->setNumThreads(scene->mPhysicsThreads);
+		}
+		ImGui::Checkbox("Async update", &scene->mAsyncUpdate);
+		ImGui::Checkbox("Profiler", &showProfiler);
+		if (showProfiler) {
+			Profiler::Get().DrawPanel(&showProfiler);
+		}
+		if (IndirectRenderer::IsSupported()) {
+			ImGui::Checkbox("Multi draw indirect", &indirectRenderer.mEnabled);
+			ImGui::SameLine();
+			ImGui::Text("%d draws", (int)indirectRenderer.mDrawCount);
+		}
+		ImGui::Checkbox("LOD", &enableLod);
+		ImGui::SameLine();
+		ImGui::Text("%d triangles", (int)drawnTriangles);
+		const auto geometry = GeometryArena<Vertex>::Get().GetStats();
+		ImGui::Text("Geometry: %d meshes, vertices %.2f/%.2f MB, indices %.2f/%.2f MB, stream %.2f MB, %d free ranges, %d defragmentations",
+			(int)geometry.mAllocations,
+			geometry.mVertexBytes / (1024.0f * 1024.0f), geometry.mVertexCapacityBytes / (1024.0f * 1024.0f),
+			geometry.mIndexBytes / (1024.0f * 1024.0f), geometry.mIndexCapacityBytes / (1024.0f * 1024.0f),
+			geometry.mStreamCapacityBytes / (1024.0f * 1024.0f),
+			(int)geometry.mFreeRanges, (int)geometry.mDefragmentations);
+		auto meshMemory = scene->GetMeshMemoryStats();
+		for (const auto& skinnedMesh : cpuSkinnedMeshes) {
+			meshMemory.Add(*skinnedMesh.second);
+		}
+		for (const auto policy : { MeshResidency::Release, MeshResidency::Keep, MeshResidency::Dynamic }) {
+			static const char* names[] = { "release", "keep", "dynamic" };
+			const auto i = (size_t)policy;
+			ImGui::Text("Meshes (%s): %d, CPU %.2f MB, GPU %.2f MB", names[i], (int)meshMemory.mMeshes[i],
+				meshMemory.mCpuBytes[i] / (1024.0f * 1024.0f), meshMemory.mGpuBytes[i] / (1024.0f * 1024.0f));
+		}
+
+		if (selected && selected->mAnimationController) {
+			const auto ac = selected->mAnimationController;
+			const auto as = ac->mAnimationSet;
+			ImGui::Begin("Animations");
+			ImGui::Text(ac->GetAnimationEnabled() ? ac->GetAnimation()->mName.c_str() : "DISABLED");
+
+			ImGui::Checkbox("Animation info", &animDetails);
+			if (animDetails) {
+				for (const auto& anim : as->mAnimations) {
+					ImGui::Text("Animation: %s, %f", anim->mName.c_str(), anim->mDuration);
+				}
+			}
+
+			ImGui::Checkbox("Blend", &ac->mBlended);
+			if (ac->mBlended) {
+				ImGui::Checkbox("HeadRot", &headRot);
+				if (headRot) {
+					//ac->mHeadRot = glm::quatLookAt(cam.mFront, { 0, 0, 1 });
+					double mx = 0;
+					glfwGetCursorPos(window, &mx, nullptr);
+					ac->mHeadRot = glm::rotate(glm::identity<glm::quat>(), (float)mx * 0.025f, { 0, 1, 0 });
+				}
+				else {
+					ac->mHeadRot = glm::identity<glm::quat>();
+				}
+
+				ImGui::Checkbox("autoBlend", &autoBlend);
+
+				// FIXME
+				if (selectedWeights.size() != ac->GetAnimationCount()) {
+					selectedWeights.resize(ac->GetAnimationCount());
+					if (!selectedWeights.empty()) {
+						std::fill(selectedWeights.begin(), selectedWeights.end(), 0);
+						selectedWeights[0] = 1.0f;
+					}
+				}
+
+				// FIXME
+				if (autoBlend) {
+					const auto animIdle = as->GetAnimationIndex("CharacterArmature|Idle");
+					const auto animWalk = as->GetAnimationIndex("CharacterArmature|Walk");
+					const auto animJump = as->GetAnimationIndex("CharacterArmature|Victory");
+					const float animFadeIn = 20.0f;
+					const float animFadeOut = 10.0f;
+
+					for (auto& w : selectedWeights) {
+						w = glm::clamp(w - timer.mDelta * animFadeOut, 0.0f, 1.0f);
+					}
+
+					// TODO: Move to ? & use velocity to choose animation
+					if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+						selectedWeights[animWalk] = glm::clamp(selectedWeights[animWalk] + timer.mDelta * animFadeIn, 0.0f, 1.0f);
+					} else {
+						selectedWeights[animIdle] = glm::clamp(selectedWeights[animIdle] + timer.mDelta * animFadeIn, 0.0f, 1.0f);
+					}
+
+					if (scene->mSelected->GetTransform().mPos.y > 1.0f) {
+						selectedWeights[animJump] = glm::clamp(selectedWeights[animJump] + timer.mDelta * animFadeIn, 0.0f, 1.0f);
+					}
+				}
+
+				size_t animIndex = 0;
+				for (const auto& anim : as->mAnimations) {
+					ImGui::SliderFloat(("#" + std::to_string(animIndex) + " " + anim->mName).c_str(), &selectedWeights[animIndex], 0.0f, 1.0f);
+					ac->BlendAnimation(animIndex, selectedWeights[animIndex]);
+					animIndex++;
+				}
+			}
+
+			if (ImGui::CollapsingHeader("Stuff")) {
+				ImGui::End();
+			}
+
+			if (ImGui::TreeNode("AnimationNodes")) {
+				auto renderTree = [](AnimationNode_ node, auto renderTree) -> void {
+					if (ImGui::TreeNode(node->mName.c_str())) {
+						for (auto& c : node->mChildren) {
+							renderTree(c, renderTree);
+						}
+						ImGui::TreePop();
+					}
+				};
+				renderTree(as->mAnimations[0]->mRootNode, renderTree);
+				ImGui::TreePop();
+			}
+
+			ImGui::End();
+		}
+
+		//cam.mView = glm::lookAt(glm::vec3(4.0f,4.0f,4.0f), glm::vec3(0.0f,2.0f,0.0f), glm::vec3(0.0f,1.0f,0.0f));
+		uiScope.End();
+
+		cam.UpdateView();
+		cam.UpdateProjection();
+
+		scene->Update(timer.mNow, timer.mDelta);
+
+		{
+			PROFILE_SCOPE("Culling");
+			visibleEntities.clear();
+			scene->QueryFrustum(cam.GetFrustum(), visibleEntities);
+		}
+
+		// Only the render state may be read from here on, the next simulation can be running
+		const auto& renderState = scene->mRenderState;
+
+		ProfileScope drawScope("Draw submission");
+		GpuProfileScope gpuDrawScope("Scene");
+		FrameUniforms frame = {};
+		frame.mProj = cam.mProjection;
+		frame.mView = cam.mView;
+		frame.mViewPos = cam.mPos;
+		frame.mTime = timer.mNow;
+		frame.mLightPos = lightPos;
+		frame.mLightColor = lightColor;
+		if (benchmark.mDraw) {
+			frameUniforms.Update(&frame);
+		}
+
+		drawCommands.clear();
+		drawnTriangles = 0;
+		if (!cpuSkinning) {
+			cpuSkinnedMeshes.clear();
+		}
+		for (auto id : visibleEntities) {
+			const auto renderIndex = scene->mRegistry.mRenders.mIndices[id];
+			const auto& render = scene->mRegistry.mRenders.mData[renderIndex];
+			const auto& instance = renderState.mInstances[renderIndex];
+			if (render.mEmitter) {
+				drawUniforms.Push({ instance.mWorld });
+				drawCommands.push_back({ renderIndex, nullptr, 0 });
+				continue;
+			}
+			const bool indirect = render.mShaderProgram->mName == "default" && render.mShaderProgram->mDefines.IsEmpty();
+			for (auto& modelMesh : render.mModel->mMeshes) {
+				if (modelMesh->mMesh->mHidden) continue;
+				//glm::mat4 meshTransform = instance.mWorld * modelMesh->mTransform;
+
+				// FIXME!!!
+				glm::mat4 meshTransform = glm::translate(instance.mWorld, render.mOffset);
+				meshTransform *= modelMesh->mTransform;
+
+				auto mesh = modelMesh->mMesh.get();
+				if (cpuSkinning && instance.mBoneCount && scene->mSelected && scene->mSelected->mID == id) {
+					auto& skinnedMesh = cpuSkinnedMeshes[mesh];
+					if (!skinnedMesh) skinnedMesh = std::make_shared<Mesh>();
+					const auto first = renderState.mBones.begin() + instance.mBoneOffset;
+					cpuSkinningBones.assign(first, first + instance.mBoneCount);
+					if (SkinMesh(*mesh, cpuSkinningBones, cpuSkinned)) {
+						CopySkinnedMesh(*mesh, cpuSkinned, *skinnedMesh);
+						mesh = skinnedMesh.get();
+					}
+				}
+				size_t lod = 0;
+				if (enableLod && !mesh->mLods.empty()) {
+					const auto bounds = mesh->mAABB.Transform(meshTransform);
+					lod = mesh->GetLod(cam.GetScreenSize(bounds.mCenter, glm::length(bounds.mHalfSize)));
+				}
+				drawnTriangles += mesh->GetIndexCount(lod) / 3;
+
+				if (indirect && indirectRenderer.Add(*mesh, meshTransform, lod)) continue;
+				drawUniforms.Push({ meshTransform });
+				drawCommands.push_back({ renderIndex, mesh, (uint32_t)lod });
+			}
+		}
+		if (benchmark.mDraw) {
+			drawUniforms.Flush();
+		} else {
+			// Gathered for the timings only
+			drawUniforms.Clear();
+			drawCommands.clear();
+			indirectRenderer.Clear();
+		}
+
+		ShaderProgram* shaderProgram = nullptr;
+		uint32_t boneRenderIndex = UINT32_MAX;
+		for (size_t i = 0; i < drawCommands.size(); i++) {
+			const auto& command = drawCommands[i];
+			const auto& render = scene->mRegistry.mRenders.mData[command.mRenderIndex];
+			const auto& instance = renderState.mInstances[command.mRenderIndex];
+			if (render.mShaderProgram != shaderProgram) {
+				shaderProgram = render.mShaderProgram;
+				glUseProgram(shaderProgram->mID);
+				boneRenderIndex = UINT32_MAX;
+			}
+			if (instance.mBoneCount && shaderProgram->uBones >= 0 && boneRenderIndex != command.mRenderIndex) {
+				glUniformMatrix4fv(shaderProgram->uBones, instance.mBoneCount, GL_FALSE, (GLfloat*)&renderState.mBones[instance.mBoneOffset]);
+				boneRenderIndex = command.mRenderIndex;
+			}
+			drawUniforms.Bind(DrawBinding, i);
+			if (!command.mMesh) {
+				render.mEmitter->Draw();
+				continue;
+			}
+			command.mMesh->Bind();
+			command.mMesh->Draw(command.mLod);
+		}
+		indirectRenderer.Render();
+		gpuDrawScope.End();
+		drawScope.End();
+
+		if (enableDebug && benchmark.mDraw) {
+			debugRenderer.Render();
+		}
+		debugRenderer.Clear();
+
+		if (benchmark.mDraw) {
+			ui->Render();
+		} else {
+			ImGui::EndFrame();
+		}
+	}
+
+	int result = 0;
+	if (benchmark.mEnabled) {
+		scene->Sync();
+		if (!benchmark.Finish(Profiler::Get(), scene->mPhysicsThreads)) {
+			result = 1;
+		}
+	} else {
+		fps.Log(std::cout);
+	}
+
+	input.reset();
+	scene.reset();
+	GeometryArena<Vertex>::Get().Shutdown();
+
+	glfwTerminate();
+	return result;
+}
@@ -1,129 +1,283 @@
-#pragma once
-
-#define MAX_VERTEX_WEIGHTS 4
-#define AI_LMW_MAX_WEIGHTS MAX_VERTEX_WEIGHTS
-
-#define GLFW_INCLUDE_NONE
-#include <GLFW/glfw3.h>
-#include <glad/glad.h>
-
-#define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/glm.hpp>
-#include <glm/gtc/epsilon.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/hash.hpp>
-#include "glm/ext.hpp"
-
-#include <cstring>
-#include <cstdlib>
-#include <cstdint>
-#include <vector>
-#include <map>
-#include <sstream>
-#include <iostream>
-#include <fstream>
-#include <stdexcept>
-#include <algorithm>
-#include <initializer_list>
-#include <list>
-#include <deque>
-#include <execution>
-#include <filesystem>
-
-#include <rapidjson/document.h>
-#include <rapidjson/istreamwrapper.h>
-#include <rapidjson/ostreamwrapper.h>
-#include <rapidjson/writer.h>
-
-inline void LoadJson(rapidjson::Document &doc, const std::string& fileName) {
-	std::ifstream ifs(fileName);
-	rapidjson::IStreamWrapper isw(ifs);
-	doc.ParseStream<rapidjson::kParseDefaultFlags | rapidjson::kParseCommentsFlag | rapidjson::kParseTrailingCommasFlag>(isw);
-}
-
-inline float GetTime() {
-	return (float)glfwGetTime();
-}
-
-inline glm::vec3 RandomColor() {
-	return {
-		(float)(rand()) / (float)(RAND_MAX),
-		(float)(rand()) / (float)(RAND_MAX),
-		(float)(rand()) / (float)(RAND_MAX)
-	};
-}
-
-inline std::string ReadFile(const std::string& path) {
-	std::ifstream stream(path, std::ios::in);
-	if (!stream.is_open()) {
-		std::string message = "Could not open file: " + path;
-		throw new std::runtime_error(message);
-	}
-	std::stringstream buffer;
-	buffer << stream.rdbuf();
-	const auto source = buffer.str();
-	stream.close();
-	return source;
-}
-
-template<typename T>
-size_t SplitString(const std::string& str, const std::string& delim, T &result) {
-	size_t current = str.find(delim);
-	size_t previous = 0;
-	while (current != std::string::npos) {
-		result.push_back(str.substr(previous, current - previous));
-		previous = current + 1;
-		current = str.find(delim, previous);
-	}
-	result.push_back(str.substr(previous, current - previous));
-	return result.size();
-}
-
-template<typename T>
-struct Timer {
-	T mNow = 0;
-	T mDelta = 0;
-	T mLastUpdate = 0;
-
-	void Update() {
-		mNow = (T)glfwGetTime();
-		mDelta = mNow - mLastUpdate;
-		mLastUpdate = mNow;
-	}
-};
-
-template<typename T>
-struct FrameCounter {
-	std::deque<T> mHistory;
-	std::deque<T> mFrameTimeHistory;
-	size_t mHistoryLimit = 0;
-	size_t mCounter = 0;
-	T mInterval = 1.0;
-	T mNextUpdate = 0;
-	size_t mValue = 0;
-
-	bool Tick(const T now, const T delta) {
-		mCounter++;
-		mFrameTimeHistory.push_back(delta);
-		if (mFrameTimeHistory.size() > mHistoryLimit) mFrameTimeHistory.pop_front();
-		if (mNextUpdate > now) return false;
-		mValue = mCounter;
-		if (mHistoryLimit > 0) {
-			mHistory.push_back(mValue);
-			if (mHistory.size() > mHistoryLimit) {
-				mHistory.pop_front();
-			}
-		}
-		mNextUpdate = now + mInterval;
-		mCounter = 0;
-		return true;
-	}
-
-	size_t fps = 0;
-	float fps_timer = 0;
-	size_t fps_counter = 0;
-	std::deque<float> fps_history;
-	float timer = GetTime();
-};
\ No newline at end of file
+#pragma once
+
+#define MAX_VERTEX_WEIGHTS 4
+#define AI_LMW_MAX_WEIGHTS MAX_VERTEX_WEIGHTS
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <glad/glad.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/epsilon.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/hash.hpp>
+#include "glm/ext.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <initializer_list>
+#include <list>
+#include <tuple>
+#include <deque>
+#include <execution>
+#include <filesystem>
+#include <thread>
+#include <random>
+#include <future>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/writer.h>
+
+inline void LoadJson(rapidjson::Document &doc, const std::string& fileName) {
+	std::ifstream ifs(fileName);
+	rapidjson::IStreamWrapper isw(ifs);
+	doc.ParseStream<rapidjson::kParseDefaultFlags | rapidjson::kParseCommentsFlag | rapidjson::kParseTrailingCommasFlag>(isw);
+}
+
+inline float GetTime() {
+	return (float)glfwGetTime();
+}
+
+inline glm::vec3 RandomColor() {
+	return {
+		(float)(rand()) / (float)(RAND_MAX),
+		(float)(rand()) / (float)(RAND_MAX),
+		(float)(rand()) / (float)(RAND_MAX)
+	};
+}
+
+inline std::string ReadFile(const std::string& path) {
+	std::ifstream stream(path, std::ios::in);
+	if (!stream.is_open()) {
+		std::string message = "Could not open file: " + path;
+		throw std::runtime_error(message);
+	}
+	std::stringstream buffer;
+	buffer << stream.rdbuf();
+	const auto source = buffer.str();
+	stream.close();
+	return source;
+}
+
+// FNV-1a, stable across runs and platforms unlike std::hash
+inline uint64_t HashString(const std::string& str) {
+	uint64_t hash = 14695981039346656037ull;
+	for (auto c : str) {
+		hash ^= (uint8_t)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+template<typename T>
+size_t SplitString(const std::string& str, const std::string& delim, T &result) {
+	size_t current = str.find(delim);
+	size_t previous = 0;
+	while (current != std::string::npos) {
+		result.push_back(str.substr(previous, current - previous));
+		previous = current + 1;
+		current = str.find(delim, previous);
+	}
+	result.push_back(str.substr(previous, current - previous));
+	return result.size();
+}
+
+template<typename T>
+struct Timer {
+	T mNow = 0;
+	T mDelta = 0;
+	T mLastUpdate = 0;
+
+	void Update() {
+		mNow = (T)glfwGetTime();
+		mDelta = mNow - mLastUpdate;
+		mLastUpdate = mNow;
+	}
+
+	// Fixed step instead of the wall clock, see Benchmark
+	void Step(T delta) {
+		mNow += delta;
+		mDelta = delta;
+		mLastUpdate = mNow;
+	}
+};
+
+// Fixed capacity ring, the oldest value is overwritten once full. Index 0 is
+// the oldest value.
+template<typename T>
+struct RingBuffer {
+	std::vector<T> mData;
+	size_t mHead = 0; // next write
+	size_t mSize = 0;
+
+	RingBuffer(size_t capacity) : mData(capacity) {}
+
+	void Push(const T& value) {
+		mData[mHead] = value;
+		mHead = (mHead + 1) % mData.size();
+		mSize = std::min(mSize + 1, mData.size());
+	}
+	void Clear() {
+		mHead = 0;
+		mSize = 0;
+	}
+	size_t Size() const {
+		return mSize;
+	}
+	size_t Capacity() const {
+		return mData.size();
+	}
+	const T& operator[](size_t index) const {
+		return mData[(mHead + mData.size() - mSize + index) % mData.size()];
+	}
+	const T& Back() const {
+		return (*this)[mSize - 1];
+	}
+};
+
+// Frame times in ms
+struct FrameTimeStats {
+	size_t mFrames = 0;
+	size_t mHitches = 0; // frames over budget
+	float mMean = 0.0f;
+	float mP50 = 0.0f;
+	float mP95 = 0.0f;
+	float mP99 = 0.0f;
+	float mMax = 0.0f;
+};
+
+// Frame time statistics. Percentiles over the last frames come from a ring of
+// raw frame times and are refreshed once per interval, the whole run is kept
+// in a fixed histogram of HistogramResolution ms buckets for the summary at
+// exit. A hitch is a frame longer than mBudget.
+template<typename T>
+struct FrameCounter {
+	static constexpr T HistogramResolution = (T)0.1; // ms
+	static constexpr size_t HistogramBuckets = 10000; // the last one collects everything from 1 s up
+
+	RingBuffer<T> mFrameTimes; // ms
+	std::vector<uint32_t> mHistogram;
+	std::vector<T> mScratch;
+	FrameTimeStats mStats; // rolling, see Tick
+	T mBudget = (T)(1000.0 / 60.0); // ms
+	size_t mFrames = 0; // whole run
+	size_t mHitches = 0;
+	double mTotalTime = 0.0; // ms
+	T mMaxTime = 0;
+	size_t mCounter = 0;
+	T mInterval = 1.0; // s
+	T mNextUpdate = 0;
+	size_t mValue = 0; // frames in the last interval
+	bool mStarted = false;
+
+	FrameCounter(size_t capacity = 600) : mFrameTimes(capacity), mHistogram(HistogramBuckets, 0) {
+		mScratch.reserve(capacity);
+	}
+
+	// Returns true once per interval, after mValue and mStats were updated.
+	// The first frame includes startup and is not recorded.
+	bool Tick(const T now, const T delta) {
+		mCounter++;
+		if (mStarted) {
+			Record(delta * (T)1000.0);
+		}
+		mStarted = true;
+		if (mNextUpdate > now) return false;
+		mValue = mCounter;
+		mStats = ComputeStats();
+		mNextUpdate = now + mInterval;
+		mCounter = 0;
+		return true;
+	}
+
+	void Record(T ms) {
+		mFrameTimes.Push(ms);
+		mHistogram[std::min((size_t)(ms / HistogramResolution), HistogramBuckets - 1)]++;
+		mFrames++;
+		mHitches += ms > mBudget;
+		mTotalTime += ms;
+		mMaxTime = std::max(mMaxTime, ms);
+	}
+
+	// Over the frames in mFrameTimes, nearest rank percentiles
+	FrameTimeStats ComputeStats() {
+		FrameTimeStats stats;
+		const auto count = mFrameTimes.Size();
+		if (!count) return stats;
+		mScratch.clear();
+		double total = 0.0;
+		for (size_t i = 0; i < count; i++) {
+			const auto ms = mFrameTimes[i];
+			mScratch.push_back(ms);
+			total += ms;
+			stats.mHitches += ms > mBudget;
+		}
+		auto percentile = [this, count](double p) {
+			const auto rank = std::min((size_t)std::ceil(p * count), count) - 1;
+			std::nth_element(mScratch.begin(), mScratch.begin() + rank, mScratch.end());
+			return (float)mScratch[rank];
+		};
+		stats.mFrames = count;
+		stats.mMean = (float)(total / count);
+		stats.mP50 = percentile(0.50);
+		stats.mP95 = percentile(0.95);
+		stats.mP99 = percentile(0.99);
+		stats.mMax = (float)*std::max_element(mScratch.begin(), mScratch.end());
+		return stats;
+	}
+
+	// Over the whole run, percentiles are rounded up to the histogram resolution
+	FrameTimeStats GetRunStats() const {
+		FrameTimeStats stats;
+		if (!mFrames) return stats;
+		auto percentile = [this](double p) {
+			const auto rank = std::max((size_t)std::ceil(p * mFrames), (size_t)1);
+			size_t seen = 0;
+			for (size_t i = 0; i < HistogramBuckets; i++) {
+				seen += mHistogram[i];
+				if (seen >= rank) return std::min((float)((i + 1) * HistogramResolution), (float)mMaxTime);
+			}
+			return (float)mMaxTime;
+		};
+		stats.mFrames = mFrames;
+		stats.mHitches = mHitches;
+		stats.mMean = (float)(mTotalTime / mFrames);
+		stats.mP50 = percentile(0.50);
+		stats.mP95 = percentile(0.95);
+		stats.mP99 = percentile(0.99);
+		stats.mMax = (float)mMaxTime;
+		return stats;
+	}
+
+	void Log(std::ostream& out) const {
+		const auto stats = GetRunStats();
+		out << "Frame times: " << stats.mFrames << " frames"
+			<< ", mean " << stats.mMean << " ms"
+			<< ", p50 " << stats.mP50 << " ms"
+			<< ", p95 " << stats.mP95 << " ms"
+			<< ", p99 " << stats.mP99 << " ms"
+			<< ", max " << stats.mMax << " ms"
+			<< ", " << stats.mHitches << " hitches over " << mBudget << " ms" << std::endl;
+	}
+};
@@ -1,64 +1,219 @@
-#pragma once
-
-#include "Main.h"
-#include "Vertex.h"
-#include "AABB.h"
-
-struct Mesh {
-	std::vector<Vertex> mVertices;
-	std::vector<uint32_t> mIndices;
-	GLuint mVertexBuffer = 0;
-	GLuint mIndexBuffer = 0;
-	GLuint mVertexArray = 0;
-	bool mVertexBufferDirty = true;
-	bool mHidden = false;
-	AABB mAABB;
-	GLuint mMode = GL_TRIANGLES;
-
-	Mesh(const Mesh&) = delete;
-	Mesh& operator=(const Mesh&) = delete;
-	Mesh() {}
-	~Mesh() {
-		if (mVertexBuffer) glDeleteBuffers(1, &mVertexBuffer);
-		if (mIndexBuffer) glDeleteBuffers(1, &mIndexBuffer);
-		if (mVertexArray) glDeleteVertexArrays(1, &mVertexArray);
-	}
-	void Bind() {
-		if (mVertexBufferDirty) {
-			UpdateVertexBuffer();
-			mVertexBufferDirty = false;
-		}
-		if (!mIndexBuffer) {
-			UpdateIndexBuffer();
-		}
-		if (!mVertexArray) {
-			UpdateVertexArray();
-		}
-		glBindVertexArray(mVertexArray);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
-	}
-	void UpdateVertexBuffer() {
-		if (!mVertexBuffer) glGenBuffers(1, &mVertexBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
-		glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex), &mVertices[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
-	void UpdateVertexArray() {
-		if (!mVertexArray) glGenVertexArrays(1, &mVertexArray);
-		glBindVertexArray(mVertexArray);
-		glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
-		Vertex::MapVertexArray();
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
-	void UpdateIndexBuffer() {
-		if (!mIndexBuffer) glGenBuffers(1, &mIndexBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(uint32_t), &mIndices[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	}
-	void UpdateAABB() {
-		mAABB = AABB::FromVertices(mVertices);
-	}
-};
-typedef std::shared_ptr<Mesh> Mesh_;
+#pragma once
+
+#include "Main.h"
+#include "Vertex.h"
+#include "AABB.h"
+#include "GeometryArena.h"
+#include "Simplify.h"
+
+// What happens to the CPU copy of a mesh once it is on the GPU
+enum class MeshResidency {
+	Release, // static meshes, dropped after the upload and reloaded from the model cache on demand
+	Keep, // flagged for CPU access (physics, picking, AABB rebuilds)
+	Dynamic, // rewritten every frame, vertices are streamed instead of stored in the arena
+};
+
+// One level of detail, a range of mIndices followed by mLodIndices
+struct MeshLod {
+	uint32_t mFirstIndex;
+	uint32_t mIndexCount;
+	float mError; // accumulated simplification error in mesh units
+};
+
+// Meshes live in the shared GeometryArena<Vertex>, edits to mVertices are
+// uploaded to the mesh range on the next Bind. Dynamic meshes only keep their
+// indices there, every edit writes all vertices to the arena stream instead.
+struct Mesh {
+	std::vector<Vertex> mVertices;
+	std::vector<uint32_t> mIndices;
+	std::vector<uint32_t> mLodIndices; // LOD 1 and coarser, stored after mIndices in the arena
+	std::vector<MeshLod> mLods; // LOD 0 is mIndices, empty without a LOD chain
+	GeometryAllocation* mAllocation = nullptr;
+	bool mVertexBufferDirty = true; // all vertices changed
+	size_t mDirtyBegin = 0; // partially changed vertex range, see MarkVerticesDirty
+	size_t mDirtyEnd = 0;
+	bool mHidden = false;
+	bool mDynamic = false; // see GeometryArena::Stream
+	size_t mStreamBaseVertex = 0;
+	size_t mStreamGeneration = 0;
+	bool mCpuAccess = false; // keep mVertices and mIndices after the upload
+	bool mCpuResident = true; // false once released, see LoadCpuData
+	std::string mCachePath; // model cache the CPU data can be reloaded from, set by Model::Export
+	size_t mCacheOffset = 0;
+	AABB mAABB;
+	GLuint mMode = GL_TRIANGLES;
+
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+	Mesh() {}
+	~Mesh() {
+		if (mAllocation) GeometryArena<Vertex>::Get().Free(mAllocation);
+	}
+	void MarkVerticesDirty(size_t first, size_t count) {
+		if (mDirtyBegin == mDirtyEnd) {
+			mDirtyBegin = first;
+			mDirtyEnd = first + count;
+		} else {
+			mDirtyBegin = std::min(mDirtyBegin, first);
+			mDirtyEnd = std::max(mDirtyEnd, first + count);
+		}
+	}
+	void Bind() {
+		Upload();
+		if (mDynamic) {
+			GeometryArena<Vertex>::Get().BindStream();
+		} else {
+			GeometryArena<Vertex>::Get().Bind();
+		}
+	}
+	// Full detail above LodScreenSize (fraction of the viewport height), one
+	// level coarser for every halving of the projected size below it
+	static constexpr float LodScreenSize = 0.25f;
+	size_t GetLod(float screenSize) const {
+		size_t lod = 0;
+		for (float size = LodScreenSize; lod + 1 < mLods.size() && screenSize < size; size *= 0.5f) {
+			lod++;
+		}
+		return lod;
+	}
+	size_t GetIndexCount(size_t lod = 0) const {
+		if (lod < mLods.size()) return mLods[lod].mIndexCount;
+		return mAllocation ? mAllocation->mIndexCount : mIndices.size();
+	}
+	// Index range of a level in the arena index buffer
+	void GetIndexRange(size_t lod, size_t& first, size_t& count) const {
+		first = mAllocation->mFirstIndex;
+		count = mAllocation->mIndexCount;
+		if (lod < mLods.size()) {
+			first += mLods[lod].mFirstIndex;
+			count = mLods[lod].mIndexCount;
+		}
+	}
+	// Requires Bind
+	void Draw(size_t lod = 0) const {
+		assert(mAllocation);
+		size_t first, count;
+		GetIndexRange(lod, first, count);
+		const auto baseVertex = mDynamic ? mStreamBaseVertex : mAllocation->mBaseVertex;
+		glDrawElementsBaseVertex(mMode, (GLsizei)count, GL_UNSIGNED_INT, (GLvoid*)(first * sizeof(uint32_t)), (GLint)baseVertex);
+	}
+	MeshResidency GetResidency() const {
+		if (mDynamic) return MeshResidency::Dynamic;
+		return mCpuAccess ? MeshResidency::Keep : MeshResidency::Release;
+	}
+	// Uploads the mesh to its arena range, reallocating the range if the size
+	// changed. Meshes with the Release policy drop their CPU copy after an
+	// upload, data reloaded by LoadCpuData stays until the mesh changes again.
+	// Dynamic meshes stream all vertices on any change, and again when the
+	// stream has been orphaned since their last write.
+	void Upload() {
+		if (!mCpuResident) return;
+		auto& arena = GeometryArena<Vertex>::Get();
+		const auto vertexCount = mDynamic ? 0 : mVertices.size();
+		const auto indexCount = mIndices.size() + mLodIndices.size();
+		const bool dirty = !mAllocation || mVertexBufferDirty || mDirtyBegin != mDirtyEnd;
+		if (!mAllocation || mAllocation->mVertexCount != vertexCount || mAllocation->mIndexCount != indexCount) {
+			if (mAllocation) arena.Free(mAllocation);
+			mAllocation = arena.Allocate(vertexCount, indexCount);
+			arena.UploadIndices(*mAllocation, mIndices.data(), 0, mIndices.size());
+			arena.UploadIndices(*mAllocation, mLodIndices.data(), mIndices.size(), mLodIndices.size());
+			mVertexBufferDirty = true;
+		}
+		if (mDynamic) {
+			if (dirty || mVertexBufferDirty || !arena.IsStreamed(mStreamGeneration)) {
+				mStreamBaseVertex = arena.Stream(mVertices.data(), mVertices.size(), mStreamGeneration);
+			}
+		} else if (mVertexBufferDirty) {
+			arena.UploadVertices(*mAllocation, mVertices.data(), 0, mVertices.size());
+		} else if (mDirtyBegin < std::min(mDirtyEnd, mVertices.size())) {
+			const auto end = std::min(mDirtyEnd, mVertices.size());
+			arena.UploadVertices(*mAllocation, &mVertices[mDirtyBegin], mDirtyBegin, end - mDirtyBegin);
+		}
+		mVertexBufferDirty = false;
+		mDirtyBegin = mDirtyEnd = 0;
+		if (dirty && GetResidency() == MeshResidency::Release && !mCachePath.empty()) {
+			ReleaseCpuData();
+		}
+	}
+	void ReleaseCpuData() {
+		std::vector<Vertex>().swap(mVertices);
+		std::vector<uint32_t>().swap(mIndices);
+		std::vector<uint32_t>().swap(mLodIndices);
+		mCpuResident = false;
+	}
+	// Reads mVertices and mIndices back from the model cache after a release,
+	// returns false if they are not available
+	bool LoadCpuData() {
+		if (mCpuResident) return true;
+		std::ifstream stream(mCachePath, std::ios::binary);
+		if (!stream.is_open()) return false;
+		stream.seekg(mCacheOffset);
+		uint32_t indexCount = 0;
+		stream.read((char*)&indexCount, sizeof(indexCount));
+		mIndices.resize(indexCount);
+		stream.read((char*)mIndices.data(), indexCount * sizeof(uint32_t));
+		uint32_t vertexCount = 0;
+		stream.read((char*)&vertexCount, sizeof(vertexCount));
+		mVertices.resize(vertexCount);
+		stream.read((char*)mVertices.data(), vertexCount * sizeof(Vertex));
+		uint32_t lodIndexCount = 0;
+		stream.read((char*)&lodIndexCount, sizeof(lodIndexCount));
+		mLodIndices.resize(lodIndexCount);
+		stream.read((char*)mLodIndices.data(), lodIndexCount * sizeof(uint32_t));
+		if (!stream || (mAllocation && (mAllocation->mIndexCount != indexCount + lodIndexCount || mAllocation->mVertexCount != vertexCount))) {
+			std::cerr << "Warning: Could not reload mesh data from " << mCachePath << std::endl;
+			mVertices.clear();
+			mIndices.clear();
+			mLodIndices.clear();
+			return false;
+		}
+		mCpuResident = true;
+		return true;
+	}
+	size_t GetCpuBytes() const {
+		return mVertices.capacity() * sizeof(Vertex) + (mIndices.capacity() + mLodIndices.capacity()) * sizeof(uint32_t);
+	}
+	// Streamed vertices count once, the ring holds as many copies as fit
+	size_t GetGpuBytes() const {
+		if (!mAllocation) return 0;
+		const auto vertexCount = mDynamic ? mVertices.size() : mAllocation->mVertexCount;
+		return vertexCount * sizeof(Vertex) + mAllocation->mIndexCount * sizeof(uint32_t);
+	}
+	void UpdateAABB() {
+		if (!LoadCpuData()) return;
+		mAABB = AABB::FromVertices(mVertices);
+	}
+	// Builds up to maxLods levels, each with about half the triangles of the
+	// previous one. Stops early when simplification stalls.
+	void BuildLods(size_t maxLods = 4, size_t minTriangles = 64) {
+		mLods.clear();
+		mLodIndices.clear();
+		if (mMode != GL_TRIANGLES || mIndices.size() < minTriangles * 3) return;
+		mLods.push_back({ 0, (uint32_t)mIndices.size(), 0.0f });
+		auto indices = mIndices;
+		while (mLods.size() < maxLods) {
+			float error = 0.0f;
+			auto lod = SimplifyMesh(mVertices, indices, indices.size() / 6 * 3, error);
+			if (lod.empty() || lod.size() > indices.size() * 9 / 10) break;
+			mLods.push_back({ (uint32_t)(mIndices.size() + mLodIndices.size()), (uint32_t)lod.size(), mLods.back().mError + error });
+			mLodIndices.insert(mLodIndices.end(), lod.begin(), lod.end());
+			indices = std::move(lod);
+		}
+		if (mLods.size() == 1) mLods.clear();
+	}
+};
+typedef std::shared_ptr<Mesh> Mesh_;
+
+// Mesh memory by residency policy
+struct MeshMemoryStats {
+	size_t mMeshes[3] = {};
+	size_t mCpuBytes[3] = {};
+	size_t mGpuBytes[3] = {};
+
+	void Add(const Mesh& mesh) {
+		const auto policy = (size_t)mesh.GetResidency();
+		mMeshes[policy]++;
+		mCpuBytes[policy] += mesh.GetCpuBytes();
+		mGpuBytes[policy] += mesh.GetGpuBytes();
+	}
+};
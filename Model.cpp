@@ -1,274 +1,512 @@
-#include "Model.h"
-
-#include <assimp/cimport.h>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
-inline glm::vec3 make_vec3(const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); }
-inline glm::vec2 make_vec2(const aiVector2D& v) { return glm::vec2(v.x, v.y); }
-inline glm::quat make_quat(const aiQuaternion& q) { return glm::quat(q.w, q.x, q.y, q.z); }
-inline glm::mat4 make_mat4(const aiMatrix4x4& m) { return glm::transpose(glm::make_mat4(&m.a1)); }
-
-const aiNode* FindMeshRoot(const aiNode* node) {
-    if (node->mNumMeshes) {
-        return node;
-    }
-    for (size_t i = 0; i < node->mNumChildren; ++i) {
-        auto n = FindMeshRoot(node->mChildren[i]);
-        if (nullptr != n) return n;
-    }
-    return nullptr;
-}
-
-glm::mat4 GetNodeTransform(const aiNode* node) {
-    if (node->mParent) {
-        return GetNodeTransform(node->mParent) * make_mat4(node->mTransformation);
-    }
-    return make_mat4(node->mTransformation);
-}
-
-glm::mat4 FindGlobalInverseTransform(const aiScene* scene) {
-    const auto node = FindMeshRoot(scene->mRootNode);
-    auto transform = GetNodeTransform(node ? node : scene->mRootNode);
-    transform = glm::inverse(transform);
-    std::cout << "global inverse: " << glm::to_string(transform) << std::endl;
-    std::cout << "From node: " << (node ? node->mName.data : scene->mRootNode->mName.data) << std::endl;
-    return transform;
-}
-
-void LoadBoneWeights(Model* model, Mesh_ mesh, const aiMesh* nodeMesh) {
-    size_t numUnmappedWeights = 0;
-    for (unsigned int boneIndex = 0; boneIndex < nodeMesh->mNumBones; ++boneIndex) {
-        const auto bone = nodeMesh->mBones[boneIndex];
-        for (unsigned int weightIndex = 0; weightIndex < bone->mNumWeights; ++weightIndex) {
-            const auto boneWeight = bone->mWeights[weightIndex];
-            assert(boneWeight.mVertexId < mesh->mVertices.size());
-            const auto boneID = model->mAnimationSet->MapBone(bone->mName.data, make_mat4(bone->mOffsetMatrix));
-            if (!mesh->mVertices[boneWeight.mVertexId].AddBoneWeight(boneID, boneWeight.mWeight)) {
-                numUnmappedWeights++;
-            }
-        }
-    }
-    if (numUnmappedWeights > 0) {
-        std::cerr << "Mesh " << nodeMesh->mName.data << ": MAX_VERTEX_WEIGHTS (" << MAX_VERTEX_WEIGHTS << ") reached for " << numUnmappedWeights << " weights" << std::endl;
-    }
-}
-
-void LoadNode(Model* model, const aiScene* scene, const aiNode* node, const glm::mat4& parentTransform) {
-    glm::mat4 combinedTransform = parentTransform * make_mat4(node->mTransformation);
-
-    for (unsigned int meshIndex = 0; meshIndex < node->mNumMeshes; ++meshIndex) {
-        const auto nodeMesh = scene->mMeshes[node->mMeshes[meshIndex]]; // TODO: Shared meshes?
-        auto mesh = std::make_shared<Mesh>();
-        auto debugColor = RandomColor();
-        
-        mesh->mVertices.resize(nodeMesh->mNumVertices);
-        auto vertexPointer = mesh->mVertices.data();
-        for (unsigned int vertexIndex = 0; vertexIndex < nodeMesh->mNumVertices; ++vertexIndex) {
-            const auto& nodeVertex = nodeMesh->mVertices[vertexIndex];
-            vertexPointer->mPos = make_vec3(nodeVertex);
-            if (nodeMesh->HasNormals()) {
-                vertexPointer->mNormal = make_vec3(nodeMesh->mNormals[vertexIndex]);
-            }
-            vertexPointer->mColor = debugColor; // FIXME
-            vertexPointer++;
-        }
-
-        mesh->mIndices.resize(nodeMesh->mNumFaces * 3);
-        auto indexPointer = mesh->mIndices.data();
-        size_t invalidFaces = 0;
-        for (unsigned int faceIndex = 0; faceIndex < nodeMesh->mNumFaces; ++faceIndex) {
-            const auto nodeFace = &nodeMesh->mFaces[faceIndex];
-            //assert(nodeFace->mNumIndices == 3);
-            if (nodeFace->mNumIndices != 3) {
-                invalidFaces++;
-                continue;
-            }
-            *indexPointer++ = nodeFace->mIndices[0];
-            *indexPointer++ = nodeFace->mIndices[1];
-            *indexPointer++ = nodeFace->mIndices[2];
-        }
-
-        // FIXME
-        if (invalidFaces > 0) {
-            std::cerr << "Model has " << invalidFaces << " invalid (non triangular) faces" << std::endl;
-            while (invalidFaces > 0) {
-                mesh->mIndices.pop_back();
-                invalidFaces--;
-            }
-        }
-
-        // FIXME
-        if (model->mAnimationSet) {
-            LoadBoneWeights(model, mesh, nodeMesh);
-        }
-
-        model->mMeshes.push_back(std::make_shared<ModelMesh>(mesh, combinedTransform));
-    }
-
-    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
-        LoadNode(model, scene, node->mChildren[childIndex], combinedTransform);
-    }
-}
-
-AnimationNode_ LoadHierarchy(Model* model, const aiNode* node, AnimationNode_ parent = nullptr) {
-    AnimationNode_ animationNode = std::make_shared<AnimationNode>(node->mName.data, parent, make_mat4(node->mTransformation));
-
-    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
-        auto childNode = LoadHierarchy(model, node->mChildren[childIndex], animationNode);
-        animationNode->mChildren.push_back(childNode);
-    }
-
-    return animationNode;
-}
-
-void LoadAnimations(Model* model, const aiScene* scene) {
-    if (scene->mNumAnimations < 1) return;
-
-    // FIXME: Store elsewhere?
-    if (!model->mAnimationSet) {
-        model->mAnimationSet = std::make_shared<AnimationSet>();
-        model->mAnimationSet->mGlobalInverseTransform = FindGlobalInverseTransform(scene); // FIXME
-    }
-
-    for (unsigned int animationIndex = 0; animationIndex < scene->mNumAnimations; ++animationIndex) {
-        const auto aAnimation = scene->mAnimations[animationIndex];
-        if (!aAnimation->mNumChannels) continue; // TODO: Stuff
-        auto animation = std::make_shared<Animation>();
-        animation->mName = aAnimation->mName.data;
-        animation->mTicksPerSecond = (float)aAnimation->mTicksPerSecond;
-        animation->mDuration = (float)aAnimation->mDuration;
-        animation->mRootNode = LoadHierarchy(model, scene->mRootNode);
-
-        for (unsigned int channelIndex = 0; channelIndex < aAnimation->mNumChannels; ++channelIndex) {
-            const auto aChannel = aAnimation->mChannels[channelIndex];
-            auto track = std::make_shared<AnimationTrack>();
-            track->mName = aChannel->mNodeName.data;
-
-            for (unsigned int i = 0; i < aChannel->mNumPositionKeys; ++i) {
-                const auto aKey = aChannel->mPositionKeys[i];
-                track->mPositionKeys.push_back(VectorKey((float)aKey.mTime, make_vec3(aKey.mValue)));
-            }
-            for (unsigned int i = 0; i < aChannel->mNumScalingKeys; ++i) {
-                const auto aKey = aChannel->mScalingKeys[i];
-                track->mScalingKeys.push_back(VectorKey((float)aKey.mTime, make_vec3(aKey.mValue)));
-            }
-            for (unsigned int i = 0; i < aChannel->mNumRotationKeys; ++i) {
-                const auto aKey = aChannel->mRotationKeys[i];
-                track->mRotationKeys.push_back(QuatKey((float)aKey.mTime, make_quat(aKey.mValue)));
-            }
-
-            // TODO Pre/post state
-            animation->mAnimationTracks.push_back(track);
-        }
-
-        model->mAnimationSet->mAnimations.push_back(animation);
-    }
-}
-
-std::string GetMetaDataString(const aiMetadataEntry& entry) {
-    switch (entry.mType) {
-    case AI_BOOL: return "(BOOL) " + std::to_string(*(bool*)entry.mData);
-    case AI_INT32: return "(INT32) " + std::to_string(*(int32_t*)entry.mData);
-    case AI_UINT64: return "(UINT64) " + std::to_string(*(uint64_t*)entry.mData);
-    case AI_FLOAT: return "(FLOAT) " + std::to_string(*(float*)entry.mData);
-    case AI_DOUBLE: return "(DOUBLE) " + std::to_string(*(double*)entry.mData);
-    case AI_AISTRING: {
-        const auto val = (aiString*)entry.mData;
-        return "(AISTRING) " + std::string(val->data);
-    }
-    case AI_AIVECTOR3D: {
-        const auto val = make_vec3(*(aiVector3D*)entry.mData);
-        return "(AIVECTOR3D) " + glm::to_string(val);
-    }
-    default:
-        return "(UNKNOWN)";
-    }
-}
-
-void FixSceneUpAxis(const aiScene* scene) {
-    int32_t upAxis, upAxisSign;
-    int32_t frontAxis, frontAxisSign;
-    int32_t coordAxis, coordAxisSign;
-    scene->mMetaData->Get("UpAxis", upAxis);
-    scene->mMetaData->Get("UpAxisSign", upAxisSign);
-    scene->mMetaData->Get("FrontAxis", frontAxis);
-    scene->mMetaData->Get("FrontAxisSign", frontAxisSign);
-    scene->mMetaData->Get("CoordAxis", coordAxis);
-    scene->mMetaData->Get("CoordAxisSign", coordAxisSign);
-    aiVector3D upVec = upAxis == 0 ? aiVector3D(upAxisSign, 0, 0) : upAxis == 1 ? aiVector3D(0, upAxisSign, 0) : aiVector3D(0, 0, upAxisSign);
-    aiVector3D forwardVec = frontAxis == 0 ? aiVector3D(frontAxisSign, 0, 0) : frontAxis == 1 ? aiVector3D(0, frontAxisSign, 0) : aiVector3D(0, 0, frontAxisSign);
-    aiVector3D rightVec = coordAxis == 0 ? aiVector3D(coordAxisSign, 0, 0) : coordAxis == 1 ? aiVector3D(0, coordAxisSign, 0) : aiVector3D(0, 0, coordAxisSign);
-    aiMatrix4x4 mat(
-        rightVec.x, rightVec.y, rightVec.z, 0.0f,
-        upVec.x, upVec.y, upVec.z, 0.0f,
-        forwardVec.x, forwardVec.y, forwardVec.z, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f
-    );
-    scene->mRootNode->mTransformation = mat;
-}
-
-const aiScene* LoadScene(const std::string& fileName, const rapidjson::Value& options) {
-    // FIXME: config
-    auto props = aiCreatePropertyStore();
-    //aiSetImportPropertyFloat(props, AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, options.mScale);
-    auto target = /*aiProcess_GlobalScale |*/ aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_LimitBoneWeights;
-    auto scene = aiImportFileExWithProperties(fileName.c_str(), target, nullptr, props);
-    aiReleasePropertyStore(props);
-    
-    if (nullptr == scene) {
-        throw new std::runtime_error(aiGetErrorString());
-    }
-    if (scene->mMetaData) {
-        for (unsigned int i = 0; i < scene->mMetaData->mNumProperties; ++i) {
-            std::cout << scene->mMetaData->mKeys[i].data << "=" << GetMetaDataString(scene->mMetaData->mValues[i]) << std::endl;
-        }
-    }
-    auto scale = options.HasMember("scale") ? options["scale"].GetFloat() : 1.0f;
-    scene->mRootNode->mTransformation.Scaling(aiVector3D(scale, scale, scale), scene->mRootNode->mTransformation); // FIXME
-    return scene;
-}
-
-void Model::Load(const std::string& fileName) {
-    Load(fileName, {});
-}
-
-void Model::Load(const std::string& fileName, const rapidjson::Value& options) {
-    const auto scene = LoadScene(fileName, options);
-    mName = fileName;
-    mAnimationSet.reset();
-    LoadAnimations(this, scene);
-    LoadNode(this, scene, scene->mRootNode, glm::identity<glm::mat4>());
-    aiReleaseImport(scene);
-    UpdateAABB();
-}
-
-//void Model::LoadAnimation(const std::string& fileName, const ModelOptions& options, bool append) {
-//    const auto scene = LoadScene(fileName, options);
-//    if (!append) {
-//        mAnimationSet.reset();
-//    }
-//    LoadAnimations(this, scene);
-//}
-
-void Model::Import(const std::string& fileName) {
-    std::cerr << "Model::Import" << std::endl;
-}
-
-void Model::Export(const std::string& fileName) {
-    std::cerr << "Model::Export" << std::endl;
-
-    auto fp = fopen((fileName + ".test").c_str(), "wb");
-    uint32_t meshCount = mMeshes.size();
-    fwrite(&meshCount, sizeof(meshCount), 1, fp);
-    for (auto& mesh : mMeshes) {
-        fwrite(&mesh->mTransform[0], sizeof(glm::mat4), 1, fp);
-        uint32_t ic = mesh->mMesh->mIndices.size();
-        fwrite(&ic, sizeof(ic), 1, fp);
-        fwrite(mesh->mMesh->mIndices.data(), sizeof(uint32_t) * ic, 1, fp);
-        uint32_t vc = mesh->mMesh->mVertices.size();
-        fwrite(&vc, sizeof(vc), 1, fp);
-        fwrite(mesh->mMesh->mVertices.data(), sizeof(Vertex) * vc, 1, fp);
-    }
-    fclose(fp);
-}
+#include "Model.h"
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+inline glm::vec3 make_vec3(const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); }
+inline glm::vec2 make_vec2(const aiVector2D& v) { return glm::vec2(v.x, v.y); }
+inline glm::quat make_quat(const aiQuaternion& q) { return glm::quat(q.w, q.x, q.y, q.z); }
+inline glm::mat4 make_mat4(const aiMatrix4x4& m) { return glm::transpose(glm::make_mat4(&m.a1)); }
+
+const aiNode* FindMeshRoot(const aiNode* node) {
+    if (node->mNumMeshes) {
+        return node;
+    }
+    for (size_t i = 0; i < node->mNumChildren; ++i) {
+        auto n = FindMeshRoot(node->mChildren[i]);
+        if (nullptr != n) return n;
+    }
+    return nullptr;
+}
+
+glm::mat4 GetNodeTransform(const aiNode* node) {
+    if (node->mParent) {
+        return GetNodeTransform(node->mParent) * make_mat4(node->mTransformation);
+    }
+    return make_mat4(node->mTransformation);
+}
+
+glm::mat4 FindGlobalInverseTransform(const aiScene* scene) {
+    const auto node = FindMeshRoot(scene->mRootNode);
+    auto transform = GetNodeTransform(node ? node : scene->mRootNode);
+    transform = glm::inverse(transform);
+    std::cout << "global inverse: " << glm::to_string(transform) << std::endl;
+    std::cout << "From node: " << (node ? node->mName.data : scene->mRootNode->mName.data) << std::endl;
+    return transform;
+}
+
+void LoadBoneWeights(Model* model, Mesh_ mesh, const aiMesh* nodeMesh) {
+    size_t numUnmappedWeights = 0;
+    for (unsigned int boneIndex = 0; boneIndex < nodeMesh->mNumBones; ++boneIndex) {
+        const auto bone = nodeMesh->mBones[boneIndex];
+        for (unsigned int weightIndex = 0; weightIndex < bone->mNumWeights; ++weightIndex) {
+            const auto boneWeight = bone->mWeights[weightIndex];
+            assert(boneWeight.mVertexId < mesh->mVertices.size());
+            const auto boneID = model->mAnimationSet->MapBone(bone->mName.data, make_mat4(bone->mOffsetMatrix));
+            if (!mesh->mVertices[boneWeight.mVertexId].AddBoneWeight(boneID, boneWeight.mWeight)) {
+                numUnmappedWeights++;
+            }
+        }
+    }
+    if (numUnmappedWeights > 0) {
+        std::cerr << "Mesh " << nodeMesh->mName.data << ": MAX_VERTEX_WEIGHTS (" << MAX_VERTEX_WEIGHTS << ") reached for " << numUnmappedWeights << " weights" << std::endl;
+    }
+}
+
+void LoadNode(Model* model, const aiScene* scene, const aiNode* node, const glm::mat4& parentTransform) {
+    glm::mat4 combinedTransform = parentTransform * make_mat4(node->mTransformation);
+
+    for (unsigned int meshIndex = 0; meshIndex < node->mNumMeshes; ++meshIndex) {
+        const auto nodeMesh = scene->mMeshes[node->mMeshes[meshIndex]]; // TODO: Shared meshes?
+        auto mesh = std::make_shared<Mesh>();
+        auto debugColor = RandomColor();
+        
+        mesh->mVertices.resize(nodeMesh->mNumVertices);
+        auto vertexPointer = mesh->mVertices.data();
+        for (unsigned int vertexIndex = 0; vertexIndex < nodeMesh->mNumVertices; ++vertexIndex) {
+            const auto& nodeVertex = nodeMesh->mVertices[vertexIndex];
+            vertexPointer->mPos = make_vec3(nodeVertex);
+            if (nodeMesh->HasNormals()) {
+                vertexPointer->mNormal = make_vec3(nodeMesh->mNormals[vertexIndex]);
+            }
+            vertexPointer->mColor = debugColor; // FIXME
+            vertexPointer++;
+        }
+
+        mesh->mIndices.resize(nodeMesh->mNumFaces * 3);
+        auto indexPointer = mesh->mIndices.data();
+        size_t invalidFaces = 0;
+        for (unsigned int faceIndex = 0; faceIndex < nodeMesh->mNumFaces; ++faceIndex) {
+            const auto nodeFace = &nodeMesh->mFaces[faceIndex];
+            //assert(nodeFace->mNumIndices == 3);
+            if (nodeFace->mNumIndices != 3) {
+                invalidFaces++;
+                continue;
+            }
+            *indexPointer++ = nodeFace->mIndices[0];
+            *indexPointer++ = nodeFace->mIndices[1];
+            *indexPointer++ = nodeFace->mIndices[2];
+        }
+
+        // FIXME
+        if (invalidFaces > 0) {
+            std::cerr << "Model has " << invalidFaces << " invalid (non triangular) faces" << std::endl;
+            while (invalidFaces > 0) {
+                mesh->mIndices.pop_back();
+                invalidFaces--;
+            }
+        }
+
+        // FIXME
+        if (model->mAnimationSet) {
+            LoadBoneWeights(model, mesh, nodeMesh);
+        }
+
+        mesh->UpdateAABB();
+        mesh->BuildLods();
+
+        model->mMeshes.push_back(std::make_shared<ModelMesh>(mesh, combinedTransform));
+    }
+
+    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
+        LoadNode(model, scene, node->mChildren[childIndex], combinedTransform);
+    }
+}
+
+AnimationNode_ LoadHierarchy(Model* model, const aiNode* node, AnimationNode_ parent = nullptr) {
+    AnimationNode_ animationNode = std::make_shared<AnimationNode>(node->mName.data, parent, make_mat4(node->mTransformation));
+
+    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
+        auto childNode = LoadHierarchy(model, node->mChildren[childIndex], animationNode);
+        animationNode->mChildren.push_back(childNode);
+    }
+
+    return animationNode;
+}
+
+void LoadAnimations(Model* model, const aiScene* scene) {
+    if (scene->mNumAnimations < 1) return;
+
+    // FIXME: Store elsewhere?
+    if (!model->mAnimationSet) {
+        model->mAnimationSet = std::make_shared<AnimationSet>();
+        model->mAnimationSet->mGlobalInverseTransform = FindGlobalInverseTransform(scene); // FIXME
+    }
+
+    for (unsigned int animationIndex = 0; animationIndex < scene->mNumAnimations; ++animationIndex) {
+        const auto aAnimation = scene->mAnimations[animationIndex];
+        if (!aAnimation->mNumChannels) continue; // TODO: Stuff
+        auto animation = std::make_shared<Animation>();
+        animation->mName = aAnimation->mName.data;
+        animation->mTicksPerSecond = (float)aAnimation->mTicksPerSecond;
+        animation->mDuration = (float)aAnimation->mDuration;
+        animation->mRootNode = LoadHierarchy(model, scene->mRootNode);
+
+        for (unsigned int channelIndex = 0; channelIndex < aAnimation->mNumChannels; ++channelIndex) {
+            const auto aChannel = aAnimation->mChannels[channelIndex];
+            auto track = std::make_shared<AnimationTrack>();
+            track->mName = aChannel->mNodeName.data;
+
+            for (unsigned int i = 0; i < aChannel->mNumPositionKeys; ++i) {
+                const auto aKey = aChannel->mPositionKeys[i];
+                track->mPositionKeys.push_back(VectorKey((float)aKey.mTime, make_vec3(aKey.mValue)));
+            }
+            for (unsigned int i = 0; i < aChannel->mNumScalingKeys; ++i) {
+                const auto aKey = aChannel->mScalingKeys[i];
+                track->mScalingKeys.push_back(VectorKey((float)aKey.mTime, make_vec3(aKey.mValue)));
+            }
+            for (unsigned int i = 0; i < aChannel->mNumRotationKeys; ++i) {
+                const auto aKey = aChannel->mRotationKeys[i];
+                track->mRotationKeys.push_back(QuatKey((float)aKey.mTime, make_quat(aKey.mValue)));
+            }
+
+            // TODO Pre/post state
+            animation->mAnimationTracks.push_back(track);
+        }
+
+        model->mAnimationSet->mAnimations.push_back(animation);
+    }
+}
+
+std::string GetMetaDataString(const aiMetadataEntry& entry) {
+    switch (entry.mType) {
+    case AI_BOOL: return "(BOOL) " + std::to_string(*(bool*)entry.mData);
+    case AI_INT32: return "(INT32) " + std::to_string(*(int32_t*)entry.mData);
+    case AI_UINT64: return "(UINT64) " + std::to_string(*(uint64_t*)entry.mData);
+    case AI_FLOAT: return "(FLOAT) " + std::to_string(*(float*)entry.mData);
+    case AI_DOUBLE: return "(DOUBLE) " + std::to_string(*(double*)entry.mData);
+    case AI_AISTRING: {
+        const auto val = (aiString*)entry.mData;
+        return "(AISTRING) " + std::string(val->data);
+    }
+    case AI_AIVECTOR3D: {
+        const auto val = make_vec3(*(aiVector3D*)entry.mData);
+        return "(AIVECTOR3D) " + glm::to_string(val);
+    }
+    default:
+        return "(UNKNOWN)";
+    }
+}
+
+void FixSceneUpAxis(const aiScene* scene) {
+    int32_t upAxis, upAxisSign;
+    int32_t frontAxis, frontAxisSign;
+    int32_t coordAxis, coordAxisSign;
+    scene->mMetaData->Get("UpAxis", upAxis);
+    scene->mMetaData->Get("UpAxisSign", upAxisSign);
+    scene->mMetaData->Get("FrontAxis", frontAxis);
+    scene->mMetaData->Get("FrontAxisSign", frontAxisSign);
+    scene->mMetaData->Get("CoordAxis", coordAxis);
+    scene->mMetaData->Get("CoordAxisSign", coordAxisSign);
+    aiVector3D upVec = upAxis == 0 ? aiVector3D(upAxisSign, 0, 0) : upAxis == 1 ? aiVector3D(0, upAxisSign, 0) : aiVector3D(0, 0, upAxisSign);
+    aiVector3D forwardVec = frontAxis == 0 ? aiVector3D(frontAxisSign, 0, 0) : frontAxis == 1 ? aiVector3D(0, frontAxisSign, 0) : aiVector3D(0, 0, frontAxisSign);
+    aiVector3D rightVec = coordAxis == 0 ? aiVector3D(coordAxisSign, 0, 0) : coordAxis == 1 ? aiVector3D(0, coordAxisSign, 0) : aiVector3D(0, 0, coordAxisSign);
+    aiMatrix4x4 mat(
+        rightVec.x, rightVec.y, rightVec.z, 0.0f,
+        upVec.x, upVec.y, upVec.z, 0.0f,
+        forwardVec.x, forwardVec.y, forwardVec.z, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    );
+    scene->mRootNode->mTransformation = mat;
+}
+
+const aiScene* LoadScene(const std::string& fileName, const rapidjson::Value& options) {
+    // FIXME: config
+    auto props = aiCreatePropertyStore();
+    //aiSetImportPropertyFloat(props, AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, options.mScale);
+    auto target = /*aiProcess_GlobalScale |*/ aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_LimitBoneWeights;
+    auto scene = aiImportFileExWithProperties(fileName.c_str(), target, nullptr, props);
+    aiReleasePropertyStore(props);
+    
+    if (nullptr == scene) {
+        throw std::runtime_error(aiGetErrorString());
+    }
+    if (scene->mMetaData) {
+        for (unsigned int i = 0; i < scene->mMetaData->mNumProperties; ++i) {
+            std::cout << scene->mMetaData->mKeys[i].data << "=" << GetMetaDataString(scene->mMetaData->mValues[i]) << std::endl;
+        }
+    }
+    auto scale = options.HasMember("scale") ? options["scale"].GetFloat() : 1.0f;
+    scene->mRootNode->mTransformation.Scaling(aiVector3D(scale, scale, scale), scene->mRootNode->mTransformation); // FIXME
+    return scene;
+}
+
+void Model::Load(const std::string& fileName) {
+    Load(fileName, {});
+}
+
+void Model::Load(const std::string& fileName, const rapidjson::Value& options) {
+    const auto scene = LoadScene(fileName, options);
+    mName = fileName;
+    mAnimationSet.reset();
+    LoadAnimations(this, scene);
+    LoadNode(this, scene, scene->mRootNode, glm::identity<glm::mat4>());
+    aiReleaseImport(scene);
+    // Animated meshes are skinned on the CPU for bounds and picking every frame
+    const bool cpuAccess = options.IsObject() && options.HasMember("cpuAccess") && options["cpuAccess"].GetBool();
+    if (cpuAccess || HasAnimations()) {
+        for (auto& mesh : mMeshes) {
+            mesh->mMesh->mCpuAccess = true;
+        }
+    }
+    UpdateAABB();
+}
+
+//void Model::LoadAnimation(const std::string& fileName, const ModelOptions& options, bool append) {
+//    const auto scene = LoadScene(fileName, options);
+//    if (!append) {
+//        mAnimationSet.reset();
+//    }
+//    LoadAnimations(this, scene);
+//}
+
+// Cache layout: header (versions and the AssetStamp), name, then per mesh its
+// transform, the CPU access flag and the data Mesh::LoadCpuData reads back
+// from mCacheOffset (indices, vertices, LOD indices) followed by the LOD
+// ranges. The animation set follows the meshes: bones in index order, then per
+// animation its node hierarchy (depth first) and tracks. Loading from the
+// cache skips assimp and the LOD generation.
+static constexpr uint32_t ModelCacheMagic = 0x4d444c43; // "MDLC"
+static constexpr uint32_t ModelCacheVersion = 3;
+
+bool Model::Import(const std::string& fileName, const AssetStamp& stamp) {
+    auto fp = fopen(fileName.c_str(), "rb");
+    if (!fp) return false;
+    bool ok = true;
+    auto read = [fp, &ok](void* data, size_t size) {
+        if (ok && size && fread(data, size, 1, fp) != 1) ok = false;
+    };
+    uint32_t magic = 0, version = 0, vertexSize = 0, simplifyVersion = 0;
+    read(&magic, sizeof(magic));
+    read(&version, sizeof(version));
+    read(&vertexSize, sizeof(vertexSize));
+    read(&simplifyVersion, sizeof(simplifyVersion));
+    ok = ok && magic == ModelCacheMagic && version == ModelCacheVersion && vertexSize == sizeof(Vertex) && simplifyVersion == SimplifyVersion;
+    AssetStamp cached;
+    read(&cached.mSourceSize, sizeof(cached.mSourceSize));
+    read(&cached.mSourceTime, sizeof(cached.mSourceTime));
+    read(&cached.mOptionsHash, sizeof(cached.mOptionsHash));
+    ok = ok && cached == stamp;
+
+    uint32_t nameLength = 0;
+    read(&nameLength, sizeof(nameLength));
+    if (ok) mName.resize(nameLength);
+    read(&mName[0], nameLength);
+    uint32_t meshCount = 0;
+    read(&meshCount, sizeof(meshCount));
+    for (uint32_t meshIndex = 0; ok && meshIndex < meshCount; ++meshIndex) {
+        glm::mat4 transform;
+        read(&transform[0], sizeof(glm::mat4));
+        uint8_t cpuAccess = 0;
+        read(&cpuAccess, sizeof(cpuAccess));
+        auto mesh = std::make_shared<Mesh>();
+        mesh->mCpuAccess = cpuAccess != 0;
+        mesh->mCachePath = fileName;
+        mesh->mCacheOffset = ftell(fp);
+        uint32_t ic = 0;
+        read(&ic, sizeof(ic));
+        if (ok) mesh->mIndices.resize(ic);
+        read(mesh->mIndices.data(), sizeof(uint32_t) * ic);
+        uint32_t vc = 0;
+        read(&vc, sizeof(vc));
+        if (ok) mesh->mVertices.resize(vc);
+        read(mesh->mVertices.data(), sizeof(Vertex) * vc);
+        uint32_t lic = 0;
+        read(&lic, sizeof(lic));
+        if (ok) mesh->mLodIndices.resize(lic);
+        read(mesh->mLodIndices.data(), sizeof(uint32_t) * lic);
+        uint32_t lc = 0;
+        read(&lc, sizeof(lc));
+        if (ok) mesh->mLods.resize(lc);
+        read(mesh->mLods.data(), sizeof(MeshLod) * lc);
+        mesh->UpdateAABB();
+        mMeshes.push_back(std::make_shared<ModelMesh>(mesh, transform));
+    }
+
+    uint8_t hasAnimationSet = 0;
+    read(&hasAnimationSet, sizeof(hasAnimationSet));
+    if (ok && hasAnimationSet) {
+        auto readString = [&read, &ok]() {
+            uint32_t length = 0;
+            read(&length, sizeof(length));
+            std::string str;
+            if (ok) str.resize(length);
+            read(&str[0], length);
+            return str;
+        };
+        auto readKeys = [&read, &ok](auto& keys) {
+            uint32_t count = 0;
+            read(&count, sizeof(count));
+            for (uint32_t i = 0; ok && i < count; ++i) {
+                typename std::decay_t<decltype(keys)>::value_type key(0.0f, {});
+                read(&key.mTime, sizeof(key.mTime));
+                read(&key.mValue, sizeof(key.mValue));
+                keys.push_back(key);
+            }
+        };
+        auto readNode = [&read, &ok, &readString](AnimationNode_ parent, auto readNode) -> AnimationNode_ {
+            const auto name = readString();
+            glm::mat4 transform;
+            read(&transform[0], sizeof(glm::mat4));
+            auto node = std::make_shared<AnimationNode>(name, parent, transform);
+            uint32_t childCount = 0;
+            read(&childCount, sizeof(childCount));
+            for (uint32_t i = 0; ok && i < childCount; ++i) {
+                node->mChildren.push_back(readNode(node, readNode));
+            }
+            return node;
+        };
+
+        mAnimationSet = std::make_shared<AnimationSet>();
+        read(&mAnimationSet->mGlobalInverseTransform[0], sizeof(glm::mat4));
+        uint32_t boneCount = 0;
+        read(&boneCount, sizeof(boneCount));
+        for (uint32_t boneIndex = 0; ok && boneIndex < boneCount; ++boneIndex) {
+            const auto name = readString();
+            glm::mat4 offset;
+            read(&offset[0], sizeof(glm::mat4));
+            ok = ok && mAnimationSet->MapBone(name, offset) == boneIndex;
+        }
+        uint32_t animationCount = 0;
+        read(&animationCount, sizeof(animationCount));
+        for (uint32_t animationIndex = 0; ok && animationIndex < animationCount; ++animationIndex) {
+            auto animation = std::make_shared<Animation>();
+            animation->mName = readString();
+            read(&animation->mTicksPerSecond, sizeof(animation->mTicksPerSecond));
+            read(&animation->mDuration, sizeof(animation->mDuration));
+            animation->mRootNode = readNode(nullptr, readNode);
+            uint32_t trackCount = 0;
+            read(&trackCount, sizeof(trackCount));
+            for (uint32_t trackIndex = 0; ok && trackIndex < trackCount; ++trackIndex) {
+                auto track = std::make_shared<AnimationTrack>();
+                track->mName = readString();
+                readKeys(track->mPositionKeys);
+                readKeys(track->mScalingKeys);
+                readKeys(track->mRotationKeys);
+                animation->mAnimationTracks.push_back(track);
+            }
+            mAnimationSet->mAnimations.push_back(animation);
+        }
+    }
+    fclose(fp);
+
+    if (!ok) {
+        std::cerr << "Warning: Model cache " << fileName << " is stale or unreadable, loading from source" << std::endl;
+        mMeshes.clear();
+        mName.clear();
+        mAnimationSet.reset();
+        return false;
+    }
+    UpdateAABB();
+    return true;
+}
+
+void Model::Export(const std::string& fileName, const AssetStamp& stamp) {
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(fileName).parent_path(), error);
+    auto fp = fopen(fileName.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Warning: Could not write model cache: " << fileName << std::endl;
+        return;
+    }
+    bool ok = true;
+    auto write = [fp, &ok](const void* data, size_t size) {
+        if (ok && size && fwrite(data, size, 1, fp) != 1) ok = false;
+    };
+    const uint32_t header[] = { ModelCacheMagic, ModelCacheVersion, (uint32_t)sizeof(Vertex), SimplifyVersion };
+    write(header, sizeof(header));
+    write(&stamp.mSourceSize, sizeof(stamp.mSourceSize));
+    write(&stamp.mSourceTime, sizeof(stamp.mSourceTime));
+    write(&stamp.mOptionsHash, sizeof(stamp.mOptionsHash));
+    uint32_t nameLength = mName.size();
+    write(&nameLength, sizeof(nameLength));
+    write(mName.data(), nameLength);
+    uint32_t meshCount = mMeshes.size();
+    write(&meshCount, sizeof(meshCount));
+    for (auto& mesh : mMeshes) {
+        write(&mesh->mTransform[0], sizeof(glm::mat4));
+        uint8_t cpuAccess = mesh->mMesh->mCpuAccess;
+        write(&cpuAccess, sizeof(cpuAccess));
+        // Mesh::LoadCpuData reads the mesh back from here once its CPU copy is released
+        mesh->mMesh->mCachePath = fileName;
+        mesh->mMesh->mCacheOffset = ftell(fp);
+        uint32_t ic = mesh->mMesh->mIndices.size();
+        write(&ic, sizeof(ic));
+        write(mesh->mMesh->mIndices.data(), sizeof(uint32_t) * ic);
+        uint32_t vc = mesh->mMesh->mVertices.size();
+        write(&vc, sizeof(vc));
+        write(mesh->mMesh->mVertices.data(), sizeof(Vertex) * vc);
+        uint32_t lic = mesh->mMesh->mLodIndices.size();
+        write(&lic, sizeof(lic));
+        write(mesh->mMesh->mLodIndices.data(), sizeof(uint32_t) * lic);
+        uint32_t lc = mesh->mMesh->mLods.size();
+        write(&lc, sizeof(lc));
+        write(mesh->mMesh->mLods.data(), sizeof(MeshLod) * lc);
+    }
+
+    uint8_t hasAnimationSet = mAnimationSet != nullptr;
+    write(&hasAnimationSet, sizeof(hasAnimationSet));
+    if (mAnimationSet) {
+        auto writeString = [&write](const std::string& str) {
+            uint32_t length = str.size();
+            write(&length, sizeof(length));
+            write(str.data(), length);
+        };
+        auto writeKeys = [&write](const auto& keys) {
+            uint32_t count = keys.size();
+            write(&count, sizeof(count));
+            for (const auto& key : keys) {
+                write(&key.mTime, sizeof(key.mTime));
+                write(&key.mValue, sizeof(key.mValue));
+            }
+        };
+        auto writeNode = [&write, &writeString](const AnimationNode_& node, auto writeNode) -> void {
+            writeString(node->mName);
+            write(&node->mTransform[0], sizeof(glm::mat4));
+            uint32_t childCount = node->mChildren.size();
+            write(&childCount, sizeof(childCount));
+            for (const auto& child : node->mChildren) {
+                writeNode(child, writeNode);
+            }
+        };
+
+        write(&mAnimationSet->mGlobalInverseTransform[0], sizeof(glm::mat4));
+        std::vector<std::string> boneNames(mAnimationSet->mBoneOffsets.size());
+        for (const auto& bone : mAnimationSet->mBoneMappings) {
+            boneNames[bone.second] = bone.first;
+        }
+        uint32_t boneCount = boneNames.size();
+        write(&boneCount, sizeof(boneCount));
+        for (uint32_t boneIndex = 0; boneIndex < boneCount; ++boneIndex) {
+            writeString(boneNames[boneIndex]);
+            write(&mAnimationSet->mBoneOffsets[boneIndex][0], sizeof(glm::mat4));
+        }
+        uint32_t animationCount = mAnimationSet->mAnimations.size();
+        write(&animationCount, sizeof(animationCount));
+        for (const auto& animation : mAnimationSet->mAnimations) {
+            writeString(animation->mName);
+            write(&animation->mTicksPerSecond, sizeof(animation->mTicksPerSecond));
+            write(&animation->mDuration, sizeof(animation->mDuration));
+            writeNode(animation->mRootNode, writeNode);
+            uint32_t trackCount = animation->mAnimationTracks.size();
+            write(&trackCount, sizeof(trackCount));
+            for (const auto& track : animation->mAnimationTracks) {
+                writeString(track->mName);
+                writeKeys(track->mPositionKeys);
+                writeKeys(track->mScalingKeys);
+                writeKeys(track->mRotationKeys);
+            }
+        }
+    }
+    ok = fclose(fp) == 0 && ok;
+
+    // A partial file must neither be imported nor used to reload released meshes
+    if (!ok) {
+        std::cerr << "Warning: Could not write model cache: " << fileName << std::endl;
+        std::filesystem::remove(fileName, error);
+        for (auto& mesh : mMeshes) {
+            mesh->mMesh->mCachePath.clear();
+        }
+    }
+}
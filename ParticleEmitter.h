@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Main.h"
+#include "AABB.h"
+#include "UniformBuffer.h"
+
+// Per particle data, uploaded once. Particles are simulated statelessly in
+// particles.vert.glsl: the age follows from uTime and the spawn offset and the
+// position is the ballistic path of the start velocity, so the CPU does no
+// per particle work after Build.
+struct Particle {
+	glm::vec3 mVelocity; // emitter space
+	float mSpawnOffset; // [0, lifetime)
+};
+
+struct ParticleEmitter {
+	// std140 layout of the Material block in particles.vert.glsl
+	struct MaterialUniforms {
+		float mLifetime;
+		float mSize;
+		float mPad0[2];
+		glm::vec3 mGravity;
+		float mPad1;
+		glm::vec3 mColorStart;
+		float mPad2;
+		glm::vec3 mColorEnd;
+		float mPad3;
+	};
+
+	uint32_t mCount = 1000;
+	float mLifetime = 2.0f;
+	float mSpeed = 5.0f;
+	float mSpread = glm::radians(30.0f); // cone half angle around mDirection
+	glm::vec3 mDirection = { 0,1,0 };
+	glm::vec3 mGravity = { 0,-10,0 }; // world space
+	float mSize = 0.1f;
+	glm::vec3 mColorStart = { 1,1,1 };
+	glm::vec3 mColorEnd = { 1,0,0 };
+	GLuint mBuffer = 0;
+	GLuint mVertexArray = 0;
+	std::unique_ptr<UniformBuffer> mMaterial;
+
+	ParticleEmitter() {}
+	ParticleEmitter(const ParticleEmitter&) = delete;
+	ParticleEmitter& operator=(const ParticleEmitter&) = delete;
+	~ParticleEmitter() {
+		if (mBuffer) glDeleteBuffers(1, &mBuffer);
+		if (mVertexArray) glDeleteVertexArrays(1, &mVertexArray);
+	}
+
+	void Build() {
+		std::vector<Particle> particles(mCount);
+		std::mt19937 random(mCount);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		const auto direction = glm::normalize(mDirection);
+		const auto tangent = glm::normalize(glm::cross(direction, std::abs(direction.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+		const auto bitangent = glm::cross(direction, tangent);
+		const float minCos = std::cos(mSpread);
+		for (auto& particle : particles) {
+			const float cosTheta = glm::mix(minCos, 1.0f, uniform(random));
+			const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+			const float phi = uniform(random) * glm::two_pi<float>();
+			const auto dir = direction * cosTheta + (tangent * std::cos(phi) + bitangent * std::sin(phi)) * sinTheta;
+			particle.mVelocity = dir * mSpeed * glm::mix(0.5f, 1.0f, uniform(random));
+			particle.mSpawnOffset = uniform(random) * mLifetime;
+		}
+
+		if (!mBuffer) glGenBuffers(1, &mBuffer);
+		if (!mVertexArray) glGenVertexArrays(1, &mVertexArray);
+		glBindVertexArray(mVertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+		glBufferData(GL_ARRAY_BUFFER, particles.size() * sizeof(Particle), particles.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (GLvoid*)offsetof(Particle, mVelocity));
+		glVertexAttribDivisor(0, 1);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (GLvoid*)offsetof(Particle, mSpawnOffset));
+		glVertexAttribDivisor(1, 1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		MaterialUniforms material = {};
+		material.mLifetime = mLifetime;
+		material.mSize = mSize;
+		material.mGravity = mGravity;
+		material.mColorStart = mColorStart;
+		material.mColorEnd = mColorEnd;
+		mMaterial = std::make_unique<UniformBuffer>(sizeof(material), &material);
+	}
+
+	// Conservative emitter space bounds of every particle path
+	AABB GetBounds() const {
+		const float reach = mSpeed * mLifetime + mSize;
+		const auto fall = glm::abs(mGravity) * 0.5f * mLifetime * mLifetime;
+		return AABB({ 0,0,0 }, glm::vec3(reach) + fall);
+	}
+
+	// Expects the particles program to be bound with the Frame and Draw blocks
+	void Draw() const {
+		mMaterial->Bind(MaterialBinding);
+		glBindVertexArray(mVertexArray);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, mCount);
+	}
+};
+typedef std::shared_ptr<ParticleEmitter> ParticleEmitter_;
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Main.h"
+
+// Object pool with stable addresses. Storage is allocated in chunks that are
+// kept until the pool is destroyed, destroyed objects put their slot on a free
+// list that is reused before a new chunk is allocated.
+template<typename T, size_t ChunkSize = 256>
+struct Pool {
+	union Slot {
+		Slot* mNext;
+		alignas(T) unsigned char mStorage[sizeof(T)];
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> mChunks;
+	Slot* mFreeList = nullptr;
+	size_t mSize = 0;
+
+	Pool() {}
+	Pool(const Pool&) = delete;
+	Pool& operator=(const Pool&) = delete;
+	~Pool() {
+		assert(mSize == 0); // live objects are not destructed
+	}
+
+	template<typename... Args>
+	T* Create(Args&&... args) {
+		if (!mFreeList) {
+			Grow();
+		}
+		auto slot = mFreeList;
+		mFreeList = slot->mNext;
+		mSize++;
+		return ::new (slot->mStorage) T(std::forward<Args>(args)...);
+	}
+
+	void Destroy(T* object) {
+		if (!object) return;
+		object->~T();
+		auto slot = reinterpret_cast<Slot*>(object);
+		slot->mNext = mFreeList;
+		mFreeList = slot;
+		mSize--;
+	}
+
+	void Reserve(size_t count) {
+		while (GetCapacity() < count) {
+			Grow();
+		}
+	}
+
+	size_t GetSize() const {
+		return mSize;
+	}
+
+	size_t GetCapacity() const {
+		return mChunks.size() * ChunkSize;
+	}
+
+private:
+	void Grow() {
+		mChunks.emplace_back(new Slot[ChunkSize]);
+		auto chunk = mChunks.back().get();
+		for (size_t i = ChunkSize; i > 0; --i) {
+			chunk[i - 1].mNext = mFreeList;
+			mFreeList = &chunk[i - 1];
+		}
+	}
+};
@@ -0,0 +1,248 @@
+#include "Profiler.h"
+#include "imgui.h"
+
+ProfileEventBuffer& Profiler::GetThreadBuffer() {
+	// Threads of the parallel algorithms come and go, the profiler keeps
+	// their buffers until the remaining events are drained
+	struct Owner {
+		std::shared_ptr<ProfileEventBuffer> mBuffer;
+		Owner() : mBuffer(Profiler::Get().RegisterThread()) {}
+		~Owner() {
+			mBuffer->mExited = true;
+		}
+	};
+	thread_local Owner owner;
+	return *owner.mBuffer;
+}
+
+std::shared_ptr<ProfileEventBuffer> Profiler::RegisterThread() {
+	auto buffer = std::make_shared<ProfileEventBuffer>();
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	if (mFreeThreads.empty()) {
+		buffer->mThread = mNextThread++;
+	} else {
+		buffer->mThread = *mFreeThreads.begin();
+		mFreeThreads.erase(mFreeThreads.begin());
+	}
+	buffer->mName = "thread " + std::to_string(buffer->mThread);
+	mThreadNames[buffer->mThread] = buffer->mName;
+	mThreads.push_back(buffer);
+	return buffer;
+}
+
+void Profiler::SetThreadName(const std::string& name) {
+	auto& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	buffer.mName = name;
+	mThreadNames[buffer.mThread] = name;
+}
+
+void Profiler::EndFrame() {
+	ProfileFrame frame;
+	frame.mBegin = mFrameBegin;
+	frame.mEnd = ProfilerNow();
+	mFrameBegin = frame.mEnd;
+
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for (auto& buffer : mThreads) {
+			buffer->Drain([&frame](const ProfileEvent& event) {
+				frame.mEvents.push_back(event);
+			});
+			if (const auto dropped = buffer->mDropped.exchange(0, std::memory_order_relaxed)) {
+				mDropped[buffer->mThread] += dropped;
+			}
+		}
+		mThreads.erase(std::remove_if(mThreads.begin(), mThreads.end(), [this](const auto& buffer) {
+			if (!buffer->mExited || !buffer->IsEmpty()) return false;
+			mFreeThreads.insert(buffer->mThread);
+			return true;
+		}), mThreads.end());
+	}
+
+	std::vector<ProfileEvent> gpuEvents;
+	mGpu.EndFrame(gpuEvents);
+	if (mPaused) return;
+
+	mFrames.push_back(std::move(frame));
+	while (mFrames.size() > mFrameLimit) {
+		mFrames.pop_front();
+	}
+
+	// GPU results arrive a few frames late, file them under the frame they ran in
+	for (const auto& event : gpuEvents) {
+		auto it = std::find_if(mFrames.rbegin(), mFrames.rend(), [&event](const ProfileFrame& frame) {
+			return frame.mBegin <= event.mBegin;
+		});
+		if (it != mFrames.rend()) {
+			it->mEvents.push_back(event);
+		}
+	}
+}
+
+std::vector<std::pair<std::string, size_t>> Profiler::GetDroppedEvents() const {
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	std::vector<std::pair<std::string, size_t>> result;
+	for (const auto& it : mDropped) {
+		result.emplace_back(mThreadNames.at(it.first), it.second);
+	}
+	return result;
+}
+
+bool Profiler::ExportChromeTrace(const std::string& fileName) {
+	std::ofstream ofs(fileName);
+	if (!ofs.is_open()) {
+		std::cerr << "Could not write profile: " << fileName << std::endl;
+		return false;
+	}
+	rapidjson::OStreamWrapper osw(ofs);
+	rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+
+	writer.StartObject();
+	writer.Key("displayTimeUnit");
+	writer.String("ms");
+	writer.Key("traceEvents");
+	writer.StartArray();
+
+	auto threadName = [&writer](uint32_t thread, const std::string& name) {
+		writer.StartObject();
+		writer.Key("name"); writer.String("thread_name");
+		writer.Key("ph"); writer.String("M");
+		writer.Key("pid"); writer.Int(0);
+		writer.Key("tid"); writer.Uint(thread);
+		writer.Key("args");
+		writer.StartObject();
+		writer.Key("name"); writer.String(name.c_str());
+		writer.EndObject();
+		writer.EndObject();
+	};
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for (const auto& it : mThreadNames) {
+			threadName(it.first, it.second);
+		}
+	}
+	threadName(GpuProfiler::Thread, "GPU");
+
+	// Timestamps are in microseconds
+	for (const auto& frame : mFrames) {
+		for (const auto& event : frame.mEvents) {
+			writer.StartObject();
+			writer.Key("name"); writer.String(event.mName);
+			writer.Key("cat"); writer.String(event.mThread == GpuProfiler::Thread ? "gpu" : "cpu");
+			writer.Key("ph"); writer.String("X");
+			writer.Key("ts"); writer.Double(event.mBegin / 1000.0);
+			writer.Key("dur"); writer.Double((event.mEnd - event.mBegin) / 1000.0);
+			writer.Key("pid"); writer.Int(0);
+			writer.Key("tid"); writer.Uint(event.mThread);
+			writer.EndObject();
+		}
+	}
+
+	writer.EndArray();
+
+	// Scopes missing from the trace because a thread's buffer was full
+	writer.Key("otherData");
+	writer.StartObject();
+	writer.Key("droppedEvents");
+	writer.StartObject();
+	for (const auto& dropped : GetDroppedEvents()) {
+		writer.Key(dropped.first.c_str()); writer.Uint64(dropped.second);
+	}
+	writer.EndObject();
+	writer.EndObject();
+
+	writer.EndObject();
+	return true;
+}
+
+void Profiler::DrawPanel(bool* open) {
+	if (!ImGui::Begin("Profiler", open)) {
+		ImGui::End();
+		return;
+	}
+
+	bool enabled = mEnabled;
+	if (ImGui::Checkbox("Enabled", &enabled)) {
+		mEnabled = enabled;
+	}
+	ImGui::SameLine();
+	ImGui::Checkbox("Pause", &mPaused);
+	ImGui::SameLine();
+	if (ImGui::Button("Export trace")) {
+		if (ExportChromeTrace("profile.json")) {
+			std::cout << "Profile written to profile.json" << std::endl;
+		}
+	}
+
+	// GPU events of the newest frames are still in flight
+	if (mFrames.size() <= GpuProfiler::Latency) {
+		ImGui::Text("Collecting...");
+		ImGui::End();
+		return;
+	}
+	const auto& frame = mFrames[mFrames.size() - 1 - GpuProfiler::Latency];
+	const double frameTime = (double)(frame.mEnd - frame.mBegin);
+	ImGui::Text("Frame: %.3f ms, %d events", frameTime / 1e6, (int)frame.mEvents.size());
+	for (const auto& dropped : GetDroppedEvents()) {
+		ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "%s: %d events dropped, buffer full", dropped.first.c_str(), (int)dropped.second);
+	}
+
+	// One lane per thread, one row per nesting level
+	std::map<uint32_t, uint32_t> lanes; // thread -> rows
+	for (const auto& event : frame.mEvents) {
+		auto& rows = lanes[event.mThread];
+		rows = std::max(rows, event.mDepth + 1);
+	}
+
+	const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+	const float labelWidth = 90.0f;
+	const float width = std::max(ImGui::GetContentRegionAvail().x - labelWidth, 100.0f);
+	auto drawList = ImGui::GetWindowDrawList();
+	auto origin = ImGui::GetCursorScreenPos();
+	const auto mouse = ImGui::GetIO().MousePos;
+	float y = origin.y;
+
+	std::map<uint32_t, std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		names = mThreadNames;
+	}
+	names[GpuProfiler::Thread] = "GPU";
+
+	for (const auto& lane : lanes) {
+		drawList->AddText(ImVec2(origin.x, y), IM_COL32(200, 200, 200, 255), names[lane.first].c_str());
+		for (const auto& event : frame.mEvents) {
+			if (event.mThread != lane.first) continue;
+			const double begin = std::max((double)event.mBegin - (double)frame.mBegin, 0.0);
+			const double end = std::min((double)event.mEnd - (double)frame.mBegin, frameTime);
+			if (end <= begin) continue;
+			const ImVec2 min(origin.x + labelWidth + (float)(begin / frameTime) * width, y + event.mDepth * rowHeight);
+			const ImVec2 max(std::max(origin.x + labelWidth + (float)(end / frameTime) * width, min.x + 1.0f), min.y + rowHeight - 1.0f);
+
+			const auto hue = (HashString(event.mName) % 360) / 360.0f;
+			drawList->AddRectFilled(min, max, ImColor::HSV(hue, 0.5f, 0.7f));
+			if (max.x - min.x > ImGui::CalcTextSize(event.mName).x + 4.0f) {
+				drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32(0, 0, 0, 255), event.mName);
+			}
+			if (mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y) {
+				ImGui::SetTooltip("%s: %.3f ms", event.mName, (event.mEnd - event.mBegin) / 1e6);
+			}
+		}
+		y += lane.second * rowHeight + 4.0f;
+	}
+	ImGui::Dummy(ImVec2(labelWidth + width, y - origin.y));
+
+	// Inclusive time per scope name over all threads
+	std::map<std::string, std::pair<uint64_t, size_t>> totals;
+	for (const auto& event : frame.mEvents) {
+		auto& total = totals[(event.mThread == GpuProfiler::Thread ? "GPU " : "") + std::string(event.mName)];
+		total.first += event.mEnd - event.mBegin;
+		total.second++;
+	}
+	for (const auto& total : totals) {
+		ImGui::Text("%-32s %8.3f ms  x%d", total.first.c_str(), total.second.first / 1e6, (int)total.second.second);
+	}
+
+	ImGui::End();
+}
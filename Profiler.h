@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Main.h"
+
+// Nanoseconds since the first call, one clock for every thread
+inline uint64_t ProfilerNow() {
+	static const auto start = std::chrono::steady_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One finished scope. Names are string literals and compared by pointer.
+struct ProfileEvent {
+	const char* mName;
+	uint64_t mBegin;
+	uint64_t mEnd;
+	uint32_t mDepth;
+	uint32_t mThread;
+};
+
+// Single producer ring of finished scopes, pushed by the owning thread and
+// drained by Profiler::EndFrame without locks. A full ring drops events
+// instead of waiting for the consumer.
+struct ProfileEventBuffer {
+	static constexpr size_t Capacity = 16 * 1024;
+
+	std::array<ProfileEvent, Capacity> mEvents;
+	std::atomic<size_t> mHead{ 0 }; // written by the owner
+	std::atomic<size_t> mTail{ 0 }; // written by the consumer
+	std::atomic<size_t> mDropped{ 0 };
+	std::atomic<bool> mExited{ false };
+	uint32_t mThread = 0;
+	uint32_t mDepth = 0; // open scopes, owner only
+	std::string mName; // guarded by Profiler::mThreadsMutex
+
+	void Push(const ProfileEvent& event) {
+		const auto head = mHead.load(std::memory_order_relaxed);
+		if (head - mTail.load(std::memory_order_acquire) >= Capacity) {
+			mDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		mEvents[head % Capacity] = event;
+		mHead.store(head + 1, std::memory_order_release);
+	}
+
+	template<typename T>
+	void Drain(T visit) {
+		const auto head = mHead.load(std::memory_order_acquire);
+		auto tail = mTail.load(std::memory_order_relaxed);
+		for (; tail != head; tail++) {
+			visit(mEvents[tail % Capacity]);
+		}
+		mTail.store(tail, std::memory_order_release);
+	}
+
+	bool IsEmpty() const {
+		return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_relaxed);
+	}
+};
+
+// GL_TIMESTAMP queries around GPU passes, main thread only. Results are read
+// Latency frames later so the pipeline never stalls, and mapped onto the CPU
+// clock with an offset sampled every frame.
+struct GpuProfiler {
+	static constexpr size_t Latency = 4;
+	static constexpr uint32_t Thread = UINT32_MAX; // ProfileEvent::mThread of GPU events
+
+	struct Query {
+		const char* mName;
+		GLuint mBegin;
+		GLuint mEnd;
+		uint32_t mDepth;
+	};
+
+	std::array<std::vector<Query>, Latency> mFrames;
+	std::vector<GLuint> mFreeQueries;
+	size_t mFrame = 0;
+	uint32_t mDepth = 0;
+	int64_t mGpuToCpu = 0; // ns to add to a GPU timestamp
+	bool mEnabled = false;
+
+	// Queries are not deleted, the context is gone when the profiler singleton is destroyed
+	GpuProfiler() {}
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	// Requires a current context, timer queries are core since GL 3.3
+	void Init() {
+		mEnabled = GLAD_GL_VERSION_3_3;
+	}
+
+	size_t Begin(const char* name) {
+		auto& frame = mFrames[mFrame % Latency];
+		frame.push_back({ name, AllocateQuery(), AllocateQuery(), mDepth++ });
+		glQueryCounter(frame.back().mBegin, GL_TIMESTAMP);
+		return frame.size() - 1;
+	}
+
+	void End(size_t index) {
+		mDepth--;
+		glQueryCounter(mFrames[mFrame % Latency][index].mEnd, GL_TIMESTAMP);
+	}
+
+	// Reads the frame recorded Latency frames ago and starts recording the next
+	void EndFrame(std::vector<ProfileEvent>& events) {
+		if (!mEnabled) return;
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		mGpuToCpu = (int64_t)ProfilerNow() - gpuNow;
+
+		mFrame++;
+		auto& frame = mFrames[mFrame % Latency];
+		for (const auto& query : frame) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(query.mBegin, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(query.mEnd, GL_QUERY_RESULT, &end);
+			events.push_back({ query.mName, (uint64_t)((int64_t)begin + mGpuToCpu), (uint64_t)((int64_t)end + mGpuToCpu), query.mDepth, Thread });
+			mFreeQueries.push_back(query.mBegin);
+			mFreeQueries.push_back(query.mEnd);
+		}
+		frame.clear();
+		mDepth = 0;
+	}
+
+private:
+	GLuint AllocateQuery() {
+		if (mFreeQueries.empty()) {
+			GLuint queries[64];
+			glGenQueries(64, queries);
+			mFreeQueries.insert(mFreeQueries.end(), std::begin(queries), std::end(queries));
+		}
+		const auto query = mFreeQueries.back();
+		mFreeQueries.pop_back();
+		return query;
+	}
+};
+
+// Events of one frame, from the end of the previous EndFrame to this one
+struct ProfileFrame {
+	uint64_t mBegin = 0;
+	uint64_t mEnd = 0;
+	std::vector<ProfileEvent> mEvents;
+};
+
+// Hierarchical CPU and GPU scope profiler. Threads record into their own
+// ProfileEventBuffer, the main thread collects them once per frame into a
+// short history that is shown as a flame graph or exported as a Chrome trace
+// (chrome://tracing, Perfetto).
+struct Profiler {
+	std::atomic<bool> mEnabled{ true };
+	bool mPaused = false; // keeps the history, events are still drained
+	size_t mFrameLimit = 300;
+	std::deque<ProfileFrame> mFrames;
+	uint64_t mFrameBegin = 0;
+	GpuProfiler mGpu;
+
+	mutable std::mutex mThreadsMutex; // registration, thread names and drop counts only
+	std::vector<std::shared_ptr<ProfileEventBuffer>> mThreads;
+	std::map<uint32_t, std::string> mThreadNames; // outlives exited threads for the export
+	std::set<uint32_t> mFreeThreads; // ids of exited threads, reused so lanes stay bounded
+	std::map<uint32_t, size_t> mDropped; // events lost to full buffers per thread since start, collected by EndFrame
+	uint32_t mNextThread = 0;
+
+	static Profiler& Get() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// Buffer of the calling thread, registered on first use
+	static ProfileEventBuffer& GetThreadBuffer();
+
+	void SetThreadName(const std::string& name);
+
+	// Called by the main thread at the frame boundary, outside of any GPU scope
+	void EndFrame();
+
+	bool ExportChromeTrace(const std::string& fileName);
+
+	// Thread name and dropped event count of every thread that lost events
+	std::vector<std::pair<std::string, size_t>> GetDroppedEvents() const;
+
+	// ImGui window with the flame graph of a recent frame
+	void DrawPanel(bool* open = nullptr);
+
+private:
+	std::shared_ptr<ProfileEventBuffer> RegisterThread();
+};
+
+// Records the enclosing block, or up to End for ranges that are not one block
+struct ProfileScope {
+	const char* mName = nullptr;
+	uint64_t mBegin = 0;
+
+	ProfileScope(const char* name) {
+		if (!Profiler::Get().mEnabled.load(std::memory_order_relaxed)) return;
+		mName = name;
+		Profiler::GetThreadBuffer().mDepth++;
+		mBegin = ProfilerNow();
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+	~ProfileScope() {
+		End();
+	}
+
+	void End() {
+		if (!mName) return;
+		const auto end = ProfilerNow();
+		auto& buffer = Profiler::GetThreadBuffer();
+		buffer.mDepth--;
+		buffer.Push({ mName, mBegin, end, buffer.mDepth, buffer.mThread });
+		mName = nullptr;
+	}
+};
+
+// GPU time of the GL commands issued in the enclosing block
+struct GpuProfileScope {
+	size_t mIndex = SIZE_MAX;
+
+	GpuProfileScope(const char* name) {
+		auto& profiler = Profiler::Get();
+		if (!profiler.mGpu.mEnabled || !profiler.mEnabled.load(std::memory_order_relaxed)) return;
+		mIndex = profiler.mGpu.Begin(name);
+	}
+	GpuProfileScope(const GpuProfileScope&) = delete;
+	GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+	~GpuProfileScope() {
+		End();
+	}
+
+	void End() {
+		if (mIndex == SIZE_MAX) return;
+		Profiler::Get().mGpu.End(mIndex);
+		mIndex = SIZE_MAX;
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// Define DISABLE_PROFILER to compile the scope macros out
+#ifndef DISABLE_PROFILER
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#endif
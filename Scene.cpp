@@ -1,201 +1,678 @@
-#include "Scene.h"
-#include "Asset.h"
-
-using namespace rapidjson;
-
-bool ReadBool(const rapidjson::Value& cfg, const char* key, bool def = false) {
-	if (cfg.HasMember(key)) return cfg[key].GetBool();
-	return def;
-}
-
-glm::vec3 ReadVec3(const rapidjson::Value& cfg, const char* key, const glm::vec3& def = { 0,0,0 }) {
-	if (cfg.HasMember(key)) {
-		const auto& val = cfg[key].GetArray();
-		return { val[0].GetFloat(), val[1].GetFloat(), val[2].GetFloat() };
-	}
-	return def;
-}
-
-
-void Entity::Init(Scene& scene) {
-	if (mModel && mModel->mAnimationSet) {
-		mAnimationController = std::make_shared<AnimationController>(mModel->mAnimationSet);
-	}
-	mPrevPos = mPos;
-	mPrevRot = mRot;
-}
-
-struct EntityMotionState : public virtual btMotionState {
-	Entity* mEntity = nullptr;
-	EntityMotionState(Entity* entity) : mEntity(entity) {}
-	virtual void getWorldTransform(btTransform& worldTrans) const {
-		worldTrans.setFromOpenGLMatrix((const btScalar*)&mEntity->mTransform[0]);
-	}
-	virtual void setWorldTransform(const btTransform& worldTrans) {
-		worldTrans.getOpenGLMatrix((btScalar*)&mEntity->mTransform[0]);
-		//auto inverted = glm::inverse(mEntity->mTransform);
-		//mEntity->mFront = glm::normalize(glm::vec3(inverted[2]));
-		mEntity->mRot = glm::quat_cast(mEntity->mTransform);
-		mEntity->mPos = glm::vec3(mEntity->mTransform[3]);
-		mEntity->mFront = glm::rotate(mEntity->mRot, glm::vec3(0, 0, 1));
-		//mEntity->mFront = glm::rotate(glm::inverse(mEntity->mRot), glm::vec3(0, 0, -1));
-		//mEntity->mRight = glm::rotate(glm::inverse(mEntity->mRot), glm::vec3(1, 0, 0));
-		//mEntity->mUp = glm::vec3(0.0, 1.0, 0.0);
-	}
-};
-
-void Entity::Load(Scene& scene, const rapidjson::Value& cfg) {
-	if (cfg.HasMember("name")) mName = cfg["name"].GetString();
-	mPos = ReadVec3(cfg, "position");
-	mRot = glm::quat(glm::radians(ReadVec3(cfg, "rotation")));
-	mScale = ReadVec3(cfg, "scale", mScale);
-	mGravity = ReadVec3(cfg, "gravity", mGravity);
-	mUseGravity = ReadBool(cfg, "useGravity");
-	mControllable = ReadBool(cfg, "controllable");
-	if (cfg.HasMember("attachTo")) {
-		auto obj = cfg["attachTo"].GetObject();
-		std::string entityName = obj["name"].GetString();
-		mAttachTo = scene.Find(entityName);
-		if (!mAttachTo) {
-			std::cerr << "Warning: Entity " << entityName << " not found" << std::endl;
-		}
-		if (mAttachTo && obj.HasMember("node")) {
-			std::string nodeName = obj["node"].GetString();
-			mAttachToNode = mAttachTo->mModel->mAnimationSet->GetBoneIndex(nodeName);
-			if (mAttachToNode == -1) {
-				std::cerr << "Warning: Node " << nodeName << " not found" << std::endl;
-			}
-		}
-	}
-	if (cfg.HasMember("rigidBody")) {
-		auto ms = new EntityMotionState(this);
-		btCollisionShape* cs = nullptr;
-		if (cfg["rigidBody"].IsArray()) {
-			auto obj = cfg["rigidBody"].GetArray();
-			std::string shape = obj[0].GetString();
-			if (shape == "box") {
-				cs = new btBoxShape(btVector3(obj[1].GetFloat(), obj[2].GetFloat(), obj[3].GetFloat()));
-			} else if(shape == "sphere") {
-				cs = new btSphereShape(obj[1].GetFloat());
-			} else if(shape == "capsule") {
-				cs = new btCapsuleShape(obj[1].GetFloat(), obj[2].GetFloat());
-			} else {
-				throw new std::invalid_argument("invalid rigidBody cfg");
-			}
-		} else {
-			cs = new btCapsuleShape(0.5f, 1.0f);
-		}
-		mRigidBody = new btRigidBody(10.0f, ms, cs);
-		scene.mDynamicsWorld->addRigidBody(mRigidBody);
-	}
-}
-
-AssetMgr<Model>* gModelMgr = nullptr; // FIXXXXXXX
-
-void ModelEntity::Load(Scene& scene, const rapidjson::Value& cfg) {
-	Entity::Load(scene, cfg);
-	mShaderProgram = ShaderProgram::Load("default");
-	if (nullptr == gModelMgr) gModelMgr = new AssetMgr<Model>();
-	std::string name = cfg["model"].GetString();
-	mModel = gModelMgr->Load(name);
-}
-
-void ParticleEntity::Init(Scene& scene) {
-	Entity::Init(scene);
-
-	mShaderProgram = ShaderProgram::Load("particles");
-	mModel = std::make_shared<Model>();
-	auto mesh = std::make_shared<Mesh>();
-	float s = 2.0f;
-	float ps = 0.25f;
-	float quad[] = {
-		0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,
-		0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f,
-	};
-	for (float r = -3.14f; r < 3.14f; r += 3.14f / 8.0f) {
-		float x = cos(r) * s;
-		float y = sin(r) * s;
-		for (int v = 0; v < 12; v += 2) {
-			Vertex vertex;
-			vertex.mPos = { x, y, 0 };
-			vertex.mNormal.x = (quad[v] - 0.5f) * ps;
-			vertex.mNormal.y = (quad[v + 1] - 0.5f) * ps;
-			vertex.mNormal.z = 1.0f;
-			mesh->mVertices.push_back(vertex);
-			mesh->mIndices.push_back(mesh->mIndices.size());
-		}
-	}
-	mModel->mMeshes.push_back(std::make_shared<ModelMesh>(mesh, glm::identity<glm::mat4>()));
-}
-
-void ParticleEntity::Load(Scene& scene, const rapidjson::Value& cfg) {
-	Entity::Load(scene, cfg);
-}
-
-void ParticleEntity::Update(float absoluteTime, float deltaTime) {
-	Entity::Update(absoluteTime, deltaTime);
-	auto& mesh = mModel->mMeshes[0]->mMesh;
-	float s = 2.0f * sin(absoluteTime);
-	int a = 0;
-	for (float r = -3.14f; r < 3.14f; r += 3.14f / 8.0f) {
-		float x = cos(r + absoluteTime) * s;
-		float y = sin(r + absoluteTime) * s;
-		for (int v = 0; v < 6; ++v) {
-			auto& vertex = mesh->mVertices[a + v];
-			vertex.mPos = { x, y, 0 };
-		}
-		a += 6;
-	}
-	mesh->mVertexBufferDirty = true;
-}
-
-Scene::Scene() {
-	Register("model", []() { return std::make_shared<ModelEntity>(); });
-	Register("particle", []() { return std::make_shared<ParticleEntity>(); });
-
-	auto cc = new btDefaultCollisionConfiguration();
-	auto dispatcher = new btCollisionDispatcher(cc);
-	auto opc = new btDbvtBroadphase();
-	auto solver = new btSequentialImpulseConstraintSolver();
-	mDynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, opc, solver, cc);
-	mDynamicsWorld->setGravity(btVector3(0, -10, 0));
-
-	auto groundShape = new btBoxShape(btVector3(100.0f, 0.1f, 100.0f));
-	btTransform groundTransform;
-	groundTransform.setIdentity();
-	groundTransform.setOrigin(btVector3(0, -0.1f, 0));
-	auto groundMS = new btDefaultMotionState(groundTransform);
-	auto ground = new btRigidBody(0.0f, groundMS, groundShape);
-	ground->forceActivationState(DISABLE_DEACTIVATION);
-	ground->setCollisionFlags(btCollisionObject::CF_KINEMATIC_OBJECT | btCollisionObject::CF_STATIC_OBJECT);
-	mDynamicsWorld->addRigidBody(ground);
-}
-
-void Scene::Load(const std::string& fileName) {
-	rapidjson::Document config;
-	LoadJson(config, fileName);
-
-	for (const auto& cfg : config["entities"].GetArray()) {
-		if (cfg.HasMember("disabled") && cfg["disabled"].GetBool()) continue;
-		auto type = cfg.HasMember("type") ? cfg["type"].GetString() : "model";
-		auto ctor = mTypes[type];
-		auto entity = ctor();
-		entity->Load(*this, cfg);
-
-		if (cfg.HasMember("array")) {
-			auto arrayObj = cfg["array"].GetArray();
-			float arraySpacing = cfg.HasMember("arraySpacing") ? cfg["arraySpacing"].GetFloat() : glm::length(entity->mModel->mAABB.mHalfSize);
-			for (size_t ax = 0; ax < arrayObj[0].GetInt(); ++ax) {
-				for (size_t ay = 0; ay < arrayObj[1].GetInt(); ++ay) {
-					for (size_t az = 0; az < arrayObj[2].GetInt(); ++az) {
-						auto arrayEntity = entity->Clone();;
-						arrayEntity->mPos += glm::vec3(ax * arraySpacing, ay * arraySpacing, az * arraySpacing);
-						mEntities.push_back(arrayEntity);
-					}
-				}
-			}
-		} else {
-			mEntities.push_back(entity);
-		}
-	}
-}
\ No newline at end of file
+#include "Scene.h"
+#include "Asset.h"
+#include "Skinning.h"
+
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
+#include "LinearMath/btThreads.h"
+
+using namespace rapidjson;
+
+bool ReadBool(const rapidjson::Value& cfg, const char* key, bool def = false) {
+	if (cfg.HasMember(key)) return cfg[key].GetBool();
+	return def;
+}
+
+glm::vec3 ReadVec3(const rapidjson::Value& cfg, const char* key, const glm::vec3& def = { 0,0,0 }) {
+	if (cfg.HasMember(key)) {
+		const auto& val = cfg[key].GetArray();
+		return { val[0].GetFloat(), val[1].GetFloat(), val[2].GetFloat() };
+	}
+	return def;
+}
+
+
+Entity_ Entity::Clone(Scene& scene, EntityRegistry& registry) const {
+	auto clone = std::make_shared<Entity>();
+	clone->Register(registry);
+	clone->mShaderProgram = mShaderProgram;
+	clone->mModel = mModel;
+	clone->mEmitter = mEmitter;
+	clone->mFront = mFront;
+	clone->mUp = mUp;
+	clone->mControllable = mControllable;
+	clone->mCollisionShape = mCollisionShape;
+	clone->mMass = mMass;
+	auto& transform = clone->GetTransform();
+	const auto& source = GetTransform();
+	transform.mPos = source.mPos;
+	transform.mRot = source.mRot;
+	transform.mScale = source.mScale;
+	transform.mRigidBody = source.mRigidBody;
+	if (GetUseGravity()) {
+		registry.mBodies.Add(clone->mID, GetGravity());
+	}
+	return clone;
+}
+
+void Entity::Init(Scene& scene) {
+	if (mCollisionShape) {
+		mRigidBody = scene.CreateRigidBody(*this);
+	}
+	if (mModel && mModel->mAnimationSet) {
+		mAnimationController = std::make_shared<AnimationController>(mModel->mAnimationSet);
+	}
+	Enable(scene);
+}
+
+void Entity::Enable(Scene& scene) {
+	mDespawned = false;
+	if (mRigidBody && !mRigidBody->getBroadphaseHandle()) {
+		btTransform worldTrans;
+		mRigidBody->getMotionState()->getWorldTransform(worldTrans);
+		mRigidBody->setCenterOfMassTransform(worldTrans);
+		mRigidBody->setInterpolationWorldTransform(worldTrans);
+		mRigidBody->setLinearVelocity(btVector3(0, 0, 0));
+		mRigidBody->setAngularVelocity(btVector3(0, 0, 0));
+		mRigidBody->clearForces();
+		scene.mDynamicsWorld->addRigidBody(mRigidBody);
+	}
+	if (mAnimationController) {
+		mRegistry->mAnimations.Add(mID, { mAnimationController.get() });
+	}
+	if (mModel && mShaderProgram) {
+		RenderComponent render;
+		render.mModel = mModel.get();
+		render.mShaderProgram = mShaderProgram.get();
+		render.mEmitter = mEmitter.get();
+		if (mRigidBody) {
+			render.mOffset = { 0, -1, 0 }; // FIXME!!!
+		}
+		mRegistry->mRenders.Add(mID, render);
+	}
+}
+
+void Entity::Disable(Scene& scene) {
+	mDespawned = true;
+	if (mRigidBody && mRigidBody->getBroadphaseHandle()) {
+		scene.mDynamicsWorld->removeRigidBody(mRigidBody);
+	}
+	if (auto render = mRegistry->mRenders.Find(mID)) {
+		if (render->mSpatialProxy != -1) {
+			scene.mSpatialIndex.Remove(render->mSpatialProxy);
+		}
+		mRegistry->mRenders.Remove(mID);
+	}
+	mRegistry->mAnimations.Remove(mID);
+	mRegistry->mBodies.Remove(mID);
+	mRegistry->mLifetimes.Remove(mID);
+}
+
+void EntityMotionState::getWorldTransform(btTransform& worldTrans) const {
+	const auto& transform = mEntity->GetTransform();
+	worldTrans.setOrigin(cast_vec3(transform.mPos));
+	worldTrans.setRotation(btQuaternion(transform.mRot.x, transform.mRot.y, transform.mRot.z, transform.mRot.w));
+}
+
+void EntityMotionState::setWorldTransform(const btTransform& worldTrans) {
+	auto& transform = mEntity->GetTransform();
+	worldTrans.getOpenGLMatrix((btScalar*)&transform.mWorld[0]);
+	transform.mDirty = true;
+	//auto inverted = glm::inverse(transform.mWorld);
+	//mEntity->mFront = glm::normalize(glm::vec3(inverted[2]));
+	transform.mRot = glm::quat_cast(transform.mWorld);
+	const auto prevPos = transform.mPos;
+	transform.mPos = glm::vec3(transform.mWorld[3]);
+	transform.mPrevOffset = prevPos - transform.mPos;
+	mEntity->mFront = glm::rotate(transform.mRot, glm::vec3(0, 0, 1));
+	//mEntity->mFront = glm::rotate(glm::inverse(mEntity->mRot), glm::vec3(0, 0, -1));
+	//mEntity->mRight = glm::rotate(glm::inverse(mEntity->mRot), glm::vec3(1, 0, 0));
+	//mEntity->mUp = glm::vec3(0.0, 1.0, 0.0);
+}
+
+void Entity::Load(Scene& scene, const rapidjson::Value& cfg) {
+	if (cfg.HasMember("name")) mName = cfg["name"].GetString();
+	auto& transform = GetTransform();
+	transform.mPos = ReadVec3(cfg, "position");
+	transform.mRot = glm::quat(glm::radians(ReadVec3(cfg, "rotation")));
+	transform.mScale = ReadVec3(cfg, "scale", transform.mScale);
+	if (ReadBool(cfg, "useGravity")) {
+		mRegistry->mBodies.Add(mID, ReadVec3(cfg, "gravity", BodyArray::DefaultGravity));
+	}
+	mControllable = ReadBool(cfg, "controllable");
+	if (cfg.HasMember("attachTo")) {
+		auto obj = cfg["attachTo"].GetObject();
+		std::string entityName = obj["name"].GetString();
+		auto attachTo = scene.Find(entityName);
+		if (!attachTo) {
+			std::cerr << "Warning: Entity " << entityName << " not found" << std::endl;
+		}
+		uint32_t node = -1;
+		if (attachTo && obj.HasMember("node")) {
+			std::string nodeName = obj["node"].GetString();
+			node = attachTo->mModel->mAnimationSet->GetBoneIndex(nodeName);
+			if (node == -1) {
+				std::cerr << "Warning: Node " << nodeName << " not found" << std::endl;
+			}
+		}
+		if (attachTo && attachTo->mRegistry != mRegistry) {
+			std::cerr << "Warning: Prefab " << mName << " can not be attached to " << entityName << std::endl;
+		} else if (attachTo) {
+			mRegistry->SetParent(mID, attachTo->mID, node);
+		}
+	}
+	if (cfg.HasMember("rigidBody")) {
+		btCollisionShape* cs = nullptr;
+		if (cfg["rigidBody"].IsArray()) {
+			auto obj = cfg["rigidBody"].GetArray();
+			std::string shape = obj[0].GetString();
+			if (shape == "box") {
+				cs = scene.GetShape(BOX_SHAPE_PROXYTYPE, { obj[1].GetFloat(), obj[2].GetFloat(), obj[3].GetFloat() });
+			} else if(shape == "sphere") {
+				cs = scene.GetShape(SPHERE_SHAPE_PROXYTYPE, { obj[1].GetFloat(), 0, 0 });
+			} else if(shape == "capsule") {
+				cs = scene.GetShape(CAPSULE_SHAPE_PROXYTYPE, { obj[1].GetFloat(), obj[2].GetFloat(), 0 });
+			} else {
+				throw std::invalid_argument("invalid rigidBody cfg");
+			}
+		} else {
+			cs = scene.GetShape(CAPSULE_SHAPE_PROXYTYPE, { 0.5f, 1.0f, 0 });
+		}
+		mCollisionShape = cs;
+		transform.mRigidBody = true;
+	}
+}
+
+AssetMgr<Model>* gModelMgr = nullptr; // FIXXXXXXX
+
+void ModelEntity::Load(Scene& scene, const rapidjson::Value& cfg) {
+	Entity::Load(scene, cfg);
+	if (nullptr == gModelMgr) gModelMgr = new AssetMgr<Model>();
+	std::string name = cfg["model"].GetString();
+	mModel = gModelMgr->Load(name);
+	mShaderProgram = ShaderProgram::Load("default", mModel->GetShaderDefines());
+}
+
+void ParticleEntity::Load(Scene& scene, const rapidjson::Value& cfg) {
+	Entity::Load(scene, cfg);
+	mShaderProgram = ShaderProgram::Load("particles");
+	mEmitter = std::make_shared<ParticleEmitter>();
+	if (cfg.HasMember("emitter")) {
+		const auto& emitter = cfg["emitter"];
+		if (emitter.HasMember("count")) mEmitter->mCount = emitter["count"].GetUint();
+		if (emitter.HasMember("lifetime")) mEmitter->mLifetime = emitter["lifetime"].GetFloat();
+		if (emitter.HasMember("speed")) mEmitter->mSpeed = emitter["speed"].GetFloat();
+		if (emitter.HasMember("spread")) mEmitter->mSpread = glm::radians(emitter["spread"].GetFloat());
+		if (emitter.HasMember("size")) mEmitter->mSize = emitter["size"].GetFloat();
+		mEmitter->mDirection = ReadVec3(emitter, "direction", mEmitter->mDirection);
+		mEmitter->mGravity = ReadVec3(emitter, "gravity", mEmitter->mGravity);
+		mEmitter->mColorStart = ReadVec3(emitter, "colorStart", mEmitter->mColorStart);
+		mEmitter->mColorEnd = ReadVec3(emitter, "colorEnd", mEmitter->mColorEnd);
+	}
+	mEmitter->Build();
+
+	// no meshes, the model only provides the bounds for culling
+	mModel = std::make_shared<Model>();
+	mModel->mAABB = mEmitter->GetBounds();
+}
+
+Scene::Scene() {
+	Register("entity", []() { return std::make_shared<Entity>(); });
+	Register("model", []() { return std::make_shared<ModelEntity>(); });
+	Register("particle", []() { return std::make_shared<ParticleEntity>(); });
+	mWorker = std::thread(&Scene::RunWorker, this);
+}
+
+void Scene::RunWorker() {
+	Profiler::Get().SetThreadName("simulation");
+	std::unique_lock<std::mutex> lock(mWorkerMutex);
+	for (;;) {
+		mWorkerCondition.wait(lock, [this]() { return mWorkerBusy || mWorkerExit; });
+		if (!mWorkerBusy) return;
+		lock.unlock();
+		try {
+			Simulate(mWorkerAbsoluteTime, mWorkerDeltaTime);
+		} catch (...) {
+			mWorkerError = std::current_exception();
+		}
+		lock.lock();
+		mWorkerBusy = false;
+		mWorkerCondition.notify_all();
+	}
+}
+
+// Lets a queued simulation finish, its error is dropped with the scene
+void Scene::StopWorker() {
+	{
+		std::lock_guard<std::mutex> lock(mWorkerMutex);
+		mWorkerExit = true;
+	}
+	mWorkerCondition.notify_all();
+	if (mWorker.joinable()) {
+		mWorker.join();
+	}
+}
+
+// Bullet's default scheduler owns its worker threads, it is created on first
+// use and shared by every world for the rest of the run
+static btITaskScheduler* GetDefaultTaskScheduler() {
+	static std::unique_ptr<btITaskScheduler> scheduler(btCreateDefaultTaskScheduler());
+	return scheduler.get();
+}
+
+// Multithreaded mode needs bullet built with BT_THREADSAFE, which the
+// bullet3:bt2_thread_locks option in conanfile.txt enables
+void Scene::CreateDynamicsWorld(bool multithreaded, int threads) {
+	assert(!mDynamicsWorld);
+	auto scheduler = multithreaded ? btGetTaskScheduler() : nullptr;
+	if (multithreaded && (!scheduler || scheduler->getMaxNumThreads() <= 1)) {
+		scheduler = GetDefaultTaskScheduler();
+		if (!scheduler) {
+			std::cerr << "Warning: Bullet was built without BT_THREADSAFE, using single threaded physics" << std::endl;
+		}
+	}
+
+	if (scheduler) {
+		if (threads <= 0) {
+			threads = (int)std::max(1u, std::thread::hardware_concurrency());
+		}
+		btSetTaskScheduler(scheduler);
+		scheduler->setNumThreads(std::min(threads, scheduler->getMaxNumThreads()));
+		mPhysicsThreads = scheduler->getNumThreads();
+
+		btDefaultCollisionConstructionInfo cci;
+		cci.m_defaultMaxPersistentManifoldPoolSize = 80000;
+		cci.m_defaultMaxCollisionAlgorithmPoolSize = 80000;
+		mCollisionConfiguration = std::make_unique<btDefaultCollisionConfiguration>(cci);
+		mDispatcher = std::make_unique<btCollisionDispatcherMt>(mCollisionConfiguration.get(), 40);
+		mBroadphase = std::make_unique<btDbvtBroadphase>();
+		auto solverPool = new btConstraintSolverPoolMt(scheduler->getMaxNumThreads());
+		mSolverPool.reset(solverPool);
+		mSolver = std::make_unique<btSequentialImpulseConstraintSolverMt>();
+		mDynamicsWorld = std::make_unique<btDiscreteDynamicsWorldMt>(mDispatcher.get(), mBroadphase.get(), solverPool, mSolver.get(), mCollisionConfiguration.get());
+	} else {
+		mCollisionConfiguration = std::make_unique<btDefaultCollisionConfiguration>();
+		mDispatcher = std::make_unique<btCollisionDispatcher>(mCollisionConfiguration.get());
+		mBroadphase = std::make_unique<btDbvtBroadphase>();
+		mSolver = std::make_unique<btSequentialImpulseConstraintSolver>();
+		mDynamicsWorld = std::make_unique<btDiscreteDynamicsWorld>(mDispatcher.get(), mBroadphase.get(), mSolver.get(), mCollisionConfiguration.get());
+		mPhysicsThreads = 0;
+	}
+	mDynamicsWorld->setGravity(btVector3(0, -10, 0));
+
+	btTransform groundTransform;
+	groundTransform.setIdentity();
+	groundTransform.setOrigin(btVector3(0, -0.1f, 0));
+	mGroundMotionState = std::make_unique<btDefaultMotionState>(groundTransform);
+	mGround = std::make_unique<btRigidBody>(0.0f, mGroundMotionState.get(), GetShape(BOX_SHAPE_PROXYTYPE, { 100.0f, 0.1f, 100.0f }));
+	mGround->forceActivationState(DISABLE_DEACTIVATION);
+	mGround->setCollisionFlags(btCollisionObject::CF_KINEMATIC_OBJECT | btCollisionObject::CF_STATIC_OBJECT);
+	mDynamicsWorld->addRigidBody(mGround.get());
+}
+
+// Entity rigid bodies must be destroyed before the world
+void Scene::DestroyDynamicsWorld() {
+	if (!mDynamicsWorld) return;
+	mDynamicsWorld->removeRigidBody(mGround.get());
+	mGround.reset();
+	mGroundMotionState.reset();
+	mDynamicsWorld.reset();
+	mSolver.reset();
+	mSolverPool.reset();
+	mBroadphase.reset();
+	mDispatcher.reset();
+	mCollisionConfiguration.reset();
+	mShapes.clear();
+}
+
+// Identical shapes are shared between bodies, size holds the shape parameters
+// in constructor order (half extents, radius or radius and height)
+btCollisionShape* Scene::GetShape(int type, const glm::vec3& size) {
+	auto& shape = mShapes[{ type, size.x, size.y, size.z }];
+	if (!shape) {
+		switch (type) {
+		case BOX_SHAPE_PROXYTYPE:
+			shape = std::make_unique<btBoxShape>(cast_vec3(size));
+			break;
+		case SPHERE_SHAPE_PROXYTYPE:
+			shape = std::make_unique<btSphereShape>(size.x);
+			break;
+		case CAPSULE_SHAPE_PROXYTYPE:
+			shape = std::make_unique<btCapsuleShape>(size.x, size.y);
+			break;
+		default:
+			throw std::invalid_argument("invalid shape type");
+		}
+	}
+	return shape.get();
+}
+
+// Bodies and motion states come from pools, creating and destroying them only
+// allocates when a pool has to grow by another chunk. The body is added to the
+// world by Entity::Enable.
+btRigidBody* Scene::CreateRigidBody(Entity& entity) {
+	assert(entity.mCollisionShape && !entity.mRigidBody);
+	auto motionState = mMotionStates.Create(&entity);
+	return mRigidBodies.Create(entity.mMass, motionState, entity.mCollisionShape);
+}
+
+void Scene::DestroyRigidBody(Entity& entity) {
+	if (!entity.mRigidBody) return;
+	if (entity.mRigidBody->getBroadphaseHandle()) {
+		mDynamicsWorld->removeRigidBody(entity.mRigidBody);
+	}
+	mMotionStates.Destroy(static_cast<EntityMotionState*>(entity.mRigidBody->getMotionState()));
+	mRigidBodies.Destroy(entity.mRigidBody);
+	entity.mRigidBody = nullptr;
+}
+
+void Scene::Load(const std::string& fileName) {
+	rapidjson::Document config;
+	LoadJson(config, fileName);
+
+	if (!mDynamicsWorld) {
+		bool multithreaded = false;
+		int threads = 0;
+		if (config.HasMember("physics")) {
+			const auto& physics = config["physics"];
+			multithreaded = ReadBool(physics, "multithreaded");
+			if (physics.HasMember("threads")) threads = physics["threads"].GetInt();
+			mAsyncUpdate = ReadBool(physics, "async", mAsyncUpdate);
+		}
+		if (mForcePhysicsThreads >= 0) {
+			multithreaded = mForcePhysicsThreads > 0;
+			threads = mForcePhysicsThreads;
+		}
+		CreateDynamicsWorld(multithreaded, threads);
+	} else if (config.HasMember("physics")) {
+		std::cerr << "Warning: " << fileName << ": physics settings ignored, world already created" << std::endl;
+	}
+
+	if (config.HasMember("prefabs")) {
+		for (const auto& cfg : config["prefabs"].GetArray()) {
+			auto type = cfg.HasMember("type") ? cfg["type"].GetString() : "model";
+			auto entity = Create(type, mTemplates);
+			entity->Load(*this, cfg);
+			mPrefabs[entity->mName].mTemplate = entity;
+		}
+	}
+
+	for (const auto& cfg : config["entities"].GetArray()) {
+		if (cfg.HasMember("disabled") && cfg["disabled"].GetBool()) continue;
+		auto type = cfg.HasMember("type") ? cfg["type"].GetString() : "model";
+		auto entity = Create(type);
+		entity->Load(*this, cfg);
+
+		if (cfg.HasMember("array")) {
+			auto arrayObj = cfg["array"].GetArray();
+			float arraySpacing = cfg.HasMember("arraySpacing") ? cfg["arraySpacing"].GetFloat() : glm::length(entity->mModel->mAABB.mHalfSize);
+			for (size_t ax = 0; ax < arrayObj[0].GetInt(); ++ax) {
+				for (size_t ay = 0; ay < arrayObj[1].GetInt(); ++ay) {
+					for (size_t az = 0; az < arrayObj[2].GetInt(); ++az) {
+						auto arrayEntity = entity->Clone(*this, mRegistry);
+						arrayEntity->GetTransform().mPos += glm::vec3(ax * arraySpacing, ay * arraySpacing, az * arraySpacing);
+						Insert(arrayEntity);
+					}
+				}
+			}
+		} else {
+			Insert(entity);
+		}
+	}
+}
+
+Entity* Scene::Spawn(const std::string& name, const glm::vec3& pos, const glm::quat& rot, float ttl) {
+	auto& prefab = mPrefabs[name];
+	if (!prefab.mTemplate) {
+		const auto source = Find(name);
+		if (!source) {
+			std::cerr << "Warning: Prefab " << name << " not found" << std::endl;
+			mPrefabs.erase(name);
+			return nullptr;
+		}
+		prefab.mTemplate = source->Clone(*this, mTemplates);
+	}
+
+	Entity* entity = nullptr;
+	const bool created = prefab.mFree.empty();
+	if (created) {
+		auto instance = prefab.mTemplate->Clone(*this, mRegistry);
+		instance->mPrefab = &prefab;
+		prefab.mInstances.push_back(instance);
+		entity = instance.get();
+	} else {
+		entity = prefab.mFree.back();
+		prefab.mFree.pop_back();
+	}
+
+	auto& transform = entity->GetTransform();
+	transform.mPos = pos;
+	transform.mRot = rot;
+	transform.mPrevOffset = { 0,0,0 };
+	transform.mDirty = true;
+	if (prefab.mTemplate->GetUseGravity()) {
+		mRegistry.mBodies.Add(entity->mID, prefab.mTemplate->GetGravity());
+	}
+
+	if (created) {
+		entity->Init(*this);
+	} else {
+		entity->Enable(*this);
+	}
+	if (entity->mUpdate) {
+		entity->mUpdateIndex = mUpdateEntities.size();
+		mUpdateEntities.push_back(entity);
+	}
+	if (ttl > 0.0f) {
+		mRegistry.mLifetimes.Add(entity->mID, { ttl });
+	}
+	return entity;
+}
+
+void Scene::Despawn(Entity& entity) {
+	assert(entity.mPrefab);
+	if (entity.mDespawned) return;
+	entity.Disable(*this);
+	if (entity.mUpdate) {
+		assert(entity.mUpdateIndex < mUpdateEntities.size() && mUpdateEntities[entity.mUpdateIndex] == &entity);
+		auto last = mUpdateEntities.back();
+		last->mUpdateIndex = entity.mUpdateIndex;
+		mUpdateEntities[entity.mUpdateIndex] = last;
+		mUpdateEntities.pop_back();
+		entity.mUpdateIndex = -1;
+	}
+	entity.mPrefab->mFree.push_back(&entity);
+}
+
+// Fixed step physics, gravity bodies and animations. In async mode this runs on
+// a worker while the previous frame is drawn from mRenderState, so it must not
+// touch renders, the spatial index or the render state.
+void Scene::Simulate(float absoluteTime, float deltaTime) {
+	PROFILE_SCOPE("Scene::Simulate");
+	mAccum += deltaTime;
+	if (mAccum >= mStep) {
+		for (auto& transform : mRegistry.mTransforms.mData) {
+			transform.mPrevOffset = { 0,0,0 };
+		}
+	}
+	size_t steps = 0;
+	const auto physicsStart = GetTime();
+	{
+		PROFILE_SCOPE("Physics");
+		while (mAccum >= mStep) {
+			mDynamicsWorld->stepSimulation(mStep);
+			mAccum -= mStep;
+			steps++;
+		}
+	}
+	mPhysicsTime = (GetTime() - physicsStart) * 1000.0f;
+	mAlpha = mAccum / mStep;
+	UpdateAnimations(absoluteTime);
+	UpdateBodies(steps);
+}
+
+void Scene::UpdateAnimations(float absoluteTime) {
+	PROFILE_SCOPE("Animation");
+	auto& animations = mRegistry.mAnimations.mData;
+	std::for_each(std::execution::par, animations.begin(), animations.end(), [absoluteTime](auto& animation) {
+		animation.mChanged = animation.mController->Update(absoluteTime);
+	});
+}
+
+// Gravity bodies share the scene accumulator, see EntityRegistry::UpdateBodies
+void Scene::UpdateBodies(size_t steps) {
+	PROFILE_SCOPE("Scene::UpdateBodies");
+	mRegistry.UpdateBodies(steps, mStep);
+}
+
+void Scene::UpdateTransforms() {
+	PROFILE_SCOPE("Scene::UpdateTransforms");
+	mRegistry.UpdateTransforms();
+}
+
+void Scene::UpdateSpatialIndex() {
+	PROFILE_SCOPE("Scene::UpdateSpatialIndex");
+	auto& renders = mRegistry.mRenders;
+	for (size_t i = 0; i < renders.Size(); ++i) {
+		auto& render = renders.mData[i];
+		const auto id = renders.mEntities[i];
+		const auto& transform = mRegistry.mTransforms.Get(id);
+		if (render.mSpatialProxy != -1 && !transform.mChanged && render.mProxyOffset == render.mOffset) continue;
+		// Same placement as the renderer, rigid bodies draw below their origin
+		const auto bounds = render.mModel->mAABB.Transform(glm::translate(transform.mWorld, render.mOffset));
+		render.mProxyOffset = render.mOffset;
+		if (render.mSpatialProxy == -1) {
+			render.mSpatialProxy = mSpatialIndex.Insert(bounds, id);
+		} else {
+			mSpatialIndex.Move(render.mSpatialProxy, bounds);
+		}
+	}
+}
+
+// Copies what the renderer reads out of the component arrays. Physics driven
+// transforms are moved back towards their previous step by the accumulator
+// remainder, children follow the interpolated parent. Only the translation is
+// interpolated, rotations are drawn as of the latest step.
+void Scene::UpdateRenderState() {
+	PROFILE_SCOPE("Scene::UpdateRenderState");
+	const auto& transforms = mRegistry.mTransforms;
+	auto& offsets = mRenderState.mOffsets;
+	offsets.resize(transforms.Size());
+	const float weight = 1.0f - mAlpha;
+	for (size_t i = 0; i < transforms.Size(); ++i) {
+		const auto& transform = transforms.mData[i];
+		offsets[i] = transform.mPrevOffset * weight;
+		if (transform.mParent != InvalidEntityID) {
+			offsets[i] += offsets[transforms.mIndices[transform.mParent]];
+		}
+	}
+
+	const auto& renders = mRegistry.mRenders;
+	auto& instances = mRenderState.mInstances;
+	auto& bones = mRenderState.mBones;
+	instances.resize(renders.Size());
+	bones.clear();
+	for (size_t i = 0; i < renders.Size(); ++i) {
+		const auto id = renders.mEntities[i];
+		const auto index = transforms.mIndices[id];
+		auto& instance = instances[i];
+		instance.mWorld = transforms.mData[index].mWorld;
+		instance.mWorld[3] += glm::vec4(offsets[index], 0.0f);
+		instance.mBoneOffset = (uint32_t)bones.size();
+		instance.mBoneCount = 0;
+		if (const auto animation = mRegistry.mAnimations.Find(id)) {
+			const auto& finalTransforms = animation->mController->mFinalTransforms;
+			bones.insert(bones.end(), finalTransforms.begin(), finalTransforms.end());
+			instance.mBoneCount = (uint32_t)finalTransforms.size();
+		}
+	}
+}
+
+// Expired instances are despawned, the lifetime component is removed with the
+// entity's other components so the loop does not advance in that case
+void Scene::UpdateLifetimes(float deltaTime) {
+	auto& lifetimes = mRegistry.mLifetimes;
+	for (size_t i = 0; i < lifetimes.Size();) {
+		auto& lifetime = lifetimes.mData[i];
+		lifetime.mRemaining -= deltaTime;
+		if (lifetime.mRemaining > 0.0f) {
+			++i;
+			continue;
+		}
+		auto entity = mRegistry.GetEntity(lifetimes.mEntities[i]);
+		if (entity->mPrefab) {
+			Despawn(*entity);
+		} else {
+			lifetimes.Remove(lifetimes.mEntities[i]);
+		}
+	}
+}
+
+MeshMemoryStats Scene::GetMeshMemoryStats() const {
+	MeshMemoryStats stats;
+	std::set<const Mesh*> meshes;
+	auto addModel = [&](const Model_& model) {
+		if (!model) return;
+		for (const auto& modelMesh : model->mMeshes) {
+			if (meshes.insert(modelMesh->mMesh.get()).second) {
+				stats.Add(*modelMesh->mMesh);
+			}
+		}
+	};
+	for (const auto& entity : mEntities) {
+		addModel(entity->mModel);
+	}
+	for (const auto& prefab : mPrefabs) {
+		addModel(prefab.second.mTemplate->mModel);
+	}
+	return stats;
+}
+// Posed from the render state so the result matches the drawn frame and does
+// not race the async simulation
+AABB Scene::GetSkinnedBounds(EntityID id) const {
+	const auto found = mRegistry.mRenders.Find(id);
+	if (!found) {
+		// Not drawn (yet), fall back to the unposed model bounds
+		const auto entity = mRegistry.GetEntity(id);
+		if (!entity || !entity->mModel) return AABB();
+		const auto transform = mRegistry.mTransforms.Find(id);
+		return transform ? entity->mModel->mAABB.Transform(transform->mWorld) : entity->mModel->mAABB;
+	}
+	const auto& render = *found;
+	const auto renderIndex = mRegistry.mRenders.mIndices[id];
+	if (render.mEmitter || renderIndex >= mRenderState.mInstances.size()) {
+		return GetWorldBounds(id);
+	}
+	const auto& instance = mRenderState.mInstances[renderIndex];
+	const auto first = mRenderState.mBones.begin() + instance.mBoneOffset;
+	const std::vector<glm::mat4> bones(first, first + instance.mBoneCount);
+	return SkinModelBounds(*render.mModel, bones).Transform(glm::translate(instance.mWorld, render.mOffset));
+}
+
+EntityID Scene::RayCastSkinned(const glm::vec3& origin, const glm::vec3& dir, float maxDistance) const {
+	EntityID hit = InvalidEntityID;
+	const glm::vec3 invDir = 1.0f / dir;
+	SkinnedMesh skinned;
+	mSpatialIndex.RayCast(origin, dir, maxDistance, [&](EntityID id, float) {
+		const auto found = mRegistry.mRenders.Find(id);
+		if (!found) return maxDistance;
+		const auto& render = *found;
+		const auto renderIndex = mRegistry.mRenders.mIndices[id];
+		float distance;
+		if (render.mEmitter || renderIndex >= mRenderState.mInstances.size()) {
+			if (GetWorldBounds(id).IntersectsRay(origin, invDir, maxDistance, distance)) {
+				hit = id;
+				maxDistance = distance;
+			}
+			return maxDistance;
+		}
+		const auto& instance = mRenderState.mInstances[renderIndex];
+		const auto first = mRenderState.mBones.begin() + instance.mBoneOffset;
+		const std::vector<glm::mat4> bones(first, first + instance.mBoneCount);
+		const auto world = glm::translate(instance.mWorld, render.mOffset);
+		for (auto& modelMesh : render.mModel->mMeshes) {
+			if (modelMesh->mMesh->mHidden || !SkinMesh(*modelMesh->mMesh, bones, skinned, false)) continue;
+			// Test in mesh space, the affine transform keeps the ray parameter so distances compare across meshes
+			const auto toMesh = glm::inverse(world * modelMesh->mTransform);
+			const glm::vec3 meshOrigin = toMesh * glm::vec4(origin, 1.0f);
+			const glm::vec3 meshDir = toMesh * glm::vec4(dir, 0.0f);
+			if (RayCastSkinned(*modelMesh->mMesh, skinned, meshOrigin, meshDir, maxDistance, distance)) {
+				hit = id;
+				maxDistance = distance;
+			}
+		}
+		return maxDistance;
+	});
+	return hit;
+}
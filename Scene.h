@@ -1,284 +1,456 @@
-#pragma once
-
-#include "Main.h"
-#include "Model.h"
-#include "Shader.h"
-#include "btBulletDynamicsCommon.h"
-
-inline btVector3 cast_vec3(const glm::vec3& v) {
-	return btVector3(v[0], v[1], v[2]);
-}
-
-struct Scene;
-
-struct Entity {
-	typedef std::shared_ptr<Entity> Entity_;
-	ShaderProgram_ mShaderProgram;
-	Model_ mModel = nullptr;
-	glm::vec3 mPos = { 0,0,0 };
-	glm::vec3 mFront = { 0,0,1 };
-	glm::vec3 mUp = { 0,1,0 };
-	glm::quat mRot = { 1,0,0,0 };
-	glm::vec3 mScale = { 1,1,1 };
-	glm::mat4 mTransform = glm::identity<glm::mat4>();
-	AnimationController_ mAnimationController;
-	bool mControllable = false;
-	bool mUseGravity = false;
-	glm::vec3 mVelocity = { 0,0,0 };
-	glm::vec3 mGravity = { 0, -10, 0 };
-	bool mGrounded = false;
-	std::string mName;
-	Entity_ mAttachTo;
-	uint32_t mAttachToNode = -1;
-	btRigidBody* mRigidBody = nullptr;
-	glm::vec3 mTargetFront;
-	bool mTargetFrontEnable = false;
-
-	Entity() {}
-	Entity(Model_ model) : mModel(model) {}
-	Entity(Model_ model, const glm::vec3& pos) : mModel(model), mPos(pos) {}
-
-	virtual Entity_ Clone() const {
-		auto clone = std::make_shared<Entity>();
-		clone->mShaderProgram = mShaderProgram;
-		clone->mModel = mModel;
-		clone->mPos = mPos;
-		clone->mFront = mFront;
-		clone->mUp = mUp;
-		clone->mRot = mRot;
-		clone->mScale = mScale;
-		clone->mControllable = mControllable;
-		clone->mUseGravity = mUseGravity;
-		clone->mGravity = mGravity;
-		return clone;
-	}
-
-	virtual void Init(Scene& scene);
-
-	glm::vec3 mForce = { 0,0,0 };
-	float mMass = 1.0f;
-	float mStep = 1.0f / 60.0f;
-	float mAccum = 0.0f;
-	float mMaxVelocity = 100.0f;
-	glm::vec3 mPrevPos;
-	glm::quat mPrevRot;
-	std::deque<float> mHistoryY;
-
-	glm::vec3 GetGravity() {
-		return mUseGravity ? mGravity : glm::zero<glm::vec3>();
-	}
-
-	glm::vec3 GetForce() {
-		return GetGravity() + mForce;
-	}
-
-	float GetDampening() {
-		return mGrounded ? 2.0f : 1.0f;
-	}
-
-	void UpdatePhysics(float deltaTime) {
-		if (!mUseGravity) return;
-		mPrevPos = mPos;
-		mPrevRot = mRot;
-		mAccum += deltaTime;
-		if (mAccum < mStep) return;
-		while (mAccum >= mStep) {
-			UpdatePhysicsStep();
-			mAccum -= mStep;
-		}
-		if (mPos.y <= 0) {
-			mPos.y = 0;
-			if (!mGrounded && mForce.y < 0.001f) {
-				std::cout << "Grounded!" << std::endl;
-				mGrounded = true;
-				//mHistoryY.push_back(-0.5f);
-				//if (mHistoryY.size() > 200) mHistoryY.pop_front();
-			}
-		}
-		if (mPos.y > 0.0f) {
-			mHistoryY.push_back(mPos.y);
-			if (mHistoryY.size() > 200) mHistoryY.pop_front();
-		}
-	}
-
-	void UpdatePhysicsStep() {
-		//auto accel = GetForce() / mMass;
-		//mVelocity = accel;
-		//mPos += mVelocity * mStep;
-		//mPos.y = 1.0f + sin(absoluteTime);
-		/*mPos += mStep * (mVelocity + accel * mStep * 0.5f);
-		mVelocity += accel * mStep;
-		mVelocity = mVelocity / (1.0f + GetDampening() * mStep);*/
-		mVelocity = mVelocity + GetGravity() * mStep + mForce;
-		mPos = mPos + mVelocity * mStep;
-		mVelocity = mVelocity / (1.0f + GetDampening() * mStep);
-
-		auto velocity = glm::length(mVelocity);
-		if (velocity > mMaxVelocity) {
-			mVelocity = mVelocity * (mMaxVelocity / velocity);
-		}
-
-		mForce = { 0,0,0 };
-	}
-	
-	virtual void Update(float absoluteTime, float deltaTime) {
-		if (mTargetFrontEnable) {
-			auto turnSpeed = 50.0f; // FIXME
-
-			if (mRigidBody) {
-				auto rot = glm::slerp(mRot, glm::quatLookAt(-mTargetFront, mUp), deltaTime * turnSpeed);
-				//auto rot = glm::quatLookAt(-targetFront, selected->mUp);
-				auto cmt = mRigidBody->getCenterOfMassTransform();
-				cmt.setRotation(btQuaternion(rot.x, rot.y, rot.z, rot.w));
-				mRigidBody->setCenterOfMassTransform(cmt);
-			} else {
-				mFront = mTargetFront;
-				mRot = glm::quatLookAt(-mTargetFront, mUp);
-			}
-
-			if (glm::all(glm::epsilonEqual(mFront, mTargetFront, 0.001f))) {
-				mTargetFrontEnable = false;
-			}
-		}
-		if (mRigidBody) return;
-		UpdatePhysics(deltaTime);
-		auto lp = std::min(deltaTime, 1.0f);
-		auto pos = glm::lerp(mPrevPos, mPos, lp);
-		auto rot = glm::lerp(mPrevRot, mRot, lp);
-		mTransform = glm::translate(glm::identity<glm::mat4>(), pos);
-		mTransform *= glm::mat4_cast(rot);
-		mTransform = glm::scale(mTransform, mScale);
-		if (mAttachTo) {
-			if (mAttachToNode != -1) {
-				mTransform = mAttachTo->mTransform * mAttachTo->mAnimationController->mLocalTransforms[mAttachToNode] * mTransform; // FIXME: can be 1 frame behind
-			} else {
-				mTransform = mAttachTo->mTransform * mTransform;
-			}
-		}
-	}
-
-	virtual void UpdateAsync(float absoluteTime, float deltaTime) {
-		if (mAnimationController) {
-			mAnimationController->Update(absoluteTime);
-		}
-	}
-
-	void Move(const glm::vec3& v) {
-		if (mRigidBody) {
-			// FIXME!
-			mRigidBody->activate(true);
-			auto& v2 = mRigidBody->getLinearVelocity();
-			mRigidBody->setLinearVelocity(btVector3(v.x, v2.getY(), v.z));
-			return;
-		}
-		mPos += v;
-	}
-
-	void Walk(float f) {
-		if (mRigidBody) {
-			mRigidBody->setLinearVelocity(cast_vec3(mFront * f));
-			return;
-		}
-		mPos += mFront * f;
-	}
-
-	void Strafe(float f) {
-		if (mRigidBody) {
-			mRigidBody->setLinearVelocity(cast_vec3(glm::normalize(glm::cross(mFront, mUp)) * f));
-			return;
-		}
-		mPos += glm::normalize(glm::cross(mFront, mUp)) * f;
-	}
-
-	void Jump() {
-		if (mRigidBody) {
-			std::cout << "JumpJumpJump!" << std::endl;
-			mRigidBody->applyCentralForce(btVector3(0, 100, 0));
-			return;
-		}
-		if (!mGrounded) return;
-		std::cout << "JumpJumpJump!" << std::endl;
-		mForce = mGravity * -2.0f;
-		mGrounded = false;
-		//mHistoryY.push_back(-0.25f);
-		//if (mHistoryY.size() > 200) mHistoryY.pop_front();
-	}
-
-	virtual void Load(Scene& scene, const rapidjson::Value& cfg);
-};
-typedef std::shared_ptr<Entity> Entity_;
-
-struct ModelEntity : Entity {
-	virtual void Load(Scene& scene, const rapidjson::Value& cfg);
-};
-
-struct ParticleEntity : Entity {
-	virtual void Init(Scene& scene);
-	virtual void Load(Scene& scene, const rapidjson::Value& cfg);
-	virtual void Update(float absoluteTime, float deltaTime);
-};
-
-struct Scene {
-	typedef std::function<Entity_()> EntityConstructor;
-	std::vector<Entity_> mEntities;
-
-	btDiscreteDynamicsWorld* mDynamicsWorld = nullptr;
-
-	float mCameraDistance = 10.0f;
-	float mCameraRotationX = 0.0f;
-	float mCameraRotationY = 0.0f;
-
-	Entity_ mSelected;
-	size_t mSelectedIndex = -1;
-
-	Scene();
-
-	void Load(const std::string& fileName);
-
-	void Init() {
-		for (auto& entity : mEntities) {
-			entity->Init(*this);
-		}
-		SelectNext();
-	}
-
-	float mAccum = 0.0f;
-	float mStep = 1.0f / 60.0;
-	void Update(float absoluteTime, float deltaTime) {
-		mAccum += deltaTime;
-		while (mAccum >= mStep) {
-			mDynamicsWorld->stepSimulation(mStep);
-			mAccum -= mStep;
-		}
-		std::for_each(std::execution::par, mEntities.begin(), mEntities.end(), [absoluteTime, deltaTime](auto& entity) {
-			entity->UpdateAsync(absoluteTime, deltaTime);
-		});
-		for (auto& entity : mEntities) {
-			entity->Update(absoluteTime, deltaTime);
-		}
-	}
-
-	Entity_ Find(const std::string& name) const {
-		for (const auto& entity : mEntities) {
-			if (entity->mName == name) return entity;
-		}
-		return nullptr;
-	}
-
-	std::map<std::string, EntityConstructor> mTypes;
-	void Register(const std::string& type, EntityConstructor constructor) {
-		mTypes[type] = constructor;
-	}
-
-	void SelectNext() {
-		mSelectedIndex++;
-		if (mSelectedIndex > mEntities.size()) {
-			mSelectedIndex = 0;
-		}
-		mSelected = mSelectedIndex < mEntities.size() ? mEntities[mSelectedIndex] : nullptr;
-		if (nullptr != mSelected) {
-			mCameraDistance = glm::length(mSelected->mModel->mAABB.mHalfSize) * 2.0f; // FIXME
-		}
-	}
-};
-typedef std::shared_ptr<Scene> Scene_;
+#pragma once
+
+#include "Main.h"
+#include "Model.h"
+#include "Shader.h"
+#include "Components.h"
+#include "SpatialIndex.h"
+#include "Pool.h"
+#include "Profiler.h"
+#include "btBulletDynamicsCommon.h"
+
+inline btVector3 cast_vec3(const glm::vec3& v) {
+	return btVector3(v[0], v[1], v[2]);
+}
+
+struct Scene;
+struct Prefab;
+
+// Transform, velocity, render and animation state lives in the scene's
+// EntityRegistry, Entity keeps the authoring data and gameplay behaviour.
+struct Entity {
+	typedef std::shared_ptr<Entity> Entity_;
+	EntityRegistry* mRegistry = nullptr;
+	EntityID mID = InvalidEntityID;
+	ShaderProgram_ mShaderProgram;
+	Model_ mModel = nullptr;
+	glm::vec3 mFront = { 0,0,1 };
+	glm::vec3 mUp = { 0,1,0 };
+	AnimationController_ mAnimationController;
+	ParticleEmitter_ mEmitter;
+	bool mControllable = false;
+	bool mUpdate = false; // Update is only called for entities with behaviour
+	size_t mUpdateIndex = -1; // slot in Scene::mUpdateEntities while mUpdate and alive
+	std::string mName;
+	btRigidBody* mRigidBody = nullptr; // pooled, see Scene::CreateRigidBody
+	btCollisionShape* mCollisionShape = nullptr; // shared, owned by the scene
+	Prefab* mPrefab = nullptr; // set for pooled instances, see Scene::Spawn
+	bool mDespawned = false;
+	float mMass = 10.0f;
+	glm::vec3 mTargetFront;
+	bool mTargetFrontEnable = false;
+	std::deque<float> mHistoryY;
+
+	Entity(const Entity&) = delete;
+	Entity& operator=(const Entity&) = delete;
+	Entity() {}
+	Entity(Model_ model) : mModel(model) {}
+	virtual ~Entity() {
+		assert(!mRigidBody); // released with Scene::DestroyRigidBody
+		if (mRegistry) mRegistry->Destroy(mID);
+	}
+
+	void Register(EntityRegistry& registry) {
+		assert(!mRegistry);
+		mRegistry = &registry;
+		mID = registry.Create(this);
+	}
+
+	virtual Entity_ Clone(Scene& scene, EntityRegistry& registry) const;
+
+	virtual void Init(Scene& scene);
+
+	// Adds/removes the components and rigid body that are dropped while a
+	// pooled instance waits to be spawned again
+	void Enable(Scene& scene);
+	void Disable(Scene& scene);
+
+	TransformComponent& GetTransform() const {
+		return mRegistry->mTransforms.Get(mID);
+	}
+
+	bool GetUseGravity() const {
+		return mRegistry->mBodies.Has(mID);
+	}
+
+	void SetUseGravity(bool useGravity) {
+		if (!useGravity) {
+			mRegistry->mBodies.Remove(mID);
+		} else if (!GetUseGravity()) {
+			mRegistry->mBodies.Add(mID);
+		}
+	}
+
+	glm::vec3 GetGravity() const {
+		return GetUseGravity() ? mRegistry->mBodies.GetGravity(mID) : BodyArray::DefaultGravity;
+	}
+
+	void SetForce(const glm::vec3& force) {
+		mRegistry->mBodies.SetForce(mID, force);
+	}
+
+	AABB GetWorldBounds() const {
+		const auto& world = GetTransform().mWorld;
+		return mModel ? mModel->mAABB.Transform(world) : AABB(glm::vec3(world[3]), { 0,0,0 });
+	}
+
+	virtual void Update(float absoluteTime, float deltaTime) {
+		if (mTargetFrontEnable) {
+			auto turnSpeed = 50.0f; // FIXME
+			auto& transform = GetTransform();
+
+			if (mRigidBody) {
+				auto rot = glm::slerp(transform.mRot, glm::quatLookAt(-mTargetFront, mUp), deltaTime * turnSpeed);
+				//auto rot = glm::quatLookAt(-targetFront, selected->mUp);
+				auto cmt = mRigidBody->getCenterOfMassTransform();
+				cmt.setRotation(btQuaternion(rot.x, rot.y, rot.z, rot.w));
+				mRigidBody->setCenterOfMassTransform(cmt);
+			} else {
+				mFront = mTargetFront;
+				transform.mRot = glm::quatLookAt(-mTargetFront, mUp);
+				transform.mDirty = true;
+			}
+
+			if (glm::all(glm::epsilonEqual(mFront, mTargetFront, 0.001f))) {
+				mTargetFrontEnable = false;
+			}
+		}
+	}
+
+	void Move(const glm::vec3& v) {
+		if (mRigidBody) {
+			// FIXME!
+			mRigidBody->activate(true);
+			auto& v2 = mRigidBody->getLinearVelocity();
+			mRigidBody->setLinearVelocity(btVector3(v.x, v2.getY(), v.z));
+			return;
+		}
+		auto& transform = GetTransform();
+		transform.mPos += v;
+		transform.mDirty = true;
+	}
+
+	void Walk(float f) {
+		if (mRigidBody) {
+			mRigidBody->setLinearVelocity(cast_vec3(mFront * f));
+			return;
+		}
+		auto& transform = GetTransform();
+		transform.mPos += mFront * f;
+		transform.mDirty = true;
+	}
+
+	void Strafe(float f) {
+		if (mRigidBody) {
+			mRigidBody->setLinearVelocity(cast_vec3(glm::normalize(glm::cross(mFront, mUp)) * f));
+			return;
+		}
+		auto& transform = GetTransform();
+		transform.mPos += glm::normalize(glm::cross(mFront, mUp)) * f;
+		transform.mDirty = true;
+	}
+
+	void Jump() {
+		if (mRigidBody) {
+			std::cout << "JumpJumpJump!" << std::endl;
+			mRigidBody->applyCentralForce(btVector3(0, 100, 0));
+			return;
+		}
+		auto& bodies = mRegistry->mBodies;
+		if (!bodies.Has(mID) || !bodies.IsGrounded(mID)) return;
+		std::cout << "JumpJumpJump!" << std::endl;
+		bodies.SetForce(mID, bodies.GetGravity(mID) * -2.0f);
+		bodies.SetGrounded(mID, false);
+		//mHistoryY.push_back(-0.25f);
+		//if (mHistoryY.size() > 200) mHistoryY.pop_front();
+	}
+
+	virtual void Load(Scene& scene, const rapidjson::Value& cfg);
+};
+typedef std::shared_ptr<Entity> Entity_;
+
+struct EntityMotionState : public btMotionState {
+	Entity* mEntity = nullptr;
+	EntityMotionState(Entity* entity) : mEntity(entity) {}
+	virtual void getWorldTransform(btTransform& worldTrans) const;
+	virtual void setWorldTransform(const btTransform& worldTrans);
+};
+
+struct ModelEntity : Entity {
+	virtual void Load(Scene& scene, const rapidjson::Value& cfg);
+};
+
+// Emitter config is read from the "emitter" object, clones share the emitter
+struct ParticleEntity : Entity {
+	virtual void Load(Scene& scene, const rapidjson::Value& cfg);
+};
+
+// Spawned instances of a prefab are recycled through a free list instead of
+// being destroyed, so spawning only allocates while the pool grows
+struct Prefab {
+	Entity_ mTemplate; // in Scene::mTemplates, loaded but never initialized
+	std::vector<Entity_> mInstances;
+	std::vector<Entity*> mFree;
+};
+
+// Snapshot of the component data the renderer needs, taken at the end of
+// Scene::Update. Instances are indexed like mRegistry.mRenders.
+struct RenderState {
+	struct Instance {
+		glm::mat4 mWorld; // translation interpolated between the last two physics steps, rotation is the latest
+		uint32_t mBoneOffset = 0;
+		uint32_t mBoneCount = 0;
+	};
+	std::vector<Instance> mInstances;
+	std::vector<glm::mat4> mBones;
+	std::vector<glm::vec3> mOffsets; // per transform scratch
+};
+
+struct Scene {
+	typedef std::function<Entity_()> EntityConstructor;
+	EntityRegistry mRegistry; // must outlive mEntities
+	std::vector<Entity_> mEntities;
+	std::vector<Entity*> mUpdateEntities;
+	std::unordered_map<std::string, Entity_> mNames; // first entity with the name
+	EntityRegistry mTemplates; // prefab templates only, the systems never see it, must outlive mPrefabs
+	std::unordered_map<std::string, Prefab> mPrefabs;
+
+	std::unique_ptr<btDefaultCollisionConfiguration> mCollisionConfiguration;
+	std::unique_ptr<btCollisionDispatcher> mDispatcher;
+	std::unique_ptr<btBroadphaseInterface> mBroadphase;
+	std::unique_ptr<btConstraintSolver> mSolverPool; // multithreaded world only
+	std::unique_ptr<btConstraintSolver> mSolver;
+	std::unique_ptr<btDiscreteDynamicsWorld> mDynamicsWorld;
+	std::unique_ptr<btMotionState> mGroundMotionState;
+	std::unique_ptr<btRigidBody> mGround;
+	std::map<std::tuple<int, float, float, float>, std::unique_ptr<btCollisionShape>> mShapes;
+	Pool<EntityMotionState> mMotionStates;
+	Pool<btRigidBody> mRigidBodies;
+	int mPhysicsThreads = 0; // 0 = single threaded world
+	int mForcePhysicsThreads = -1; // set before Load to override the scene's physics threads, 0 = single threaded world
+	float mPhysicsTime = 0.0f; // ms spent stepping bullet last frame
+	SpatialIndex<EntityID> mSpatialIndex;
+	RenderState mRenderState;
+
+	float mCameraDistance = 10.0f;
+	float mCameraRotationX = 0.0f;
+	float mCameraRotationY = 0.0f;
+
+	Entity_ mSelected;
+	size_t mSelectedIndex = -1;
+
+	Scene();
+	~Scene() {
+		StopWorker();
+		for (auto& entity : mEntities) {
+			DestroyRigidBody(*entity);
+		}
+		for (auto& prefab : mPrefabs) {
+			for (auto& entity : prefab.second.mInstances) {
+				DestroyRigidBody(*entity);
+			}
+		}
+		DestroyDynamicsWorld();
+	}
+
+	void Load(const std::string& fileName);
+	void CreateDynamicsWorld(bool multithreaded, int threads);
+	void DestroyDynamicsWorld();
+	btCollisionShape* GetShape(int type, const glm::vec3& size);
+	MeshMemoryStats GetMeshMemoryStats() const;
+	btRigidBody* CreateRigidBody(Entity& entity);
+	void DestroyRigidBody(Entity& entity);
+
+	void Init() {
+		if (!mDynamicsWorld) {
+			CreateDynamicsWorld(false, 0);
+		}
+		for (auto& entity : mEntities) {
+			InitEntity(entity);
+		}
+		SelectNext();
+	}
+
+	void InitEntity(const Entity_& entity) {
+		entity->Init(*this);
+		if (entity->mUpdate) {
+			entity->mUpdateIndex = mUpdateEntities.size();
+			mUpdateEntities.push_back(entity.get());
+		}
+	}
+
+	void Add(const Entity_& entity) {
+		InitEntity(entity);
+		Insert(entity);
+	}
+
+	void Insert(const Entity_& entity) {
+		mEntities.push_back(entity);
+		if (!entity->mName.empty()) {
+			mNames.emplace(entity->mName, entity);
+		}
+	}
+
+	// Takes an instance from the prefab pool, falls back to cloning the scene
+	// entity with that name. ttl <= 0 keeps the instance until Despawn.
+	Entity* Spawn(const std::string& name, const glm::vec3& pos, const glm::quat& rot, float ttl = 0.0f);
+	void Despawn(Entity& entity);
+
+	Entity_ Create(const std::string& type) {
+		return Create(type, mRegistry);
+	}
+
+	Entity_ Create(const std::string& type, EntityRegistry& registry) {
+		auto entity = mTypes[type]();
+		entity->Register(registry);
+		return entity;
+	}
+
+	float mAccum = 0.0f;
+	float mStep = 1.0f / 60.0;
+	float mAlpha = 0.0f; // accumulator remainder in steps, used to interpolate the render state
+
+	// In async mode the simulation of the next frame runs on a worker while the
+	// current one is drawn from mRenderState, so physics results show up one
+	// frame later. The worker is a single thread for the lifetime of the scene,
+	// Bullet gives every thread that ever steps a world its own slot and a new
+	// thread per frame would run out of them.
+	bool mAsyncUpdate = false;
+	std::thread mWorker;
+	std::mutex mWorkerMutex;
+	std::condition_variable mWorkerCondition;
+	bool mWorkerBusy = false; // a simulation is queued or running
+	bool mWorkerExit = false;
+	float mWorkerAbsoluteTime = 0.0f;
+	float mWorkerDeltaTime = 0.0f;
+	std::exception_ptr mWorkerError; // rethrown by Sync
+
+	// Waits for the async simulation, entities must not be touched before this
+	void Sync() {
+		PROFILE_SCOPE("Scene::Sync");
+		std::unique_lock<std::mutex> lock(mWorkerMutex);
+		mWorkerCondition.wait(lock, [this]() { return !mWorkerBusy; });
+		if (mWorkerError) {
+			std::rethrow_exception(std::exchange(mWorkerError, nullptr));
+		}
+	}
+
+	void StartSimulation(float absoluteTime, float deltaTime) {
+		{
+			std::lock_guard<std::mutex> lock(mWorkerMutex);
+			assert(!mWorkerBusy);
+			mWorkerAbsoluteTime = absoluteTime;
+			mWorkerDeltaTime = deltaTime;
+			mWorkerBusy = true;
+		}
+		mWorkerCondition.notify_all();
+	}
+
+	void RunWorker();
+	void StopWorker();
+
+	void Update(float absoluteTime, float deltaTime) {
+		PROFILE_SCOPE("Scene::Update");
+		Sync();
+		if (!mAsyncUpdate) {
+			Simulate(absoluteTime, deltaTime);
+		}
+		UpdateLifetimes(deltaTime);
+		for (auto entity : mUpdateEntities) {
+			entity->Update(absoluteTime, deltaTime);
+		}
+		if (mSelected && !mSelected->mUpdate) {
+			mSelected->Update(absoluteTime, deltaTime);
+		}
+		UpdateTransforms();
+		UpdateSpatialIndex();
+		UpdateHistory();
+		UpdateRenderState();
+		if (mAsyncUpdate) {
+			StartSimulation(absoluteTime, deltaTime);
+		}
+	}
+
+	// Component systems, see Scene.cpp
+	void Simulate(float absoluteTime, float deltaTime);
+	void UpdateAnimations(float absoluteTime);
+	void UpdateBodies(size_t steps);
+	void UpdateTransforms();
+	void UpdateSpatialIndex();
+	void UpdateRenderState();
+	void UpdateLifetimes(float deltaTime);
+
+	void UpdateHistory() {
+		if (!mSelected) return;
+		const auto y = mSelected->GetTransform().mPos.y;
+		if (y > 0.0f) {
+			mSelected->mHistoryY.push_back(y);
+			if (mSelected->mHistoryY.size() > 200) mSelected->mHistoryY.pop_front();
+		}
+	}
+
+	AABB GetWorldBounds(EntityID id) const {
+		const auto& render = mRegistry.mRenders.Get(id);
+		const auto& world = mRegistry.mTransforms.Get(id).mWorld;
+		return render.mModel->mAABB.Transform(glm::translate(world, render.mOffset));
+	}
+
+	template<typename T>
+	void QueryFrustum(const Frustum& frustum, T& result) const {
+		mSpatialIndex.QueryFrustum(frustum, [&result](EntityID id) {
+			result.push_back(id);
+			return true;
+		});
+	}
+
+	template<typename T>
+	void QueryRadius(const glm::vec3& center, float radius, T& result) const {
+		mSpatialIndex.QueryRadius(center, radius, [&](EntityID id) {
+			if (GetWorldBounds(id).Intersects(center, radius)) {
+				result.push_back(id);
+			}
+			return true;
+		});
+	}
+
+	// Closest entity whose world bounds are hit by the ray
+	EntityID RayCast(const glm::vec3& origin, const glm::vec3& dir, float maxDistance = 1000.0f) const {
+		EntityID hit = InvalidEntityID;
+		const glm::vec3 invDir = 1.0f / dir;
+		mSpatialIndex.RayCast(origin, dir, maxDistance, [&](EntityID id, float) {
+			float distance;
+			if (GetWorldBounds(id).IntersectsRay(origin, invDir, maxDistance, distance)) {
+				hit = id;
+				maxDistance = distance;
+			}
+			return maxDistance;
+		});
+		return hit;
+	}
+
+	// Bounds and ray casts against the current pose, skinned on the CPU, see Skinning.h
+	AABB GetSkinnedBounds(EntityID id) const;
+	EntityID RayCastSkinned(const glm::vec3& origin, const glm::vec3& dir, float maxDistance = 1000.0f) const;
+
+	Entity_ Find(const std::string& name) const {
+		const auto it = mNames.find(name);
+		return it != mNames.end() ? it->second : nullptr;
+	}
+
+	std::map<std::string, EntityConstructor> mTypes;
+	void Register(const std::string& type, EntityConstructor constructor) {
+		mTypes[type] = constructor;
+	}
+
+	void SelectNext() {
+		mSelectedIndex++;
+		if (mSelectedIndex > mEntities.size()) {
+			mSelectedIndex = 0;
+		}
+		mSelected = mSelectedIndex < mEntities.size() ? mEntities[mSelectedIndex] : nullptr;
+		if (nullptr != mSelected && mSelected->mModel) {
+			mCameraDistance = glm::length(mSelected->mModel->mAABB.mHalfSize) * 2.0f; // FIXME
+		}
+	}
+};
+typedef std::shared_ptr<Scene> Scene_;
@@ -1,3 +1,141 @@
-#include "Shader.h"
-
-std::map<std::string, ShaderProgram_> ShaderProgram::sShaderPrograms;
+#include "Shader.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+std::map<std::string, ShaderProgram_> ShaderProgram::sShaderPrograms;
+
+// cache/shaders/<name>-<variant>-<contents>.bin, the variant hashes the defines
+std::string ShaderProgram::GetBinaryCachePath(const std::string& name, const ShaderDefines& defines, const std::string& source) {
+	auto key = source;
+	for (auto info : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		key += (const char*)glGetString(info);
+	}
+	std::stringstream path;
+	path << "cache/shaders/" << name << "-" << std::hex << HashString(defines.GetKey()) << "-" << HashString(key) << ".bin";
+	return path.str();
+}
+
+// Removes the binaries of the same variant built from older sources or drivers
+static void PruneBinaries(const std::string& path) {
+	const auto file = std::filesystem::path(path);
+	const auto fileName = file.filename().string();
+	const auto prefix = fileName.substr(0, fileName.rfind('-') + 1);
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(file.parent_path(), error)) {
+		const auto name = entry.path().filename().string();
+		if (name != fileName && name.compare(0, prefix.size(), prefix) == 0 && entry.path().extension() == ".bin") {
+			std::filesystem::remove(entry.path(), error);
+		}
+	}
+}
+
+// Returns 0 if there is no usable binary
+GLuint ShaderProgram::LoadBinary(const std::string& path) {
+#ifdef GL_VERSION_4_1
+	if (!GLAD_GL_VERSION_4_1) return 0;
+	std::ifstream stream(path, std::ios::binary);
+	if (!stream.is_open()) return 0;
+	GLenum format = 0;
+	stream.read((char*)&format, sizeof(format));
+	std::vector<char> binary((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	if (binary.empty()) return 0;
+
+	const auto id = glCreateProgram();
+	glProgramBinary(id, format, binary.data(), (GLsizei)binary.size());
+	GLint status = 0;
+	glGetProgramiv(id, GL_LINK_STATUS, &status);
+	if (!status) {
+		std::cerr << "Warning: Shader program binary rejected, recompiling: " << path << std::endl;
+		glDeleteProgram(id);
+		return 0;
+	}
+	return id;
+#else
+	return 0;
+#endif
+}
+
+void ShaderProgram::SaveBinary(GLuint id, const std::string& path) {
+#ifdef GL_VERSION_4_1
+	if (!GLAD_GL_VERSION_4_1) return;
+	GLint length = 0;
+	glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(id, length, nullptr, &format, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+	std::ofstream stream(path, std::ios::binary);
+	if (!stream.is_open()) {
+		std::cerr << "Warning: Could not write shader program cache: " << path << std::endl;
+		return;
+	}
+	stream.write((const char*)&format, sizeof(format));
+	stream.write(binary.data(), binary.size());
+	stream.close();
+	if (stream) {
+		PruneBinaries(path);
+	}
+#endif
+}
+
+// shaders/<name>.<stage>.glsl
+static std::string GetProgramName(const std::string& fileName) {
+	return fileName.substr(0, fileName.find('.'));
+}
+
+ShaderWatcher::ShaderWatcher() {
+#ifdef __linux__
+	mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mFd < 0 || inotify_add_watch(mFd, "shaders", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		std::cerr << "Warning: Could not watch shaders/, hot reload disabled" << std::endl;
+	}
+#else
+	for (const auto& entry : std::filesystem::directory_iterator("shaders")) {
+		mWriteTimes[entry.path().string()] = entry.last_write_time();
+	}
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher() {
+#ifdef __linux__
+	if (mFd >= 0) close(mFd);
+#endif
+}
+
+void ShaderWatcher::Update() {
+	std::set<std::string> changed;
+#ifdef __linux__
+	if (mFd < 0) return;
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(mFd, buffer, sizeof(buffer))) > 0) {
+		for (char* ptr = buffer; ptr < buffer + length;) {
+			const auto event = (const inotify_event*)ptr;
+			if (event->len) {
+				changed.insert(GetProgramName(event->name));
+			}
+			ptr += sizeof(inotify_event) + event->len;
+		}
+	}
+#else
+	const auto now = GetTime();
+	if (now < mNextPoll) return;
+	mNextPoll = now + 0.5f;
+	for (const auto& entry : std::filesystem::directory_iterator("shaders")) {
+		auto& writeTime = mWriteTimes[entry.path().string()];
+		if (writeTime != entry.last_write_time()) {
+			writeTime = entry.last_write_time();
+			changed.insert(GetProgramName(entry.path().filename().string()));
+		}
+	}
+#endif
+	for (const auto& name : changed) {
+		ShaderProgram::Reload(name);
+	}
+}
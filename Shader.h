@@ -1,118 +1,253 @@
-#pragma once
-
-#include "Main.h"
-
-struct Shader {
-	GLuint mID = 0;
-	GLenum mType;
-
-	Shader(const std::string& path, GLenum type) : mType(type) {
-		mID = glCreateShader(type);
-		Load(path);
-	}
-
-	~Shader() {
-		glDeleteShader(mID);
-	}
-
-	void Load(const std::string& path) {
-		std::cout << "Loading shader: " << path << "..." << std::endl;
-
-		const auto source = ReadFile(path);
-
-		const char* sourcePtr = source.c_str();
-		glShaderSource(mID, 1, &sourcePtr, NULL);
-		glCompileShader(mID);
-
-		GLint status = 0;
-		GLint infoLogLength = 0;
-		glGetShaderiv(mID, GL_COMPILE_STATUS, &status);
-		glGetShaderiv(mID, GL_INFO_LOG_LENGTH, &infoLogLength);
-
-		if (infoLogLength > 0) {
-			std::string message;
-			message.resize(infoLogLength + 1);
-			glGetShaderInfoLog(mID, infoLogLength, NULL, &message[0]);
-			throw new std::runtime_error(message);
-		}
-
-		std::cout << "Shader loaded: " << path << std::endl;
-	}
-};
-typedef std::shared_ptr<Shader> Shader_;
-
-struct ShaderProgram {
-	typedef std::shared_ptr<ShaderProgram> ShaderProgram_;
-	static std::map<std::string, ShaderProgram_> sShaderPrograms;
-	GLuint mID = 0;
-	GLuint uProj;
-	GLuint uView;
-	GLuint uModel;
-	GLuint uBones;
-	GLuint uLightPos;
-	GLuint uViewPos;
-	GLuint uLightColor;
-	GLuint uTime;
-
-	ShaderProgram(const std::vector<Shader_>& shaders) {
-		mID = glCreateProgram();
-		for (auto& shader : shaders) {
-			glAttachShader(mID, shader->mID);
-		}
-		glLinkProgram(mID);
-
-		GLint status = 0;
-		GLint infoLogLength = 0;
-		glGetProgramiv(mID, GL_LINK_STATUS, &status);
-		glGetProgramiv(mID, GL_INFO_LOG_LENGTH, &infoLogLength);
-		if (infoLogLength > 0) {
-			std::string message;
-			message.resize(infoLogLength + 1);
-			glGetProgramInfoLog(mID, infoLogLength, NULL, &message[0]);
-			throw new std::runtime_error(message);
-		}
-
-		for (auto& shader : shaders) {
-			glDetachShader(mID, shader->mID);
-		}
-
-		uProj = glGetUniformLocation(mID, "uProj");
-		uView = glGetUniformLocation(mID, "uView");
-		uModel = glGetUniformLocation(mID, "uModel");
-		uBones = glGetUniformLocation(mID, "uBones");
-		uLightPos = glGetUniformLocation(mID, "uLightPos");
-		uViewPos = glGetUniformLocation(mID, "uViewPos");
-		uLightColor = glGetUniformLocation(mID, "uLightColor");
-		uTime = glGetUniformLocation(mID, "uTime");
-	}
-	~ShaderProgram() {
-		glDeleteProgram(mID);
-	}
-
-	static ShaderProgram_ Load(const std::string& name) {
-		auto it = sShaderPrograms.find(name);
-		if (it != sShaderPrograms.end()) return it->second;
-		auto shaderProgram = Create(name);
-		sShaderPrograms[name] = shaderProgram;
-		return shaderProgram;
-	}
-
-	static ShaderProgram_ Create(const std::string& name) {
-		auto getType = [](const auto& type) {
-			if (type == "vert") return GL_VERTEX_SHADER;
-			if (type == "frag") return GL_FRAGMENT_SHADER;
-			if (type == "geom") return GL_GEOMETRY_SHADER;
-			throw new std::invalid_argument("Unknown shader type");
-		};
-		std::vector<Shader_> shaders;
-		for (const auto& type : { "vert", "geom", "frag" }) {
-			const auto file = "shaders/" + name + "." + type + ".glsl";
-			if (!std::filesystem::exists(file)) continue;
-			shaders.push_back(std::make_shared<Shader>(file, getType(type)));
-		}
-		assert(!shaders.empty());
-		return std::make_shared<ShaderProgram>(shaders);
-	}
-
-};
-typedef ShaderProgram::ShaderProgram_ ShaderProgram_;
+#pragma once
+
+#include "Main.h"
+#include "UniformBuffer.h"
+
+struct Shader {
+	GLuint mID = 0;
+	GLenum mType;
+
+	Shader(const std::string& path, GLenum type, const std::string& source) : mType(type) {
+		mID = glCreateShader(type);
+		try {
+			Load(path, source);
+		} catch (...) {
+			glDeleteShader(mID); // the destructor does not run for a throwing constructor
+			throw;
+		}
+	}
+
+	~Shader() {
+		glDeleteShader(mID);
+	}
+
+	// path is only used for messages, source may differ from the file by injected defines
+	void Load(const std::string& path, const std::string& source) {
+		std::cout << "Loading shader: " << path << "..." << std::endl;
+
+		const char* sourcePtr = source.c_str();
+		glShaderSource(mID, 1, &sourcePtr, NULL);
+		glCompileShader(mID);
+
+		GLint status = 0;
+		GLint infoLogLength = 0;
+		glGetShaderiv(mID, GL_COMPILE_STATUS, &status);
+		glGetShaderiv(mID, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+		if (infoLogLength > 0) {
+			std::string message;
+			message.resize(infoLogLength + 1);
+			glGetShaderInfoLog(mID, infoLogLength, NULL, &message[0]);
+			throw std::runtime_error(message);
+		}
+
+		std::cout << "Shader loaded: " << path << std::endl;
+	}
+};
+typedef std::shared_ptr<Shader> Shader_;
+
+// Compile time defines of a program variant, e.g. SKINNED or MAX_BONES=64.
+// Kept sorted so equal sets share one program regardless of the order in
+// which they were set.
+struct ShaderDefines {
+	std::map<std::string, std::string> mValues;
+
+	ShaderDefines() {}
+	ShaderDefines(std::initializer_list<std::string> names) {
+		for (const auto& name : names) mValues[name];
+	}
+
+	ShaderDefines& Set(const std::string& name, const std::string& value = "") {
+		mValues[name] = value;
+		return *this;
+	}
+
+	ShaderDefines& Set(const std::string& name, int value) {
+		return Set(name, std::to_string(value));
+	}
+
+	bool Has(const std::string& name) const {
+		return mValues.count(name) > 0;
+	}
+
+	bool IsEmpty() const {
+		return mValues.empty();
+	}
+
+	// "MAX_BONES=64,SKINNED"
+	std::string GetKey() const {
+		std::string key;
+		for (const auto& define : mValues) {
+			if (!key.empty()) key += ",";
+			key += define.second.empty() ? define.first : define.first + "=" + define.second;
+		}
+		return key;
+	}
+
+	// Inserted after the #version line of every stage
+	std::string GetSource() const {
+		std::string source;
+		for (const auto& define : mValues) {
+			source += "#define " + define.first + " " + define.second + "\n";
+		}
+		return source;
+	}
+};
+
+struct ShaderProgram {
+	typedef std::shared_ptr<ShaderProgram> ShaderProgram_;
+	static std::map<std::string, ShaderProgram_> sShaderPrograms;
+	GLuint mID = 0;
+	std::string mName;
+	ShaderDefines mDefines;
+	GLint uBones = -1;
+
+	ShaderProgram(GLuint id) : mID(id) {
+		GetUniformLocations();
+	}
+
+	ShaderProgram(const std::vector<Shader_>& shaders) {
+		mID = glCreateProgram();
+		for (auto& shader : shaders) {
+			glAttachShader(mID, shader->mID);
+		}
+#ifdef GL_VERSION_4_1
+		if (GLAD_GL_VERSION_4_1) glProgramParameteri(mID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+		glLinkProgram(mID);
+
+		GLint status = 0;
+		GLint infoLogLength = 0;
+		glGetProgramiv(mID, GL_LINK_STATUS, &status);
+		glGetProgramiv(mID, GL_INFO_LOG_LENGTH, &infoLogLength);
+		if (infoLogLength > 0) {
+			std::string message;
+			message.resize(infoLogLength + 1);
+			glGetProgramInfoLog(mID, infoLogLength, NULL, &message[0]);
+			glDeleteProgram(mID);
+			throw std::runtime_error(message);
+		}
+
+		for (auto& shader : shaders) {
+			glDetachShader(mID, shader->mID);
+		}
+
+		GetUniformLocations();
+	}
+
+	void GetUniformLocations() {
+		uBones = glGetUniformLocation(mID, "uBones");
+		for (const auto& block : { std::make_pair("Frame", FrameBinding), std::make_pair("Draw", DrawBinding), std::make_pair("Material", MaterialBinding) }) {
+			const auto index = glGetUniformBlockIndex(mID, block.first);
+			if (index != GL_INVALID_INDEX) glUniformBlockBinding(mID, index, block.second);
+		}
+	}
+	~ShaderProgram() {
+		glDeleteProgram(mID);
+	}
+
+	// Programs are cached per name and define set
+	static ShaderProgram_ Load(const std::string& name, const ShaderDefines& defines = {}) {
+		const auto key = defines.IsEmpty() ? name : name + "|" + defines.GetKey();
+		auto it = sShaderPrograms.find(key);
+		if (it != sShaderPrograms.end()) return it->second;
+		auto shaderProgram = Create(name, defines);
+		sShaderPrograms[key] = shaderProgram;
+		return shaderProgram;
+	}
+
+	// Linked programs are cached with glGetProgramBinary. The cache file name
+	// hashes the sources and the driver strings, so edits and driver updates
+	// miss the cache, a binary the driver rejects falls back to compiling.
+	// Saving a binary deletes the older ones of the same variant.
+	static ShaderProgram_ Create(const std::string& name, const ShaderDefines& defines = {}) {
+		auto getType = [](const auto& type) {
+			if (type == "vert") return GL_VERTEX_SHADER;
+			if (type == "frag") return GL_FRAGMENT_SHADER;
+			if (type == "geom") return GL_GEOMETRY_SHADER;
+			throw std::invalid_argument("Unknown shader type");
+		};
+		struct Stage {
+			std::string mFile;
+			GLenum mType;
+			std::string mSource;
+		};
+		std::vector<Stage> stages;
+		std::string source;
+		for (const auto& type : { "vert", "geom", "frag" }) {
+			const auto file = "shaders/" + name + "." + type + ".glsl";
+			if (!std::filesystem::exists(file)) continue;
+			stages.push_back({ file, getType(type), AddDefines(ReadFile(file), defines) });
+			source += stages.back().mSource;
+		}
+		assert(!stages.empty());
+
+		ShaderProgram_ shaderProgram;
+		const auto cachePath = GetBinaryCachePath(name, defines, source);
+		if (auto id = LoadBinary(cachePath)) {
+			std::cout << "Shader program loaded from cache: " << cachePath << std::endl;
+			shaderProgram = std::make_shared<ShaderProgram>(id);
+		} else {
+			std::vector<Shader_> shaders;
+			for (const auto& stage : stages) {
+				shaders.push_back(std::make_shared<Shader>(stage.mFile, stage.mType, stage.mSource));
+			}
+			shaderProgram = std::make_shared<ShaderProgram>(shaders);
+			SaveBinary(shaderProgram->mID, cachePath);
+		}
+		shaderProgram->mName = name;
+		shaderProgram->mDefines = defines;
+		return shaderProgram;
+	}
+
+	static std::string AddDefines(const std::string& source, const ShaderDefines& defines) {
+		if (defines.IsEmpty()) return source;
+		const auto lines = defines.GetSource();
+		const auto version = source.find("#version");
+		const auto pos = version == std::string::npos ? 0 : source.find('\n', version) + 1;
+		return source.substr(0, pos) + lines + source.substr(pos);
+	}
+
+	// Recompiles every loaded variant of the program and swaps it into the
+	// existing object, so every holder of the program (including raw pointers
+	// in render components) sees the new one. A failed compile keeps the old
+	// program.
+	static void Reload(const std::string& name) {
+		for (auto& entry : sShaderPrograms) {
+			auto& oldProgram = entry.second;
+			if (oldProgram->mName != name) continue;
+			ShaderProgram_ shaderProgram;
+			try {
+				shaderProgram = Create(name, oldProgram->mDefines);
+			} catch (const std::exception& e) {
+				std::cerr << "Shader reload failed, keeping the old program: " << entry.first << std::endl << e.what() << std::endl;
+				continue;
+			}
+			std::swap(oldProgram->mID, shaderProgram->mID);
+			oldProgram->GetUniformLocations();
+			std::cout << "Shader reloaded: " << entry.first << std::endl;
+		}
+	}
+
+	static std::string GetBinaryCachePath(const std::string& name, const ShaderDefines& defines, const std::string& source);
+	static GLuint LoadBinary(const std::string& path);
+	static void SaveBinary(GLuint id, const std::string& path);
+
+};
+typedef ShaderProgram::ShaderProgram_ ShaderProgram_;
+
+// Watches shaders/ and reloads the programs of changed files. Update is called
+// once per frame from the render thread, so the swap happens at a frame
+// boundary. Uses inotify on Linux, elsewhere modification times are polled.
+struct ShaderWatcher {
+	int mFd = -1;
+	std::map<std::string, std::filesystem::file_time_type> mWriteTimes;
+	float mNextPoll = 0.0f;
+
+	ShaderWatcher();
+	~ShaderWatcher();
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	void Update();
+};
\ No newline at end of file
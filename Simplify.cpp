@@ -0,0 +1,175 @@
+#include "Simplify.h"
+
+// Symmetric 4x4 matrix of summed plane equations, upper triangle only
+struct SimplifyQuadric {
+	double mA[10] = {};
+
+	static SimplifyQuadric FromTriangle(const glm::dvec3& p0, const glm::dvec3& p1, const glm::dvec3& p2) {
+		SimplifyQuadric quadric;
+		auto normal = glm::cross(p1 - p0, p2 - p0);
+		const auto length = glm::length(normal);
+		if (length <= 0.0) return quadric;
+		normal /= length;
+		const double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, p0);
+		const double values[10] = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+		std::copy(std::begin(values), std::end(values), quadric.mA);
+		return quadric;
+	}
+
+	SimplifyQuadric& operator+=(const SimplifyQuadric& other) {
+		for (int i = 0; i < 10; i++) mA[i] += other.mA[i];
+		return *this;
+	}
+
+	// Sum of squared distances of p to the planes
+	double Evaluate(const glm::vec3& p) const {
+		const double x = p.x, y = p.y, z = p.z;
+		return mA[0] * x * x + 2 * mA[1] * x * y + 2 * mA[2] * x * z + 2 * mA[3] * x
+			+ mA[4] * y * y + 2 * mA[5] * y * z + 2 * mA[6] * y
+			+ mA[7] * z * z + 2 * mA[8] * z
+			+ mA[9];
+	}
+};
+
+struct SimplifyCollapse {
+	uint32_t mFrom;
+	uint32_t mTo;
+	double mCost;
+};
+
+// True if moving from onto to turns a remaining triangle around from over
+static bool CollapseFlips(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const uint32_t* triangles, size_t triangleCount, uint32_t from, uint32_t to) {
+	for (size_t i = 0; i < triangleCount; i++) {
+		const auto triangle = &indices[triangles[i] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+		glm::vec3 before[3], after[3];
+		for (int k = 0; k < 3; k++) {
+			before[k] = vertices[triangle[k]].mPos;
+			after[k] = triangle[k] == from ? vertices[to].mPos : before[k];
+		}
+		const auto n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+		const auto n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(n0, n1) <= 0.0f) return true;
+	}
+	return false;
+}
+
+std::vector<uint32_t> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float& error) {
+	const auto vertexCount = vertices.size();
+	std::vector<uint32_t> result = indices;
+	error = 0.0f;
+
+	// Vertices split by other attributes would tear the surface apart
+	std::vector<bool> locked(vertexCount, false);
+	std::unordered_map<glm::vec3, uint32_t> positions;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		const auto it = positions.emplace(vertices[i].mPos, i);
+		if (!it.second) {
+			locked[i] = true;
+			locked[it.first->second] = true;
+		}
+	}
+
+	// So would moving a vertex of an edge used by a single triangle
+	std::unordered_map<uint64_t, uint32_t> edgeUses;
+	auto edgeKey = [](uint32_t a, uint32_t b) { return (uint64_t)std::min(a, b) << 32 | std::max(a, b); };
+	for (size_t t = 0; t < result.size(); t += 3) {
+		for (int e = 0; e < 3; e++) {
+			edgeUses[edgeKey(result[t + e], result[t + (e + 1) % 3])]++;
+		}
+	}
+	for (const auto& edge : edgeUses) {
+		if (edge.second == 1) {
+			locked[edge.first >> 32] = true;
+			locked[edge.first & 0xffffffff] = true;
+		}
+	}
+
+	std::vector<SimplifyQuadric> quadrics(vertexCount);
+	for (size_t t = 0; t < result.size(); t += 3) {
+		const auto quadric = SimplifyQuadric::FromTriangle(glm::dvec3(vertices[result[t]].mPos), glm::dvec3(vertices[result[t + 1]].mPos), glm::dvec3(vertices[result[t + 2]].mPos));
+		for (int k = 0; k < 3; k++) {
+			quadrics[result[t + k]] += quadric;
+		}
+	}
+
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> adjacencyOffsets;
+	std::vector<uint32_t> adjacencyFill;
+	std::vector<uint32_t> adjacency;
+	std::vector<SimplifyCollapse> collapses;
+
+	// Each pass collapses the cheapest edges whose neighbourhoods do not overlap
+	while (result.size() > targetIndexCount) {
+		const auto triangleCount = result.size() / 3;
+
+		// vertex -> triangles using it
+		adjacencyOffsets.assign(vertexCount + 1, 0);
+		for (auto index : result) {
+			adjacencyOffsets[index + 1]++;
+		}
+		for (size_t i = 0; i < vertexCount; i++) {
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+		adjacencyFill = adjacencyOffsets;
+		adjacency.resize(result.size());
+		for (size_t i = 0; i < result.size(); i++) {
+			adjacency[adjacencyFill[result[i]]++] = (uint32_t)(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t t = 0; t < result.size(); t += 3) {
+			for (int e = 0; e < 3; e++) {
+				const auto a = result[t + e];
+				const auto b = result[t + (e + 1) % 3];
+				for (const auto& edge : { std::make_pair(a, b), std::make_pair(b, a) }) {
+					if (locked[edge.first]) continue;
+					auto quadric = quadrics[edge.first];
+					quadric += quadrics[edge.second];
+					collapses.push_back({ edge.first, edge.second, quadric.Evaluate(vertices[edge.second].mPos) });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const auto& a, const auto& b) { return a.mCost < b.mCost; });
+
+		std::iota(remap.begin(), remap.end(), 0);
+		touched.assign(vertexCount, false);
+		const auto targetRemoved = triangleCount - targetIndexCount / 3;
+		size_t removed = 0;
+		for (const auto& collapse : collapses) {
+			if (removed >= targetRemoved) break;
+			if (touched[collapse.mFrom] || touched[collapse.mTo]) continue;
+			const auto triangles = &adjacency[adjacencyOffsets[collapse.mFrom]];
+			const auto count = adjacencyOffsets[collapse.mFrom + 1] - adjacencyOffsets[collapse.mFrom];
+			if (CollapseFlips(vertices, result, triangles, count, collapse.mFrom, collapse.mTo)) continue;
+
+			remap[collapse.mFrom] = collapse.mTo;
+			quadrics[collapse.mTo] += quadrics[collapse.mFrom];
+			for (size_t i = 0; i < count; i++) {
+				const auto triangle = &result[triangles[i] * 3];
+				bool degenerate = false;
+				for (int k = 0; k < 3; k++) {
+					touched[triangle[k]] = true;
+					degenerate |= triangle[k] == collapse.mTo;
+				}
+				removed += degenerate;
+			}
+			error = std::max(error, (float)std::sqrt(std::max(collapse.mCost, 0.0)));
+		}
+		if (!removed) break;
+
+		size_t write = 0;
+		for (size_t t = 0; t < result.size(); t += 3) {
+			const auto a = remap[result[t]];
+			const auto b = remap[result[t + 1]];
+			const auto c = remap[result[t + 2]];
+			if (a == b || b == c || a == c) continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+	return result;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Main.h"
+#include "Vertex.h"
+
+// Bump when SimplifyMesh or the Mesh::BuildLods settings change the output,
+// model caches hold the generated LODs and are rebuilt on a mismatch
+static constexpr uint32_t SimplifyVersion = 1;
+
+// Quadric error metric simplification (Garland & Heckbert) restricted to half
+// edge collapses: a vertex only ever moves onto one of its neighbours, so the
+// result is a new index buffer over the unchanged vertices and all levels of
+// detail of a mesh can share one vertex range. Vertices on open borders and
+// seams (a position shared by several vertices) are locked. Returns at least
+// targetIndexCount indices unless the mesh cannot be simplified further, error
+// is set to the largest collapse error in mesh units.
+std::vector<uint32_t> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float& error);
@@ -0,0 +1,161 @@
+#include "Skinning.h"
+
+#ifdef SKINNING_SSE
+#include <xmmintrin.h>
+#endif
+
+static_assert(MAX_VERTEX_WEIGHTS == 4, "SkinVertex blends exactly four weights");
+
+// Vertices per parallel task
+static constexpr size_t SkinningBatchSize = 1024;
+
+void SkinVertexScalar(const Vertex& vertex, const glm::mat4* bones, glm::vec3& position, glm::vec3* normal) {
+	const auto w = vertex.mBoneWeights;
+	auto skin = glm::identity<glm::mat4>() * (1.0f - (w[0] + w[1] + w[2] + w[3]));
+	for (int k = 0; k < 4; k++) {
+		skin += bones[vertex.mBoneIndices[k]] * w[k];
+	}
+	position = skin * glm::vec4(vertex.mPos, 1.0f);
+	if (normal) *normal = glm::mat3(skin) * vertex.mNormal;
+}
+
+#ifdef SKINNING_SSE
+// Columns of the blended matrix are built in registers, one multiply add per
+// bone and column
+void SkinVertexSse(const Vertex& vertex, const glm::mat4* bones, glm::vec3& position, glm::vec3* normal) {
+	const auto w = vertex.mBoneWeights;
+	const float rest = 1.0f - (w[0] + w[1] + w[2] + w[3]);
+	__m128 skin[4] = {
+		_mm_set_ps(0.0f, 0.0f, 0.0f, rest),
+		_mm_set_ps(0.0f, 0.0f, rest, 0.0f),
+		_mm_set_ps(0.0f, rest, 0.0f, 0.0f),
+		_mm_set_ps(rest, 0.0f, 0.0f, 0.0f),
+	};
+	for (int k = 0; k < 4; k++) {
+		const auto weight = _mm_set1_ps(w[k]);
+		const auto bone = glm::value_ptr(bones[vertex.mBoneIndices[k]]);
+		for (int c = 0; c < 4; c++) {
+			skin[c] = _mm_add_ps(skin[c], _mm_mul_ps(_mm_loadu_ps(bone + c * 4), weight));
+		}
+	}
+
+	alignas(16) float out[4];
+	auto p = _mm_add_ps(_mm_mul_ps(skin[0], _mm_set1_ps(vertex.mPos.x)), skin[3]);
+	p = _mm_add_ps(p, _mm_mul_ps(skin[1], _mm_set1_ps(vertex.mPos.y)));
+	p = _mm_add_ps(p, _mm_mul_ps(skin[2], _mm_set1_ps(vertex.mPos.z)));
+	_mm_store_ps(out, p);
+	position = { out[0], out[1], out[2] };
+	if (!normal) return;
+
+	auto n = _mm_mul_ps(skin[0], _mm_set1_ps(vertex.mNormal.x));
+	n = _mm_add_ps(n, _mm_mul_ps(skin[1], _mm_set1_ps(vertex.mNormal.y)));
+	n = _mm_add_ps(n, _mm_mul_ps(skin[2], _mm_set1_ps(vertex.mNormal.z)));
+	_mm_store_ps(out, n);
+	*normal = { out[0], out[1], out[2] };
+}
+
+static constexpr auto SkinVertex = SkinVertexSse;
+#else
+static constexpr auto SkinVertex = SkinVertexScalar;
+#endif
+
+bool SkinMesh(Mesh& mesh, const std::vector<glm::mat4>& bones, SkinnedMesh& result, bool normals) {
+	if (!mesh.LoadCpuData()) return false;
+	const auto& vertices = mesh.mVertices;
+	const auto count = vertices.size();
+	result.mPositions.resize(count);
+	result.mNormals.resize(normals ? count : 0);
+	if (!count) {
+		result.mAABB = AABB();
+		return true;
+	}
+
+	if (bones.empty()) {
+		for (size_t i = 0; i < count; i++) {
+			result.mPositions[i] = vertices[i].mPos;
+			if (normals) result.mNormals[i] = vertices[i].mNormal;
+		}
+	} else {
+		// Unused weight slots keep bone index 0, only real indices can be out of range
+		assert(std::all_of(vertices.begin(), vertices.end(), [&](const Vertex& v) {
+			return std::all_of(std::begin(v.mBoneIndices), std::end(v.mBoneIndices), [&](uint32_t i) { return i < bones.size(); });
+		}));
+		std::vector<size_t> batches((count + SkinningBatchSize - 1) / SkinningBatchSize);
+		std::iota(batches.begin(), batches.end(), 0);
+		std::for_each(std::execution::par, batches.begin(), batches.end(), [&](size_t batch) {
+			const auto end = std::min(count, (batch + 1) * SkinningBatchSize);
+			for (auto i = batch * SkinningBatchSize; i < end; i++) {
+				SkinVertex(vertices[i], bones.data(), result.mPositions[i], normals ? &result.mNormals[i] : nullptr);
+			}
+		});
+	}
+
+	auto min = result.mPositions[0];
+	auto max = result.mPositions[0];
+	for (const auto& p : result.mPositions) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	result.mAABB = AABB::FromExtents(min, max);
+	return true;
+}
+
+void CopySkinnedMesh(const Mesh& mesh, const SkinnedMesh& skinned, Mesh& target) {
+	assert(skinned.mPositions.size() == mesh.mVertices.size() && skinned.mNormals.size() == mesh.mVertices.size());
+	target.mDynamic = true;
+	target.mMode = mesh.mMode;
+	target.mAABB = skinned.mAABB;
+	if (target.mIndices != mesh.mIndices) {
+		target.mIndices = mesh.mIndices;
+	}
+	target.mVertices.resize(mesh.mVertices.size());
+	for (size_t i = 0; i < mesh.mVertices.size(); i++) {
+		auto& vertex = target.mVertices[i];
+		vertex = mesh.mVertices[i];
+		vertex.mPos = skinned.mPositions[i];
+		vertex.mNormal = skinned.mNormals[i];
+		std::fill(std::begin(vertex.mBoneWeights), std::end(vertex.mBoneWeights), 0.0f);
+	}
+	target.mVertexBufferDirty = true;
+}
+
+AABB SkinModelBounds(Model& model, const std::vector<glm::mat4>& bones) {
+	SkinnedMesh skinned;
+	AABB bounds;
+	bool first = true;
+	for (auto& modelMesh : model.mMeshes) {
+		if (modelMesh->mMesh->mHidden || !SkinMesh(*modelMesh->mMesh, bones, skinned, false)) continue;
+		const auto meshBounds = skinned.mAABB.Transform(modelMesh->mTransform);
+		bounds = first ? meshBounds : bounds.Extend(meshBounds);
+		first = false;
+	}
+	return bounds;
+}
+
+bool RayCastSkinned(const Mesh& mesh, const SkinnedMesh& skinned, const glm::vec3& origin, const glm::vec3& dir, float maxDistance, float& distance) {
+	if (mesh.mMode != GL_TRIANGLES || skinned.mPositions.size() != mesh.mVertices.size()) return false;
+	bool hit = false;
+	const auto& indices = mesh.mIndices;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		// Moller-Trumbore, both faces
+		const auto& p0 = skinned.mPositions[indices[t]];
+		const auto e1 = skinned.mPositions[indices[t + 1]] - p0;
+		const auto e2 = skinned.mPositions[indices[t + 2]] - p0;
+		const auto p = glm::cross(dir, e2);
+		const auto det = glm::dot(e1, p);
+		if (std::abs(det) < 1e-12f) continue;
+		const auto invDet = 1.0f / det;
+		const auto s = origin - p0;
+		const auto u = glm::dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f) continue;
+		const auto q = glm::cross(s, e1);
+		const auto v = glm::dot(dir, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f) continue;
+		const auto d = glm::dot(e2, q) * invDet;
+		if (d < 0.0f || d > maxDistance) continue;
+		maxDistance = d;
+		distance = d;
+		hit = true;
+	}
+	return hit;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Main.h"
+#include "Mesh.h"
+#include "Model.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SKINNING_SSE
+#endif
+
+// Bind pose vertices of a mesh blended with a bone palette on the CPU, the same
+// math as the SKINNED variant of default.vert.glsl: up to four weighted bones
+// plus the identity for the unweighted remainder. Used where the GPU result is
+// not available, animated bounds, picking and checks without a context.
+struct SkinnedMesh {
+	std::vector<glm::vec3> mPositions;
+	std::vector<glm::vec3> mNormals; // not renormalized, like the vertex shader
+	AABB mAABB;
+};
+
+// One vertex blended with the palette, normal may be null. SkinMesh uses the
+// SSE version where it is available, both must give the same results.
+void SkinVertexScalar(const Vertex& vertex, const glm::mat4* bones, glm::vec3& position, glm::vec3* normal);
+#ifdef SKINNING_SSE
+void SkinVertexSse(const Vertex& vertex, const glm::mat4* bones, glm::vec3& position, glm::vec3* normal);
+#endif
+
+// Reloads released CPU data first. Returns false if the mesh has no CPU data,
+// an empty palette leaves the mesh in its bind pose.
+bool SkinMesh(Mesh& mesh, const std::vector<glm::mat4>& bones, SkinnedMesh& result, bool normals = true);
+
+// Copies mesh into target with the skinned positions and normals and the
+// weights cleared, so the SKINNED shader variant draws it unchanged. target
+// becomes a dynamic mesh, the vertices are streamed on its next Bind.
+void CopySkinnedMesh(const Mesh& mesh, const SkinnedMesh& skinned, Mesh& target);
+
+// Bounds of all visible meshes of the model in model space
+AABB SkinModelBounds(Model& model, const std::vector<glm::mat4>& bones);
+
+// Closest triangle of mesh.mIndices hit by the ray, positions from SkinMesh
+bool RayCastSkinned(const Mesh& mesh, const SkinnedMesh& skinned, const glm::vec3& origin, const glm::vec3& dir, float maxDistance, float& distance);
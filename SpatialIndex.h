@@ -0,0 +1,307 @@
+#pragma once
+
+#include "Main.h"
+#include "AABB.h"
+#include "Camera.h"
+
+// Dynamic AABB tree (incremental BVH). Leaves store fattened bounds so small
+// movements do not touch the tree, larger ones reinsert the leaf and refit
+// the ancestors. Balanced with AVL style rotations on insert/remove.
+template<typename T>
+struct SpatialIndex {
+	static constexpr int32_t Null = -1;
+
+	struct Node {
+		AABB mBounds;
+		T mUserData = {};
+		int32_t mParent = Null; // next free node when unused
+		int32_t mChild1 = Null;
+		int32_t mChild2 = Null;
+		int32_t mHeight = -1; // -1 = free, 0 = leaf
+		bool IsLeaf() const { return mChild1 == Null; }
+	};
+
+	std::vector<Node> mNodes;
+	int32_t mRoot = Null;
+	int32_t mFreeList = Null;
+	size_t mProxyCount = 0;
+	float mMargin = 0.1f;
+
+	int32_t Insert(const AABB& bounds, const T& userData) {
+		const auto proxy = AllocateNode();
+		mNodes[proxy].mBounds = bounds.Grow(mMargin);
+		mNodes[proxy].mUserData = userData;
+		mNodes[proxy].mHeight = 0;
+		InsertLeaf(proxy);
+		mProxyCount++;
+		return proxy;
+	}
+
+	void Remove(int32_t proxy) {
+		assert(proxy >= 0 && proxy < (int32_t)mNodes.size() && mNodes[proxy].IsLeaf());
+		RemoveLeaf(proxy);
+		FreeNode(proxy);
+		mProxyCount--;
+	}
+
+	// Returns true if the leaf had to be reinserted
+	bool Move(int32_t proxy, const AABB& bounds) {
+		assert(proxy >= 0 && proxy < (int32_t)mNodes.size() && mNodes[proxy].IsLeaf());
+		if (mNodes[proxy].mBounds.Contains(bounds)) {
+			return false;
+		}
+		RemoveLeaf(proxy);
+		mNodes[proxy].mBounds = bounds.Grow(mMargin);
+		InsertLeaf(proxy);
+		return true;
+	}
+
+	const T& GetUserData(int32_t proxy) const {
+		return mNodes[proxy].mUserData;
+	}
+
+	const AABB& GetFatBounds(int32_t proxy) const {
+		return mNodes[proxy].mBounds;
+	}
+
+	size_t GetProxyCount() const {
+		return mProxyCount;
+	}
+
+	int32_t GetHeight() const {
+		return mRoot == Null ? 0 : mNodes[mRoot].mHeight;
+	}
+
+	void Clear() {
+		mNodes.clear();
+		mRoot = Null;
+		mFreeList = Null;
+		mProxyCount = 0;
+	}
+
+	// Generic traversal, test(bounds) decides whether to descend, visit(userData) returns false to stop
+	template<typename TTest, typename TVisit>
+	void Query(TTest test, TVisit visit) const {
+		if (mRoot == Null) return;
+		int32_t stack[256];
+		std::vector<int32_t> overflow;
+		int32_t count = 0;
+		stack[count++] = mRoot;
+		while (count > 0 || !overflow.empty()) {
+			int32_t nodeId;
+			if (!overflow.empty()) {
+				nodeId = overflow.back();
+				overflow.pop_back();
+			} else {
+				nodeId = stack[--count];
+			}
+			const auto& node = mNodes[nodeId];
+			if (!test(node.mBounds)) continue;
+			if (node.IsLeaf()) {
+				if (!visit(node.mUserData)) return;
+				continue;
+			}
+			for (auto child : { node.mChild1, node.mChild2 }) {
+				if (count < 256) {
+					stack[count++] = child;
+				} else {
+					overflow.push_back(child);
+				}
+			}
+		}
+	}
+
+	template<typename TVisit>
+	void QueryAABB(const AABB& bounds, TVisit visit) const {
+		Query([&bounds](const AABB& b) { return b.Intersects(bounds); }, visit);
+	}
+
+	template<typename TVisit>
+	void QueryFrustum(const Frustum& frustum, TVisit visit) const {
+		Query([&frustum](const AABB& b) { return frustum.Intersects(b); }, visit);
+	}
+
+	template<typename TVisit>
+	void QueryRadius(const glm::vec3& center, float radius, TVisit visit) const {
+		Query([&center, radius](const AABB& b) { return b.Intersects(center, radius); }, visit);
+	}
+
+	// visit(userData, distance) returns the new max distance: 0 stops, distance clips, maxDistance continues
+	template<typename TVisit>
+	void RayCast(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, TVisit visit) const {
+		const glm::vec3 invDir = 1.0f / dir;
+		float distance = 0.0f;
+		Query([&](const AABB& b) { return b.IntersectsRay(origin, invDir, maxDistance, distance); }, [&](const T& userData) {
+			maxDistance = visit(userData, distance);
+			return maxDistance > 0.0f;
+		});
+	}
+
+private:
+	int32_t AllocateNode() {
+		if (mFreeList == Null) {
+			mNodes.emplace_back();
+			return (int32_t)mNodes.size() - 1;
+		}
+		const auto nodeId = mFreeList;
+		mFreeList = mNodes[nodeId].mParent;
+		mNodes[nodeId] = Node();
+		return nodeId;
+	}
+
+	void FreeNode(int32_t nodeId) {
+		mNodes[nodeId].mParent = mFreeList;
+		mNodes[nodeId].mHeight = -1;
+		mNodes[nodeId].mUserData = {};
+		mFreeList = nodeId;
+	}
+
+	void InsertLeaf(int32_t leaf) {
+		if (mRoot == Null) {
+			mRoot = leaf;
+			mNodes[mRoot].mParent = Null;
+			return;
+		}
+
+		// Find the best sibling using the surface area heuristic
+		const auto leafBounds = mNodes[leaf].mBounds;
+		auto index = mRoot;
+		while (!mNodes[index].IsLeaf()) {
+			const auto& node = mNodes[index];
+			const float area = node.mBounds.GetSurfaceArea();
+			const float combinedArea = node.mBounds.Extend(leafBounds).GetSurfaceArea();
+			const float cost = 2.0f * combinedArea;
+			const float inheritanceCost = 2.0f * (combinedArea - area);
+
+			auto childCost = [&](int32_t child) {
+				const auto& bounds = mNodes[child].mBounds;
+				const float newArea = bounds.Extend(leafBounds).GetSurfaceArea();
+				if (mNodes[child].IsLeaf()) return newArea + inheritanceCost;
+				return newArea - bounds.GetSurfaceArea() + inheritanceCost;
+			};
+			const float cost1 = childCost(node.mChild1);
+			const float cost2 = childCost(node.mChild2);
+
+			if (cost < cost1 && cost < cost2) break;
+			index = cost1 < cost2 ? node.mChild1 : node.mChild2;
+		}
+
+		const auto sibling = index;
+		const auto oldParent = mNodes[sibling].mParent;
+		const auto newParent = AllocateNode();
+		mNodes[newParent].mParent = oldParent;
+		mNodes[newParent].mBounds = mNodes[sibling].mBounds.Extend(leafBounds);
+		mNodes[newParent].mHeight = mNodes[sibling].mHeight + 1;
+		mNodes[newParent].mChild1 = sibling;
+		mNodes[newParent].mChild2 = leaf;
+		mNodes[sibling].mParent = newParent;
+		mNodes[leaf].mParent = newParent;
+
+		if (oldParent == Null) {
+			mRoot = newParent;
+		} else if (mNodes[oldParent].mChild1 == sibling) {
+			mNodes[oldParent].mChild1 = newParent;
+		} else {
+			mNodes[oldParent].mChild2 = newParent;
+		}
+
+		Refit(mNodes[leaf].mParent);
+	}
+
+	void RemoveLeaf(int32_t leaf) {
+		if (leaf == mRoot) {
+			mRoot = Null;
+			return;
+		}
+
+		const auto parent = mNodes[leaf].mParent;
+		const auto grandParent = mNodes[parent].mParent;
+		const auto sibling = mNodes[parent].mChild1 == leaf ? mNodes[parent].mChild2 : mNodes[parent].mChild1;
+
+		if (grandParent == Null) {
+			mRoot = sibling;
+			mNodes[sibling].mParent = Null;
+			FreeNode(parent);
+			return;
+		}
+
+		if (mNodes[grandParent].mChild1 == parent) {
+			mNodes[grandParent].mChild1 = sibling;
+		} else {
+			mNodes[grandParent].mChild2 = sibling;
+		}
+		mNodes[sibling].mParent = grandParent;
+		FreeNode(parent);
+
+		Refit(grandParent);
+	}
+
+	// Walk back up the tree fixing heights and bounds
+	void Refit(int32_t index) {
+		while (index != Null) {
+			index = Balance(index);
+			auto& node = mNodes[index];
+			const auto& child1 = mNodes[node.mChild1];
+			const auto& child2 = mNodes[node.mChild2];
+			node.mHeight = 1 + std::max(child1.mHeight, child2.mHeight);
+			node.mBounds = child1.mBounds.Extend(child2.mBounds);
+			index = node.mParent;
+		}
+	}
+
+	// Rotates A with the higher of its children if the subtree is imbalanced, returns the new subtree root
+	int32_t Balance(int32_t iA) {
+		auto& A = mNodes[iA];
+		if (A.IsLeaf() || A.mHeight < 2) {
+			return iA;
+		}
+
+		const auto iB = A.mChild1;
+		const auto iC = A.mChild2;
+		const int32_t balance = mNodes[iC].mHeight - mNodes[iB].mHeight;
+
+		if (balance > 1) return Rotate(iA, iC, iB);
+		if (balance < -1) return Rotate(iA, iB, iC);
+		return iA;
+	}
+
+	// Promotes iUp (child of iA) above iA, iOther is the remaining child of iA
+	int32_t Rotate(int32_t iA, int32_t iUp, int32_t iOther) {
+		auto& A = mNodes[iA];
+		auto& U = mNodes[iUp];
+		const auto iF = U.mChild1;
+		const auto iG = U.mChild2;
+		auto& F = mNodes[iF];
+		auto& G = mNodes[iG];
+
+		U.mChild1 = iA;
+		U.mParent = A.mParent;
+		A.mParent = iUp;
+
+		if (U.mParent == Null) {
+			mRoot = iUp;
+		} else if (mNodes[U.mParent].mChild1 == iA) {
+			mNodes[U.mParent].mChild1 = iUp;
+		} else {
+			mNodes[U.mParent].mChild2 = iUp;
+		}
+
+		// Keep the higher grandchild under U, move the lower one under A
+		const auto iKeep = F.mHeight > G.mHeight ? iF : iG;
+		const auto iMove = F.mHeight > G.mHeight ? iG : iF;
+		U.mChild2 = iKeep;
+		if (A.mChild1 == iUp) {
+			A.mChild1 = iMove;
+		} else {
+			A.mChild2 = iMove;
+		}
+		mNodes[iMove].mParent = iA;
+
+		A.mBounds = mNodes[iOther].mBounds.Extend(mNodes[iMove].mBounds);
+		A.mHeight = 1 + std::max(mNodes[iOther].mHeight, mNodes[iMove].mHeight);
+		U.mBounds = A.mBounds.Extend(mNodes[iKeep].mBounds);
+		U.mHeight = 1 + std::max(A.mHeight, mNodes[iKeep].mHeight);
+
+		return iUp;
+	}
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Main.h"
+
+// Ring buffer for data that is rewritten every frame. Writes are appended with
+// unsynchronized maps, when the end is reached the storage is orphaned so the
+// driver hands out a fresh allocation instead of waiting for pending draws.
+// Uploads go through GL_COPY_WRITE_BUFFER so no VAO state is touched.
+struct StreamBuffer {
+	GLuint mBuffer = 0;
+	size_t mSize = 0;
+	size_t mOffset = 0;
+	size_t mOrphans = 0; // data written before the last orphan is gone
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+	StreamBuffer(size_t size) : mSize(size) {
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, mSize, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	~StreamBuffer() {
+		glDeleteBuffers(1, &mBuffer);
+	}
+
+	// Copies size bytes into the buffer and returns the offset they were written to
+	size_t Write(const void* data, size_t size, size_t alignment = 4) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		auto offset = (mOffset + alignment - 1) / alignment * alignment;
+		if (offset + size > mSize) {
+			mSize = std::max(mSize, size * 2);
+			glBufferData(GL_COPY_WRITE_BUFFER, mSize, nullptr, GL_STREAM_DRAW);
+			offset = 0;
+			mOrphans++;
+		}
+		auto ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		memcpy(ptr, data, size);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mOffset = offset + size;
+		return offset;
+	}
+};
@@ -1,2 +1,2 @@
-#include "UI.h"
-
+#include "UI.h"
+
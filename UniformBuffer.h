@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Main.h"
+#include "StreamBuffer.h"
+
+// Uniform block binding points shared by every program. The blocks are bound
+// by name in ShaderProgram::GetUniformLocations, so shaders only declare them.
+enum UniformBinding : GLuint {
+	FrameBinding = 0, // uniform Frame, written once per frame
+	DrawBinding = 1, // uniform Draw, a range of the per frame draw stream
+	MaterialBinding = 2, // uniform Material, owned by the drawn object
+};
+
+// std140 layout of the Frame block
+struct FrameUniforms {
+	glm::mat4 mProj;
+	glm::mat4 mView;
+	glm::vec3 mViewPos;
+	float mTime;
+	glm::vec3 mLightPos;
+	float mPad0;
+	glm::vec3 mLightColor;
+	float mPad1;
+};
+static_assert(sizeof(FrameUniforms) == 176, "FrameUniforms must match the std140 Frame block");
+
+// std140 layout of the Draw block
+struct DrawUniforms {
+	glm::mat4 mModel;
+	glm::mat4 mNormal; // inverse transpose of mModel, only the upper 3x3 is used
+
+	DrawUniforms(const glm::mat4& model) : mModel(model), mNormal(glm::transpose(glm::inverse(glm::mat3(model)))) {}
+};
+static_assert(sizeof(DrawUniforms) == 128, "DrawUniforms must match the std140 Draw block");
+
+// Buffer for a block that is rewritten as a whole, like the Frame block or a material
+struct UniformBuffer {
+	GLuint mBuffer = 0;
+	size_t mSize = 0;
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+	UniformBuffer(size_t size, const void* data = nullptr) : mSize(size) {
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, mSize, data, data ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	~UniformBuffer() {
+		glDeleteBuffers(1, &mBuffer);
+	}
+
+	void Update(const void* data) {
+		glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, mSize, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, mSize, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void Bind(GLuint binding) const {
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, mBuffer);
+	}
+};
+
+// Per draw blocks of one frame. Push stages a block and returns its index, the
+// blocks are uploaded with a single Flush and bound by range before each draw.
+template<typename T>
+struct UniformStream {
+	StreamBuffer mBuffer;
+	std::vector<uint8_t> mStaging;
+	size_t mStride = 0;
+	size_t mOffset = 0;
+
+	UniformStream(size_t count) : mBuffer(count * GetStride()), mStride(GetStride()) {}
+
+	static size_t GetStride() {
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		return (sizeof(T) + alignment - 1) / alignment * alignment;
+	}
+
+	size_t Push(const T& block) {
+		const auto index = mStaging.size() / mStride;
+		mStaging.resize(mStaging.size() + mStride);
+		memcpy(&mStaging[index * mStride], &block, sizeof(T));
+		return index;
+	}
+
+	// Drops the staged blocks without uploading them
+	void Clear() {
+		mStaging.clear();
+	}
+
+	void Flush() {
+		if (mStaging.empty()) return;
+		mOffset = mBuffer.Write(mStaging.data(), mStaging.size(), mStride);
+		mStaging.clear();
+	}
+
+	void Bind(GLuint binding, size_t index) const {
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, mBuffer.mBuffer, mOffset + index * mStride, sizeof(T));
+	}
+};
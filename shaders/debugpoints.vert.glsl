@@ -0,0 +1,32 @@
+#version 450
+
+layout(std140) uniform Frame {
+    mat4 uProj;
+    mat4 uView;
+    vec3 uViewPos;
+    float uTime;
+    vec3 uLightPos;
+    vec3 uLightColor;
+};
+
+// per instance
+layout(location=0) in vec3 inPosition;
+layout(location=1) in float inScale;
+layout(location=2) in vec3 inColor;
+
+layout(location=0) out vec3 outColor;
+
+const vec2 corners[6] = vec2[](
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
+void main() {
+    vec2 corner = (corners[gl_VertexID] - 0.5) * 0.25 * inScale;
+    vec3 camRight = vec3(uView[0][0], uView[1][0], uView[2][0]);
+    vec3 camUp = vec3(uView[0][1], uView[1][1], uView[2][1]);
+    vec3 pos = inPosition + camRight * corner.x + camUp * corner.y;
+
+    gl_Position = uProj * uView * vec4(pos, 1.0);
+    outColor = inColor;
+}
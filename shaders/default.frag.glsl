@@ -7,9 +7,14 @@ layout(location=3) in vec3 inBarycentric;
 
 layout(location=0) out vec4 outColor;
 
-uniform vec3 uLightPos; 
-uniform vec3 uViewPos; 
-uniform vec3 uLightColor;
+layout(std140) uniform Frame {
+    mat4 uProj;
+    mat4 uView;
+    vec3 uViewPos;
+    float uTime;
+    vec3 uLightPos;
+    vec3 uLightColor;
+};
 
 void main() {
     // ambient
@@ -1,39 +1,76 @@
 #version 450
 
+// Variants, see Model::GetShaderDefines
+// SKINNED: blend positions and normals with the bone palette
+// MAX_BONES: palette size of skinned variants
+// INSTANCED: per draw matrices are instanced attributes, see IndirectRenderer
+#ifndef MAX_BONES
 #define MAX_BONES 192
+#endif
 
-layout(location=0) uniform mat4 uProj;
-layout(location=1) uniform mat4 uView;
-layout(location=2) uniform mat4 uModel;
-layout(location=3) uniform mat4 uBones[MAX_BONES];
+layout(std140) uniform Frame {
+    mat4 uProj;
+    mat4 uView;
+    vec3 uViewPos;
+    float uTime;
+    vec3 uLightPos;
+    vec3 uLightColor;
+};
+
+#ifdef INSTANCED
+layout(location=5) in mat4 inModel;
+layout(location=9) in mat4 inNormalMatrix;
+#define uModel inModel
+#define uNormalMatrix inNormalMatrix
+#else
+layout(std140) uniform Draw {
+    mat4 uModel;
+    mat4 uNormalMatrix; // inverse transpose of uModel, computed on the CPU
+};
+#endif
+
+#ifdef SKINNED
+uniform mat4 uBones[MAX_BONES];
+#endif
 
 layout(location=0) in vec3 inPosition;
 layout(location=1) in vec3 inNormal;
 layout(location=2) in vec3 inColor;
+#ifdef SKINNED
 layout(location=3) in vec4 inBoneWeights;
 layout(location=4) in uvec4 inBoneIndices;
+#endif
 
 layout(location=0) out vec3 outColor;
 layout(location=1) out vec3 outNormal;
 layout(location=2) out vec3 outPosition;
 
 void main() {
-    if(inBoneWeights[0] > 0.0) {
-        mat4 boneTransform = uBones[inBoneIndices[0]] * inBoneWeights[0];
-        boneTransform += uBones[inBoneIndices[1]] * inBoneWeights[1];
-        boneTransform += uBones[inBoneIndices[2]] * inBoneWeights[2];
-        boneTransform += uBones[inBoneIndices[3]] * inBoneWeights[3];
-    
-        gl_Position = uProj * uView * uModel * boneTransform * vec4(inPosition, 1.0);
-    } else {
-        gl_Position = uProj * uView * uModel * vec4(inPosition, 1.0);
-    }
+#ifdef SKINNED
+    // Unweighted vertices keep their bind pose through the identity term.
+    // Normals use the upper 3x3 of the skin matrix, fine for bones without
+    // non-uniform scale.
+    float weight = dot(inBoneWeights, vec4(1.0));
+    mat4 skin = uBones[inBoneIndices[0]] * inBoneWeights[0];
+    skin += uBones[inBoneIndices[1]] * inBoneWeights[1];
+    skin += uBones[inBoneIndices[2]] * inBoneWeights[2];
+    skin += uBones[inBoneIndices[3]] * inBoneWeights[3];
+    skin += mat4(1.0) * (1.0 - weight);
+    vec4 position = skin * vec4(inPosition, 1.0);
+    vec3 normal = mat3(skin) * inNormal;
+#else
+    vec4 position = vec4(inPosition, 1.0);
+    vec3 normal = inNormal;
+#endif
+
+    vec4 worldPosition = uModel * position;
+    gl_Position = uProj * uView * worldPosition;
 
     outColor = inColor;
 
     //outColor = vec3(inBoneWeights[0], inBoneWeights[1], inBoneWeights[2]);
     //outColor = vec3(inBoneIndices[0], inBoneIndices[1], inBoneIndices[2]);
 
-    outPosition = vec3(uModel * vec4(inPosition, 1.0));
-    outNormal = mat3(transpose(inverse(uModel))) * inNormal; 
+    outPosition = worldPosition.xyz;
+    outNormal = mat3(uNormalMatrix) * normal;
 }
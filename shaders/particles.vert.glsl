@@ -1,30 +1,50 @@
 #version 450
 
-layout(location=0) uniform mat4 uProj;
-layout(location=1) uniform mat4 uView;
-layout(location=2) uniform mat4 uModel;
-layout(location=3) uniform float uTime;
+layout(std140) uniform Frame {
+    mat4 uProj;
+    mat4 uView;
+    vec3 uViewPos;
+    float uTime;
+    vec3 uLightPos;
+    vec3 uLightColor;
+};
 
-layout(location=0) in vec3 inPosition;
-layout(location=1) in vec3 inNormal;
-layout(location=2) in vec3 inColor;
+layout(std140) uniform Draw {
+    mat4 uModel;
+};
+
+// ParticleEmitter::MaterialUniforms
+layout(std140) uniform Material {
+    float uLifetime;
+    float uSize;
+    vec3 uGravity;
+    vec3 uColorStart;
+    vec3 uColorEnd;
+};
+
+// per instance, see ParticleEmitter.h
+layout(location=0) in vec3 inVelocity;
+layout(location=1) in float inSpawnOffset;
 
 layout(location=0) out vec3 outColor;
 
+const vec2 corners[6] = vec2[](
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
 void main() {
-    //vec3 offset  = inPosition + inNormal * uTime * 0.1;
+    float age = mod(uTime + inSpawnOffset, uLifetime);
+    float t = age / uLifetime;
 
-	// TODO: use custom vertex format for particles
-	float scale = inNormal.z;
-	vec3 center = inPosition;
-	mat4 viewModel = uView * uModel;
-	vec3 camRight = vec3(viewModel[0][0], viewModel[1][0], viewModel[2][0]);
-	vec3 camUp = vec3(viewModel[0][1], viewModel[1][1], viewModel[2][1]);
-	vec3 pos = center
-			 + camRight * inNormal.x * scale
-			 + camUp * inNormal.y * scale;
+    // velocity is in emitter space, gravity in world space
+    vec3 center = (uModel * vec4(inVelocity * age, 1.0)).xyz + 0.5 * uGravity * age * age;
 
-    gl_Position = uProj * uView * uModel * vec4(pos, 1.0);
+    vec2 corner = (corners[gl_VertexID] - 0.5) * uSize * (1.0 - 0.5 * t);
+    vec3 camRight = vec3(uView[0][0], uView[1][0], uView[2][0]);
+    vec3 camUp = vec3(uView[0][1], uView[1][1], uView[2][1]);
+    vec3 pos = center + camRight * corner.x + camUp * corner.y;
 
-    outColor = pos;
+    gl_Position = uProj * uView * vec4(pos, 1.0);
+    outColor = mix(uColorStart, uColorEnd, t);
 }
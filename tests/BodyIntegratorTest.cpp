@@ -0,0 +1,104 @@
+#include "../Components.h"
+
+// Steps the per body integrator of the old Entity::UpdatePhysicsStep next to
+// EntityRegistry::UpdateBodies over many frames and checks that positions,
+// velocities, the interpolation offsets and the grounded state agree.
+
+struct ReferenceBody {
+	glm::vec3 mPos = { 0,0,0 };
+	glm::vec3 mPrevPos = { 0,0,0 }; // before the last step
+	glm::vec3 mVelocity = { 0,0,0 };
+	glm::vec3 mForce = { 0,0,0 };
+	glm::vec3 mGravity = BodyArray::DefaultGravity;
+	float mMaxVelocity = BodyArray::DefaultMaxVelocity;
+	bool mGrounded = false;
+
+	void Update(size_t steps, float step) {
+		for (size_t i = 0; i < steps; ++i) {
+			mPrevPos = mPos;
+			mVelocity = mVelocity + mGravity * step + mForce;
+			mPos = mPos + mVelocity * step;
+			mVelocity = mVelocity / (1.0f + (mGrounded ? 2.0f : 1.0f) * step);
+			const auto velocity = glm::length(mVelocity);
+			if (velocity > mMaxVelocity) {
+				mVelocity = mVelocity * (mMaxVelocity / velocity);
+			}
+			mForce = { 0,0,0 };
+		}
+		if (mPos.y <= 0) {
+			mPos.y = 0;
+			mGrounded = true;
+		}
+	}
+};
+
+static bool Near(const glm::vec3& a, const glm::vec3& b) {
+	const float tolerance = 1e-4f * std::max(1.0f, std::max(glm::length(a), glm::length(b)));
+	return glm::all(glm::epsilonEqual(a, b, tolerance));
+}
+
+int main() {
+	constexpr size_t BodyCount = 257; // not a multiple of any vector width
+	constexpr size_t FrameCount = 600;
+	constexpr float Step = 1.0f / 120.0f;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	EntityRegistry registry;
+	auto& bodies = registry.mBodies;
+	std::vector<ReferenceBody> reference(BodyCount);
+	for (size_t i = 0; i < BodyCount; ++i) {
+		const auto id = registry.Create(nullptr);
+		auto& body = reference[id];
+		body.mPos = { unit(random) * 10.0f, 5.0f + unit(random) * 5.0f, unit(random) * 10.0f };
+		body.mGravity = id % 7 ? BodyArray::DefaultGravity : glm::vec3(0, -30, 0);
+		body.mMaxVelocity = id % 5 ? BodyArray::DefaultMaxVelocity : 3.0f; // some bodies hit the clamp
+		body.mGrounded = id % 3 == 0;
+
+		registry.mTransforms.Get(id).mPos = body.mPos;
+		bodies.Add(id, body.mGravity);
+		bodies.mMaxVelocity[bodies.mIndices[id]] = body.mMaxVelocity;
+		bodies.SetGrounded(id, body.mGrounded);
+	}
+
+	size_t failures = 0;
+	for (size_t frame = 0; frame < FrameCount && failures < 10; ++frame) {
+		// Jump impulses now and then, one to three fixed steps per frame like Scene::Update
+		for (EntityID id = 0; id < BodyCount; ++id) {
+			if ((frame + id) % 50 == 0) {
+				const glm::vec3 force = { unit(random) * 5.0f, 8.0f + unit(random) * 4.0f, unit(random) * 5.0f };
+				reference[id].mForce = force;
+				bodies.SetForce(id, force);
+			}
+		}
+		const size_t steps = 1 + frame % 3;
+
+		for (auto& body : reference) {
+			body.Update(steps, Step);
+		}
+		registry.UpdateBodies(steps, Step);
+
+		for (EntityID id = 0; id < BodyCount && failures < 10; ++id) {
+			const auto& expected = reference[id];
+			const auto& transform = registry.mTransforms.Get(id);
+			const auto index = bodies.mIndices[id];
+			const glm::vec3 velocity = { bodies.mVelX[index], bodies.mVelY[index], bodies.mVelZ[index] };
+			const auto prevOffset = expected.mPrevPos - expected.mPos;
+			if (!Near(transform.mPos, expected.mPos) || !Near(velocity, expected.mVelocity) || !Near(transform.mPrevOffset, prevOffset)
+				|| bodies.IsGrounded(id) != expected.mGrounded) {
+				std::cerr << "Frame " << frame << ", body " << id << ": position " << glm::to_string(transform.mPos) << " expected " << glm::to_string(expected.mPos)
+					<< ", velocity " << glm::to_string(velocity) << " expected " << glm::to_string(expected.mVelocity)
+					<< ", offset " << glm::to_string(transform.mPrevOffset) << " expected " << glm::to_string(prevOffset) << std::endl;
+				failures++;
+			}
+		}
+	}
+
+	if (failures) {
+		std::cerr << "BodyIntegratorTest failed" << std::endl;
+		return 1;
+	}
+	std::cout << "BodyIntegratorTest passed: " << BodyCount << " bodies, " << FrameCount << " frames" << std::endl;
+	return 0;
+}
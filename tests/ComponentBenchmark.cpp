@@ -0,0 +1,187 @@
+#include "../Components.h"
+
+// Times the per entity update of the old Scene, virtual Update calls on heap
+// allocated Entities holding all of their state, against the component
+// systems that replaced it (EntityRegistry::UpdateBodies and UpdateTransforms)
+// for the same falling bodies. Needs no GL context, build with optimizations.
+
+// Copy of the non rigid body part of the old Entity::Update. Only the
+// "Grounded!" log line is left out, it would dominate the timing.
+struct LegacyEntity {
+	ShaderProgram_ mShaderProgram;
+	Model_ mModel = nullptr;
+	glm::vec3 mPos = { 0,0,0 };
+	glm::vec3 mFront = { 0,0,1 };
+	glm::vec3 mUp = { 0,1,0 };
+	glm::quat mRot = { 1,0,0,0 };
+	glm::vec3 mScale = { 1,1,1 };
+	glm::mat4 mTransform = glm::identity<glm::mat4>();
+	AnimationController_ mAnimationController;
+	bool mControllable = false;
+	bool mUseGravity = true;
+	glm::vec3 mVelocity = { 0,0,0 };
+	glm::vec3 mGravity = { 0, -10, 0 };
+	bool mGrounded = false;
+	std::string mName;
+	std::shared_ptr<LegacyEntity> mAttachTo;
+	uint32_t mAttachToNode = -1;
+	void* mRigidBody = nullptr;
+	glm::vec3 mTargetFront;
+	bool mTargetFrontEnable = false;
+	glm::vec3 mForce = { 0,0,0 };
+	float mMass = 1.0f;
+	float mStep = 1.0f / 60.0f;
+	float mAccum = 0.0f;
+	float mMaxVelocity = 100.0f;
+	glm::vec3 mPrevPos;
+	glm::quat mPrevRot;
+	std::deque<float> mHistoryY;
+	bool mKeepHistory = true;
+
+	virtual ~LegacyEntity() {}
+
+	glm::vec3 GetGravity() {
+		return mUseGravity ? mGravity : glm::zero<glm::vec3>();
+	}
+
+	float GetDampening() {
+		return mGrounded ? 2.0f : 1.0f;
+	}
+
+	void UpdatePhysics(float deltaTime) {
+		if (!mUseGravity) return;
+		mPrevPos = mPos;
+		mPrevRot = mRot;
+		mAccum += deltaTime;
+		if (mAccum < mStep) return;
+		while (mAccum >= mStep) {
+			UpdatePhysicsStep();
+			mAccum -= mStep;
+		}
+		if (mPos.y <= 0) {
+			mPos.y = 0;
+			if (!mGrounded && mForce.y < 0.001f) {
+				mGrounded = true;
+			}
+		}
+		if (mPos.y > 0.0f && mKeepHistory) {
+			mHistoryY.push_back(mPos.y);
+			if (mHistoryY.size() > 200) mHistoryY.pop_front();
+		}
+	}
+
+	void UpdatePhysicsStep() {
+		mVelocity = mVelocity + GetGravity() * mStep + mForce;
+		mPos = mPos + mVelocity * mStep;
+		mVelocity = mVelocity / (1.0f + GetDampening() * mStep);
+
+		auto velocity = glm::length(mVelocity);
+		if (velocity > mMaxVelocity) {
+			mVelocity = mVelocity * (mMaxVelocity / velocity);
+		}
+
+		mForce = { 0,0,0 };
+	}
+
+	virtual void Update(float absoluteTime, float deltaTime) {
+		if (mTargetFrontEnable) {
+			mFront = mTargetFront;
+			mRot = glm::quatLookAt(-mTargetFront, mUp);
+			if (glm::all(glm::epsilonEqual(mFront, mTargetFront, 0.001f))) {
+				mTargetFrontEnable = false;
+			}
+		}
+		if (mRigidBody) return;
+		UpdatePhysics(deltaTime);
+		auto lp = std::min(deltaTime, 1.0f);
+		auto pos = glm::lerp(mPrevPos, mPos, lp);
+		auto rot = glm::lerp(mPrevRot, mRot, lp);
+		mTransform = glm::translate(glm::identity<glm::mat4>(), pos);
+		mTransform *= glm::mat4_cast(rot);
+		mTransform = glm::scale(mTransform, mScale);
+		if (mAttachTo) {
+			mTransform = mAttachTo->mTransform * mTransform;
+		}
+	}
+};
+
+// Median of the per frame times in ms
+template<typename F>
+static double TimeFrames(size_t frames, F update) {
+	std::vector<double> times;
+	for (size_t frame = 0; frame < frames; ++frame) {
+		const auto start = std::chrono::steady_clock::now();
+		update(frame);
+		times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+	return times[times.size() / 2];
+}
+
+int main() {
+	constexpr size_t EntityCount = 100000;
+	constexpr size_t FrameCount = 300;
+	constexpr float Step = 1.0f / 60.0f;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<glm::vec3> start(EntityCount);
+	for (auto& pos : start) {
+		pos = { unit(random) * 100.0f, 50.0f + unit(random) * 50.0f, unit(random) * 100.0f };
+	}
+
+	auto runLegacy = [&](bool keepHistory) {
+		std::vector<std::shared_ptr<LegacyEntity>> entities;
+		for (const auto& pos : start) {
+			auto entity = std::make_shared<LegacyEntity>();
+			entity->mPos = pos;
+			entity->mKeepHistory = keepHistory;
+			entities.push_back(entity);
+		}
+		double checksum = 0.0;
+		const auto ms = TimeFrames(FrameCount, [&](size_t frame) {
+			for (auto& entity : entities) {
+				entity->Update(frame * Step, Step);
+			}
+		});
+		for (const auto& entity : entities) {
+			checksum += entity->mPos.y;
+		}
+		return std::make_pair(ms, checksum);
+	};
+
+	auto runSystems = [&]() {
+		EntityRegistry registry;
+		for (const auto& pos : start) {
+			const auto id = registry.Create(nullptr);
+			registry.mTransforms.Get(id).mPos = pos;
+			registry.mBodies.Add(id);
+		}
+		double checksum = 0.0;
+		const auto ms = TimeFrames(FrameCount, [&](size_t) {
+			registry.UpdateBodies(1, Step);
+			registry.UpdateTransforms();
+		});
+		for (const auto& transform : registry.mTransforms.mData) {
+			checksum += transform.mPos.y;
+		}
+		return std::make_pair(ms, checksum);
+	};
+
+	const auto legacy = runLegacy(true);
+	const auto legacyNoHistory = runLegacy(false);
+	const auto systems = runSystems();
+
+	std::cout << EntityCount << " entities, " << FrameCount << " frames, median ms per frame" << std::endl;
+	std::cout << "  Entity::Update loop:              " << legacy.first << " ms" << std::endl;
+	std::cout << "  Entity::Update loop, no history:  " << legacyNoHistory.first << " ms" << std::endl;
+	std::cout << "  UpdateBodies + UpdateTransforms:  " << systems.first << " ms (" << legacy.first / systems.first << "x, "
+		<< legacyNoHistory.first / systems.first << "x without history)" << std::endl;
+
+	// Same integrator, the final heights must agree
+	if (std::abs(legacy.second - systems.second) > 1e-3 * std::max(1.0, std::abs(legacy.second))) {
+		std::cerr << "ComponentBenchmark: results differ, " << legacy.second << " vs " << systems.second << std::endl;
+		return 1;
+	}
+	return 0;
+}
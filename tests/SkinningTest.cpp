@@ -0,0 +1,158 @@
+#include "../Skinning.h"
+#include <limits>
+
+// Checks SkinVertexScalar against hand computed results for a known palette,
+// the SSE version against the scalar one on random vertices, and SkinMesh on
+// a small mesh. Links with Skinning.cpp.
+
+static size_t sFailures = 0;
+
+static void Check(bool condition, const std::string& what) {
+	if (!condition) {
+		std::cerr << "Failed: " << what << std::endl;
+		sFailures++;
+	}
+}
+
+static bool Near(const glm::vec3& a, const glm::vec3& b, float tolerance = 1e-5f) {
+	return glm::all(glm::epsilonEqual(a, b, tolerance * std::max(1.0f, std::max(glm::length(a), glm::length(b)))));
+}
+
+static Vertex MakeVertex(const glm::vec3& pos, const glm::vec3& normal, std::initializer_list<std::pair<uint32_t, float>> weights) {
+	Vertex vertex;
+	vertex.mPos = pos;
+	vertex.mNormal = normal;
+	for (const auto& weight : weights) {
+		vertex.AddBoneWeight(weight.first, weight.second);
+	}
+	return vertex;
+}
+
+// 0: translation, 1: 90 degrees around y, 2: uniform scale, 3: identity
+static std::vector<glm::mat4> KnownPalette() {
+	return {
+		glm::translate(glm::identity<glm::mat4>(), { 1, 2, 3 }),
+		glm::rotate(glm::identity<glm::mat4>(), glm::half_pi<float>(), { 0, 1, 0 }),
+		glm::scale(glm::identity<glm::mat4>(), { 2, 2, 2 }),
+		glm::identity<glm::mat4>(),
+	};
+}
+
+static void TestKnownPalette() {
+	const auto bones = KnownPalette();
+	struct Case {
+		const char* mName;
+		Vertex mVertex;
+		glm::vec3 mPosition;
+		glm::vec3 mNormal;
+	};
+	const Case cases[] = {
+		{ "unweighted", MakeVertex({ 1, 2, 3 }, { 0, 1, 0 }, {}), { 1, 2, 3 }, { 0, 1, 0 } },
+		{ "translated", MakeVertex({ 1, 0, 0 }, { 0, 1, 0 }, { { 0, 1.0f } }), { 2, 2, 3 }, { 0, 1, 0 } },
+		{ "rotated", MakeVertex({ 1, 0, 0 }, { 1, 0, 0 }, { { 1, 1.0f } }), { 0, 0, -1 }, { 0, 0, -1 } },
+		{ "half translated, half scaled", MakeVertex({ 1, 1, 1 }, { 0, 0, 1 }, { { 0, 0.5f }, { 2, 0.5f } }), { 2, 2.5f, 3 }, { 0, 0, 1.5f } },
+		// 0.75 of the identity for the unweighted remainder
+		{ "partly rotated", MakeVertex({ 1, 0, 0 }, { 1, 0, 0 }, { { 1, 0.25f } }), { 0.75f, 0, -0.25f }, { 0.75f, 0, -0.25f } },
+		{ "four bones", MakeVertex({ 0, 1, 0 }, { 0, 1, 0 }, { { 0, 0.25f }, { 1, 0.25f }, { 2, 0.25f }, { 3, 0.25f } }), { 0.25f, 1.75f, 0.75f }, { 0, 1.25f, 0 } },
+	};
+	for (const auto& test : cases) {
+		glm::vec3 position, normal;
+		SkinVertexScalar(test.mVertex, bones.data(), position, &normal);
+		Check(Near(position, test.mPosition), std::string("scalar position, ") + test.mName + ": " + glm::to_string(position));
+		Check(Near(normal, test.mNormal), std::string("scalar normal, ") + test.mName + ": " + glm::to_string(normal));
+#ifdef SKINNING_SSE
+		SkinVertexSse(test.mVertex, bones.data(), position, &normal);
+		Check(Near(position, test.mPosition), std::string("SSE position, ") + test.mName + ": " + glm::to_string(position));
+		Check(Near(normal, test.mNormal), std::string("SSE normal, ") + test.mName + ": " + glm::to_string(normal));
+#endif
+	}
+}
+
+static void TestSseMatchesScalar() {
+#ifdef SKINNING_SSE
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<uint32_t> boneIndex(0, 7);
+	std::vector<glm::mat4> bones;
+	for (size_t i = 0; i < 8; i++) {
+		auto bone = glm::translate(glm::identity<glm::mat4>(), glm::vec3(unit(random), unit(random), unit(random)) * 5.0f);
+		bone = glm::rotate(bone, unit(random) * glm::pi<float>(), glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0, 0, 2)));
+		bones.push_back(glm::scale(bone, glm::vec3(1.0f + unit(random) * 0.5f)));
+	}
+	for (size_t i = 0; i < 10000; i++) {
+		Vertex vertex;
+		vertex.mPos = glm::vec3(unit(random), unit(random), unit(random)) * 10.0f;
+		vertex.mNormal = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0, 0, 2));
+		// Weights sum to at most 1, some vertices keep part of the identity
+		float remaining = 1.0f;
+		const auto weights = 1 + i % 4;
+		for (size_t k = 0; k < weights; k++) {
+			const auto weight = k + 1 == weights && i % 3 ? remaining : remaining * (0.5f + 0.5f * unit(random)) * 0.5f;
+			vertex.AddBoneWeight(boneIndex(random), weight);
+			remaining -= weight;
+		}
+		glm::vec3 scalarPosition, scalarNormal, ssePosition, sseNormal;
+		SkinVertexScalar(vertex, bones.data(), scalarPosition, &scalarNormal);
+		SkinVertexSse(vertex, bones.data(), ssePosition, &sseNormal);
+		Check(Near(ssePosition, scalarPosition, 1e-4f), "SSE position of random vertex " + std::to_string(i) + ": " + glm::to_string(ssePosition) + " != " + glm::to_string(scalarPosition));
+		Check(Near(sseNormal, scalarNormal, 1e-4f), "SSE normal of random vertex " + std::to_string(i) + ": " + glm::to_string(sseNormal) + " != " + glm::to_string(scalarNormal));
+		if (sFailures > 10) return;
+	}
+#else
+	std::cout << "SSE not available, skipping the SSE comparison" << std::endl;
+#endif
+}
+
+static void TestSkinMesh() {
+	Mesh mesh;
+	// More vertices than one batch, so the parallel split is covered
+	for (size_t i = 0; i < 3000; i++) {
+		const auto x = (float)(i % 100);
+		const auto z = (float)(i / 100);
+		mesh.mVertices.push_back(MakeVertex({ x, 0, z }, { 0, 1, 0 }, { { (uint32_t)(i % 4), 0.5f }, { (uint32_t)((i + 1) % 4), 0.25f } }));
+	}
+	for (uint32_t i = 0; i + 2 < 3000; i += 3) {
+		mesh.mIndices.insert(mesh.mIndices.end(), { i, i + 1, i + 100 < 3000 ? i + 100 : i + 2 });
+	}
+
+	const auto bones = KnownPalette();
+	SkinnedMesh skinned;
+	Check(SkinMesh(mesh, bones, skinned), "SkinMesh with CPU data");
+	Check(skinned.mPositions.size() == mesh.mVertices.size() && skinned.mNormals.size() == mesh.mVertices.size(), "SkinMesh result size");
+	auto min = glm::vec3(std::numeric_limits<float>::max());
+	auto max = -min;
+	for (size_t i = 0; i < mesh.mVertices.size() && i < skinned.mPositions.size(); i++) {
+		glm::vec3 position, normal;
+		SkinVertexScalar(mesh.mVertices[i], bones.data(), position, &normal);
+		Check(Near(skinned.mPositions[i], position, 1e-4f), "SkinMesh position " + std::to_string(i));
+		Check(Near(skinned.mNormals[i], normal, 1e-4f), "SkinMesh normal " + std::to_string(i));
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+		if (sFailures > 10) return;
+	}
+	Check(Near(skinned.mAABB.GetMin(), min, 1e-4f) && Near(skinned.mAABB.GetMax(), max, 1e-4f), "SkinMesh bounds");
+
+	Check(SkinMesh(mesh, {}, skinned, false), "SkinMesh in bind pose");
+	Check(skinned.mNormals.empty(), "SkinMesh without normals");
+	Check(skinned.mPositions.size() == mesh.mVertices.size() && skinned.mPositions.back() == mesh.mVertices.back().mPos, "bind pose positions");
+
+	// A ray straight down through the first triangle
+	const auto& p0 = mesh.mVertices[mesh.mIndices[0]].mPos;
+	const auto& p1 = mesh.mVertices[mesh.mIndices[1]].mPos;
+	const auto& p2 = mesh.mVertices[mesh.mIndices[2]].mPos;
+	const auto center = (p0 + p1 + p2) / 3.0f;
+	float distance = 0.0f;
+	Check(RayCastSkinned(mesh, skinned, center + glm::vec3(0, 5, 0), { 0, -1, 0 }, 100.0f, distance) && std::abs(distance - 5.0f) < 1e-4f, "RayCastSkinned in bind pose");
+}
+
+int main() {
+	TestKnownPalette();
+	TestSseMatchesScalar();
+	TestSkinMesh();
+	if (sFailures) {
+		std::cerr << "SkinningTest failed: " << sFailures << " checks" << std::endl;
+		return 1;
+	}
+	std::cout << "SkinningTest passed" << std::endl;
+	return 0;
+}